@@ -2,7 +2,7 @@ EXEC = solitaire
 VERSION = 1.0.0
 
 CC = cc
-CFLAGS = -Wall
+CFLAGS = -Wall -pthread
 CPPFLAGS =
-LDFLAGS =
+LDFLAGS = -pthread
 LDLIBS = -lncursesw
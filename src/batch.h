@@ -0,0 +1,502 @@
+#ifndef SOLITAIRE_BATCH
+#define SOLITAIRE_BATCH
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "./cards.h"
+#include "./policy.h"
+#include "./playcheck.h"
+
+// batch engine: BATCH_LANES games stepped in lockstep, one move per game per step, for playouts
+// everything a move is checked against (column heights, face down counts, top cards, foundations, the waste top and
+// the pile counts) is kept as [pile][lane] arrays, so finding the legal moves, picking one and updating those arrays
+// are plain loops over the lanes that the compiler vectorizes, like estimate_block()
+// the cards under the tops are kept per lane, only lanes whose move lifts cards off a pile touch them, one at a time
+// the rules are move_card()'s and a draw's, batch_move() turns a batch move into the Move apply_move() would take
+
+#define BATCH_LANES 64
+
+// piles in a batch move, a move from BATCH_STOCK draws (or turns the waste over), BATCH_NO_PILE sits the step out
+#define BATCH_WASTE TABLEAU_COLUMNS
+#define BATCH_STOCK (TABLEAU_COLUMNS + 1)
+#define BATCH_FOUNDATION (TABLEAU_COLUMNS + 2)
+#define BATCH_PILES (BATCH_FOUNDATION + FOUNDATION_PILES)
+#define BATCH_NO_PILE 0xff
+
+typedef struct {
+    // cards are rank | suite << 4 like pack_card() without the visible bit, 0 for no card
+    // a tableau card is face up when its row is at least the column's down count
+    uint8_t height[TABLEAU_COLUMNS][BATCH_LANES];
+    uint8_t down[TABLEAU_COLUMNS][BATCH_LANES];
+    uint8_t top[TABLEAU_COLUMNS][BATCH_LANES];
+    uint8_t foundation[FOUNDATION_PILES][BATCH_LANES];
+    uint8_t waste_top[BATCH_LANES];
+    uint8_t waste_count[BATCH_LANES];
+    uint8_t stock_count[BATCH_LANES];
+    uint8_t tableau[BATCH_LANES][TABLEAU_COLUMNS][COLUMN_SLOTS];
+    uint8_t waste[BATCH_LANES][PILE_SLOTS];
+    uint8_t stock[BATCH_LANES][PILE_SLOTS]; // the top is the last card, like Game
+} GameBatch;
+
+typedef struct {
+    uint8_t legal[BATCH_PILES][BATCH_PILES][BATCH_LANES]; // [from][to], 1 for a legal move
+    uint16_t count[BATCH_LANES];
+} BatchLegal;
+
+typedef struct {
+    uint8_t from[BATCH_LANES];
+    uint8_t to[BATCH_LANES];
+} BatchMoves;
+
+typedef struct {
+    long games;
+    long wins;
+    long steps;
+    double seconds;
+} BatchResult;
+
+GameBatch *create_game_batch();
+void batch_deal(GameBatch *batch, int lane, const uint8_t *deal);
+void batch_pack(GameBatch *batch, int lane, PackedGame *packed);
+void batch_legal_moves(GameBatch *restrict batch, BatchLegal *restrict legal);
+void batch_pick_random(BatchLegal *restrict legal, uint64_t *restrict rng, BatchMoves *restrict moves);
+void batch_apply(GameBatch *restrict batch, const BatchMoves *restrict moves);
+void batch_won(GameBatch *restrict batch, uint8_t *restrict won);
+Move batch_move(GameBatch *batch, int lane, int from, int to);
+bool play_random_batch(unsigned int first_seed, long deals, BatchResult *result);
+void play_random_single(unsigned int first_seed, long deals, BatchResult *result);
+bool check_batch(unsigned int first_seed, long deals, long *steps, char *message);
+
+#ifdef SOLITAIRE_BATCH_IMPLEMENTATION
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+GameBatch *create_game_batch() {
+    // every lane starts out empty, batch_deal() fills one
+    GameBatch *batch = aligned_alloc(64, sizeof(GameBatch));
+    if (batch) memset(batch, 0, sizeof(GameBatch));
+    return batch;
+}
+
+void batch_deal(GameBatch *batch, int lane, const uint8_t *deal) {
+    // deal is DECK_CARDS bytes as from deal_permutation(), laid out like deal_game() does it
+    for (int column = 0, i = 0; column < TABLEAU_COLUMNS; ++column) {
+        for (int row = 0; row <= column; ++row) batch->tableau[lane][column][row] = deal[i++];
+        batch->height[column][lane] = column + 1;
+        batch->down[column][lane] = column;
+        batch->top[column][lane] = deal[i - 1];
+    }
+    for (int f = 0; f < FOUNDATION_PILES; ++f) batch->foundation[f][lane] = 0;
+    memcpy(batch->stock[lane], &deal[DEALT_CARDS], STOCK_CARDS);
+    batch->stock_count[lane] = STOCK_CARDS;
+    batch->waste_count[lane] = 0;
+    batch->waste_top[lane] = 0;
+}
+
+void batch_pack(GameBatch *batch, int lane, PackedGame *packed) {
+    // the same bytes pack_game() gives for the game in the lane
+    int i = 0;
+    for (int f = 0; f < FOUNDATION_PILES; ++f) packed->foundation[f] = batch->foundation[f][lane];
+    for (int column = 0; column < TABLEAU_COLUMNS; ++column) {
+        int height = batch->height[column][lane];
+        for (int row = 0; row < height; ++row) {
+            packed->cards[i++] = batch->tableau[lane][column][row] | (row >= batch->down[column][lane]) << 7;
+        }
+        packed->tableau_count[column] = height;
+    }
+    packed->waste_count = batch->waste_count[lane];
+    for (int j = 0; j < batch->waste_count[lane]; ++j) packed->cards[i++] = batch->waste[lane][j];
+    packed->stock_count = batch->stock_count[lane];
+    for (int j = 0; j < batch->stock_count[lane]; ++j) packed->cards[i++] = batch->stock[lane][j];
+    for (; i < DECK_CARDS; ++i) packed->cards[i] = 0;
+}
+
+static inline uint8_t batch_on_column(uint8_t card, uint8_t onto) {
+    // can_stack() onto a column with onto on top, 0 for an empty column
+    uint8_t on_card = ((onto & 15) == (card & 15) + 1) & (((card ^ onto) & 0x20) != 0);
+    uint8_t on_empty = (card & 15) == KING;
+    return (card != 0) & (onto ? on_card : on_empty);
+}
+
+static inline uint8_t batch_on_foundation(uint8_t card, uint8_t pile) {
+    // can_stack() onto a foundation, the next rank of the same suite is just the next byte
+    return (card != 0) & (pile ? card == pile + 1 : (card & 15) == ACE);
+}
+
+static inline uint8_t batch_run_length(uint8_t top, uint8_t up, uint8_t onto) {
+    // how many cards from the top of a column go on a column with onto on top, 0 if none can
+    // the face up cards of a column always form a run, the card k below the top is one rank higher per step and
+    // changes colour every step, so the card that fits is found from the top card alone
+    // nothing goes on an ace, a king goes on an empty column
+    uint8_t need = onto ? (onto & 15) - 1 : KING;
+    uint8_t below = need - (top & 15); // wraps around when the top is already higher
+    uint8_t colour = (onto == 0) | ((((top ^ onto) & 0x20) != 0) ^ (below & 1));
+    return (top != 0) & ((onto & 15) != ACE) & (below < up) & colour ? below + 1 : 0;
+}
+
+void batch_legal_moves(GameBatch *restrict batch, BatchLegal *restrict legal) {
+    // every move get_legal_moves() would list, as [from][to] flags per lane
+    memset(legal, 0, sizeof(BatchLegal));
+    for (int from = 0; from < TABLEAU_COLUMNS; ++from) {
+        uint8_t *top = batch->top[from];
+        for (int to = 0; to < TABLEAU_COLUMNS; ++to) {
+            if (to == from) continue;
+            uint8_t *onto = batch->top[to], *flags = legal->legal[from][to];
+            for (int lane = 0; lane < BATCH_LANES; ++lane) {
+                uint8_t up = batch->height[from][lane] - batch->down[from][lane];
+                flags[lane] = batch_run_length(top[lane], up, onto[lane]) != 0;
+            }
+        }
+        for (int f = 0; f < FOUNDATION_PILES; ++f) {
+            uint8_t *pile = batch->foundation[f], *flags = legal->legal[from][BATCH_FOUNDATION + f];
+            for (int lane = 0; lane < BATCH_LANES; ++lane) flags[lane] = batch_on_foundation(top[lane], pile[lane]);
+        }
+    }
+    for (int to = 0; to < TABLEAU_COLUMNS; ++to) {
+        uint8_t *onto = batch->top[to], *flags = legal->legal[BATCH_WASTE][to];
+        for (int lane = 0; lane < BATCH_LANES; ++lane) flags[lane] = batch_on_column(batch->waste_top[lane], onto[lane]);
+        for (int f = 0; f < FOUNDATION_PILES; ++f) {
+            uint8_t *pile = batch->foundation[f];
+            flags = legal->legal[BATCH_FOUNDATION + f][to];
+            for (int lane = 0; lane < BATCH_LANES; ++lane) flags[lane] = batch_on_column(pile[lane], onto[lane]);
+        }
+    }
+    for (int f = 0; f < FOUNDATION_PILES; ++f) {
+        uint8_t *pile = batch->foundation[f], *flags = legal->legal[BATCH_WASTE][BATCH_FOUNDATION + f];
+        for (int lane = 0; lane < BATCH_LANES; ++lane) flags[lane] = batch_on_foundation(batch->waste_top[lane], pile[lane]);
+    }
+    uint8_t *draws = legal->legal[BATCH_STOCK][BATCH_WASTE];
+    for (int lane = 0; lane < BATCH_LANES; ++lane) draws[lane] = (batch->stock_count[lane] | batch->waste_count[lane]) != 0;
+
+    uint16_t count[BATCH_LANES] = {0};
+    for (int from = 0; from < BATCH_PILES; ++from) {
+        for (int to = 0; to < BATCH_PILES; ++to) {
+            uint8_t *flags = legal->legal[from][to];
+            for (int lane = 0; lane < BATCH_LANES; ++lane) count[lane] += flags[lane];
+        }
+    }
+    memcpy(legal->count, count, sizeof(count));
+}
+
+void batch_pick_random(BatchLegal *restrict legal, uint64_t *restrict rng, BatchMoves *restrict moves) {
+    // one legal move per lane, uniformly at random from that lane's rng, BATCH_NO_PILE where there are none
+    // every lane counts down its pick over the moves in [from][to] order, so there is no per lane search
+    uint16_t left[BATCH_LANES];
+    uint8_t from[BATCH_LANES], to[BATCH_LANES];
+    for (int lane = 0; lane < BATCH_LANES; ++lane) {
+        left[lane] = (uint16_t) ((policy_random(&rng[lane]) >> 32) * legal->count[lane] >> 32);
+    }
+    memset(from, BATCH_NO_PILE, sizeof(from));
+    memset(to, BATCH_NO_PILE, sizeof(to));
+    for (int source = 0; source < BATCH_PILES; ++source) {
+        for (int target = 0; target < BATCH_PILES; ++target) {
+            uint8_t *flags = legal->legal[source][target];
+            for (int lane = 0; lane < BATCH_LANES; ++lane) {
+                bool hit = flags[lane] & (left[lane] == 0);
+                from[lane] = hit ? source : from[lane];
+                to[lane] = hit ? target : to[lane];
+                left[lane] -= flags[lane];
+            }
+        }
+    }
+    memcpy(moves->from, from, sizeof(from));
+    memcpy(moves->to, to, sizeof(to));
+}
+
+void batch_apply(GameBatch *restrict batch, const BatchMoves *restrict moves) {
+    // makes one legal move per lane (as from batch_legal_moves()), lanes with BATCH_NO_PILE stay as they are
+    const uint8_t *from = moves->from, *to = moves->to;
+    uint8_t card[BATCH_LANES] = {0}; // what goes on the destination's top
+    uint8_t count[BATCH_LANES] = {0}; // cards that move
+    uint8_t source_top[BATCH_LANES] = {0}, source_height[BATCH_LANES] = {0}, source_down[BATCH_LANES] = {0};
+    uint8_t target_top[BATCH_LANES] = {0}, target_height[BATCH_LANES] = {0};
+    uint8_t left_top[BATCH_LANES] = {0}; // the source column's new top
+
+    // the piles of each lane's move, picked with selects over every pile rather than indexed by lane
+    for (int column = 0; column < TABLEAU_COLUMNS; ++column) {
+        for (int lane = 0; lane < BATCH_LANES; ++lane) {
+            bool is_from = from[lane] == column, is_to = to[lane] == column;
+            uint8_t top = batch->top[column][lane], height = batch->height[column][lane], down = batch->down[column][lane];
+            source_top[lane] = is_from ? top : source_top[lane];
+            source_height[lane] = is_from ? height : source_height[lane];
+            source_down[lane] = is_from ? down : source_down[lane];
+            target_top[lane] = is_to ? top : target_top[lane];
+            target_height[lane] = is_to ? height : target_height[lane];
+        }
+    }
+    for (int f = 0; f < FOUNDATION_PILES; ++f) {
+        for (int lane = 0; lane < BATCH_LANES; ++lane) {
+            uint8_t pile = batch->foundation[f][lane];
+            card[lane] = from[lane] == BATCH_FOUNDATION + f ? pile : card[lane];
+        }
+    }
+    for (int lane = 0; lane < BATCH_LANES; ++lane) {
+        // a run between columns, otherwise a single card, or nothing for a draw or no move
+        bool column_run = (from[lane] < TABLEAU_COLUMNS) & (to[lane] < TABLEAU_COLUMNS);
+        uint8_t up = source_height[lane] - source_down[lane], waste_top = batch->waste_top[lane];
+        uint8_t run = batch_run_length(source_top[lane], up, target_top[lane]);
+        uint8_t single = (from[lane] != BATCH_STOCK) & (from[lane] != BATCH_NO_PILE);
+        card[lane] = from[lane] == BATCH_WASTE ? waste_top : card[lane];
+        card[lane] = from[lane] < TABLEAU_COLUMNS ? source_top[lane] : card[lane];
+        count[lane] = column_run ? run : single;
+    }
+
+    // the cards under the tops, one lane at a time
+    for (int lane = 0; lane < BATCH_LANES; ++lane) {
+        int source = from[lane], target = to[lane];
+        if (source == BATCH_NO_PILE) continue;
+        if (source < TABLEAU_COLUMNS) {
+            int left = source_height[lane] - count[lane];
+            left_top[lane] = left ? batch->tableau[lane][source][left - 1] : 0;
+            if (target < TABLEAU_COLUMNS) {
+                memcpy(&batch->tableau[lane][target][target_height[lane]], &batch->tableau[lane][source][left], count[lane]);
+            }
+            continue;
+        }
+        if (target < TABLEAU_COLUMNS) batch->tableau[lane][target][target_height[lane]] = card[lane];
+        if (source == BATCH_WASTE) {
+            int waste = --batch->waste_count[lane];
+            batch->waste_top[lane] = waste ? batch->waste[lane][waste - 1] : 0;
+        } else if (source == BATCH_STOCK) {
+            int stock = batch->stock_count[lane], waste = batch->waste_count[lane];
+            if (stock) {
+                uint8_t drawn = batch->stock[lane][stock - 1];
+                batch->waste[lane][waste] = drawn;
+                batch->waste_top[lane] = drawn;
+                batch->stock_count[lane] = stock - 1;
+                batch->waste_count[lane] = waste + 1;
+            } else {
+                // turned over, the first card drawn is on top of the stock again
+                for (int i = 0; i < waste; ++i) batch->stock[lane][i] = batch->waste[lane][waste - 1 - i];
+                batch->waste_top[lane] = 0;
+                batch->stock_count[lane] = waste;
+                batch->waste_count[lane] = 0;
+            }
+        }
+    }
+
+    // the [pile][lane] arrays, a column that loses its last face up card turns the one under it over
+    for (int column = 0; column < TABLEAU_COLUMNS; ++column) {
+        for (int lane = 0; lane < BATCH_LANES; ++lane) {
+            bool is_from = from[lane] == column, is_to = to[lane] == column;
+            uint8_t left = source_height[lane] - count[lane];
+            uint8_t down = (source_down[lane] == left) & (left != 0) ? left - 1 : source_down[lane];
+            uint8_t top = batch->top[column][lane], height = batch->height[column][lane];
+            top = is_to ? card[lane] : top;
+            height = is_to ? height + count[lane] : height;
+            batch->top[column][lane] = is_from ? left_top[lane] : top;
+            batch->height[column][lane] = is_from ? left : height;
+            batch->down[column][lane] = is_from ? down : batch->down[column][lane];
+        }
+    }
+    for (int f = 0; f < FOUNDATION_PILES; ++f) {
+        for (int lane = 0; lane < BATCH_LANES; ++lane) {
+            // a foundation that gives up its ace is empty again
+            uint8_t pile = batch->foundation[f][lane], lower = (pile & 15) == ACE ? 0 : pile - 1;
+            pile = from[lane] == BATCH_FOUNDATION + f ? lower : pile;
+            batch->foundation[f][lane] = to[lane] == BATCH_FOUNDATION + f ? card[lane] : pile;
+        }
+    }
+}
+
+void batch_won(GameBatch *restrict batch, uint8_t *restrict won) {
+    for (int lane = 0; lane < BATCH_LANES; ++lane) won[lane] = 1;
+    for (int f = 0; f < FOUNDATION_PILES; ++f) {
+        for (int lane = 0; lane < BATCH_LANES; ++lane) won[lane] &= (batch->foundation[f][lane] & 15) == KING;
+    }
+}
+
+Move batch_move(GameBatch *batch, int lane, int from, int to) {
+    // the move as get_legal_moves() lists it, rows included
+    if (from == BATCH_STOCK) return (Move) {{true, STOCK, 0, 0}, {true, WASTE, 0, 0}};
+    Move move;
+    if (from < TABLEAU_COLUMNS) {
+        int count = 1;
+        if (to < TABLEAU_COLUMNS) {
+            uint8_t up = batch->height[from][lane] - batch->down[from][lane];
+            count = batch_run_length(batch->top[from][lane], up, batch->top[to][lane]);
+        }
+        move.from = (CardPos) {true, TABLEAU, from, batch->height[from][lane] - count};
+    } else if (from == BATCH_WASTE) {
+        move.from = (CardPos) {true, WASTE, 0, 0};
+    } else {
+        move.from = (CardPos) {true, FOUNDATION, from - BATCH_FOUNDATION, 0};
+    }
+    if (to < TABLEAU_COLUMNS) {
+        int height = batch->height[to][lane];
+        move.to = (CardPos) {true, TABLEAU, to, height ? height - 1 : 0};
+    } else {
+        move.to = (CardPos) {true, FOUNDATION, to - BATCH_FOUNDATION, 0};
+    }
+    return move;
+}
+
+// random playouts: every game makes uniformly random legal moves until it is won, has no move left, or has made
+// POLICY_MAX_MOVES of them, a lane that finishes takes the next deal straight away
+
+typedef struct {
+    GameBatch *batch;
+    BatchLegal *legal;
+    BatchMoves moves;
+    uint64_t rng[BATCH_LANES];
+    int steps[BATCH_LANES]; // moves made by the game in the lane
+    unsigned int seeds[BATCH_LANES];
+    bool live[BATCH_LANES];
+    unsigned int first_seed;
+    long deals;
+    long next_deal;
+} BatchPlayout;
+
+bool batch_next_deal(BatchPlayout *playout, int lane) {
+    // false once every deal has been handed out
+    if (playout->next_deal >= playout->deals) return playout->live[lane] = false;
+    unsigned int seed = playout->first_seed + (unsigned int) playout->next_deal++;
+    uint8_t deal[DECK_CARDS];
+    deal_permutation(seed, deal);
+    batch_deal(playout->batch, lane, deal);
+    playout->rng[lane] = deal_random(seed, 0x80000000u) | 1;
+    playout->steps[lane] = 0;
+    playout->seeds[lane] = seed;
+    return playout->live[lane] = true;
+}
+
+bool start_batch_playout(BatchPlayout *playout, unsigned int first_seed, long deals) {
+    playout->batch = create_game_batch();
+    playout->legal = malloc(sizeof(BatchLegal));
+    if (!playout->batch || !playout->legal) {
+        free(playout->batch);
+        free(playout->legal);
+        return false;
+    }
+    playout->first_seed = first_seed;
+    playout->deals = deals;
+    playout->next_deal = 0;
+    for (int lane = 0; lane < BATCH_LANES; ++lane) batch_next_deal(playout, lane);
+    return true;
+}
+
+void batch_playout_step(BatchPlayout *playout) {
+    // picks this step's moves into playout->moves, the caller applies them
+    batch_legal_moves(playout->batch, playout->legal);
+    batch_pick_random(playout->legal, playout->rng, &playout->moves);
+    for (int lane = 0; lane < BATCH_LANES; ++lane) {
+        if (!playout->live[lane]) playout->moves.from[lane] = BATCH_NO_PILE;
+    }
+}
+
+bool play_random_batch(unsigned int first_seed, long deals, BatchResult *result) {
+    *result = (BatchResult) {0};
+    BatchPlayout playout;
+    double start = monotonic_seconds();
+    if (!start_batch_playout(&playout, first_seed, deals)) return false;
+    uint8_t won[BATCH_LANES];
+    bool playing = deals > 0;
+    while (playing) {
+        batch_playout_step(&playout);
+        batch_apply(playout.batch, &playout.moves);
+        batch_won(playout.batch, won);
+        playing = false;
+        for (int lane = 0; lane < BATCH_LANES; ++lane) {
+            if (!playout.live[lane]) continue;
+            bool moved = playout.moves.from[lane] != BATCH_NO_PILE;
+            result->steps += moved;
+            if (won[lane] || !moved || ++playout.steps[lane] >= POLICY_MAX_MOVES) {
+                ++result->games;
+                result->wins += won[lane];
+                batch_next_deal(&playout, lane);
+            }
+            playing |= playout.live[lane];
+        }
+    }
+    result->seconds = monotonic_seconds() - start;
+    free(playout.batch);
+    free(playout.legal);
+    return true;
+}
+
+void play_random_single(unsigned int first_seed, long deals, BatchResult *result) {
+    // the same playouts one Game at a time, through get_legal_moves() and apply_move()
+    *result = (BatchResult) {0};
+    Game game;
+    Move moves[MAX_LEGAL_MOVES];
+    double start = monotonic_seconds();
+    for (long deal = 0; deal < deals; ++deal) {
+        unsigned int seed = first_seed + (unsigned int) deal;
+        deal_game(&game, seed);
+        uint64_t rng = deal_random(seed, 0x80000000u) | 1;
+        for (int step = 0; step < POLICY_MAX_MOVES && !is_game_won(&game); ++step) {
+            int count = get_legal_moves(&game, moves);
+            if (count < 1) break;
+            apply_move(&game, moves[(policy_random(&rng) >> 32) * count >> 32]);
+            ++result->steps;
+        }
+        ++result->games;
+        result->wins += is_game_won(&game);
+    }
+    result->seconds = monotonic_seconds() - start;
+}
+
+bool check_batch(unsigned int first_seed, long deals, long *steps, char *message) {
+    // plays the batch playouts and every move again on a Game with apply_move(), the legal move counts and the
+    // positions after every move have to match, message (PLAY_CHECK_MESSAGE bytes) says where they first didn't
+    BatchPlayout playout;
+    if (!start_batch_playout(&playout, first_seed, deals)) {
+        strcpy(message, "out of memory");
+        return false;
+    }
+    Game *games = malloc(sizeof(Game) * BATCH_LANES);
+    bool ok = games != NULL, playing = deals > 0;
+    if (!ok) strcpy(message, "out of memory");
+    for (int lane = 0; ok && lane < BATCH_LANES; ++lane) {
+        if (playout.live[lane]) deal_game(&games[lane], playout.seeds[lane]);
+    }
+
+    *steps = 0;
+    uint8_t won[BATCH_LANES];
+    Move applied[BATCH_LANES];
+    PackedGame got;
+    while (ok && playing) {
+        batch_playout_step(&playout);
+        for (int lane = 0; ok && lane < BATCH_LANES; ++lane) {
+            if (!playout.live[lane]) continue;
+            // the batch only counts its moves, batch_move() gives them one at a time
+            if (!check_listed_moves(&games[lane], NULL, playout.legal->count[lane], message)) {
+                prefix_check_message(message, "seed %u move %d", playout.seeds[lane], playout.steps[lane]);
+                ok = false;
+            }
+            if (playout.moves.from[lane] != BATCH_NO_PILE) {
+                applied[lane] = batch_move(playout.batch, lane, playout.moves.from[lane], playout.moves.to[lane]);
+            }
+        }
+        if (!ok) break;
+        batch_apply(playout.batch, &playout.moves);
+        batch_won(playout.batch, won);
+        playing = false;
+        for (int lane = 0; ok && lane < BATCH_LANES; ++lane) {
+            if (!playout.live[lane]) continue;
+            bool moved = playout.moves.from[lane] != BATCH_NO_PILE;
+            if (moved) {
+                ++*steps;
+                batch_pack(playout.batch, lane, &got);
+                if (!check_played_move(&games[lane], applied[lane], &got, won[lane], message)) {
+                    prefix_check_message(message, "seed %u move %d", playout.seeds[lane], playout.steps[lane]);
+                    ok = false;
+                    break;
+                }
+            }
+            if (won[lane] || !moved || ++playout.steps[lane] >= POLICY_MAX_MOVES) {
+                if (batch_next_deal(&playout, lane)) deal_game(&games[lane], playout.seeds[lane]);
+            }
+            playing |= playout.live[lane];
+        }
+    }
+    free(games);
+    free(playout.batch);
+    free(playout.legal);
+    return ok;
+}
+
+#endif
+#endif
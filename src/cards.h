@@ -2,7 +2,10 @@
 #define SOLITAIRE_CARDS
 
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <unistd.h>
 
@@ -34,24 +37,89 @@ typedef struct {
     Suite suite;
     Rank rank;
 } Card;
+// the deal is fixed at compile time, so every loop over the piles keeps a constant bound and the single deck game
+// is exactly as fast as with literal numbers, build with -DSOLITAIRE_DECKS=2 (and -DSOLITAIRE_COLUMNS=9 or 10) for
+// double klondike
+#ifndef SOLITAIRE_DECKS
+#define SOLITAIRE_DECKS 1
+#endif
+#ifndef SOLITAIRE_COLUMNS
+#define SOLITAIRE_COLUMNS (SOLITAIRE_DECKS == 1 ? 7 : 9)
+#endif
+
+#define DECK_CARDS (52 * SOLITAIRE_DECKS)
+#define FOUNDATION_PILES (4 * SOLITAIRE_DECKS)
+#define TABLEAU_COLUMNS SOLITAIRE_COLUMNS
+#define DEALT_CARDS (TABLEAU_COLUMNS * (TABLEAU_COLUMNS + 1) / 2)
+#define STOCK_CARDS (DECK_CARDS - DEALT_CARDS)
+
+// piles are only as long as the most cards they can ever hold, plus one empty slot so there is always a first
+// empty slot after the top card: a column holds at most its face down cards and a run from king to ace,
+// the stock and the waste at most the cards that weren't dealt
+#define COLUMN_SLOTS (TABLEAU_COLUMNS - 1 + 13 + 1)
+#define PILE_SLOTS (STOCK_CARDS + 1)
+
+// the row above the tableau: the foundations from the left, then the waste and the stock at the right end
+#define TOP_SLOTS (TABLEAU_COLUMNS > FOUNDATION_PILES + 2 ? TABLEAU_COLUMNS : FOUNDATION_PILES + 2)
+#define WASTE_SLOT (TOP_SLOTS - 2)
+#define STOCK_SLOT (TOP_SLOTS - 1)
+
+// files that keep positions or deals (saves, replays, deal indexes) only fit builds with the same layout, this goes
+// into their version numbers so any other build turns them down, 0 for the single deck game
+#define LAYOUT_VERSION (SOLITAIRE_DECKS == 1 && TABLEAU_COLUMNS == 7 ? 0 : (SOLITAIRE_DECKS << 4 | TABLEAU_COLUMNS) << 8)
+
+#if DECK_CARDS > 255 || DEALT_CARDS > DECK_CARDS || TABLEAU_COLUMNS < 2
+#error "unsupported SOLITAIRE_DECKS or SOLITAIRE_COLUMNS"
+#endif
+
 typedef struct {
-    Card tableau[7][64];
-    Card foundation[4];
-    Card waste[64];
-    Card stock[64];
+    Card tableau[TABLEAU_COLUMNS][COLUMN_SLOTS];
+    Card foundation[FOUNDATION_PILES];
+    Card waste[PILE_SLOTS];
+    Card stock[PILE_SLOTS];
     CardPos selected;
     CardPos moving;
+    unsigned int seed;
 } Game;
+typedef struct {
+    // a move straight from one pile to another, without going through the cursor
+    // a move from the stock is a draw (or a recycle of the waste when the stock is empty)
+    CardPos from;
+    CardPos to;
+} Move;
+
+// upper bound on the number of legal moves in any position
+#define MAX_LEGAL_MOVES (256 * SOLITAIRE_DECKS)
+
+typedef struct {
+    // compact copy of the card layout (no cursor), one byte per card: rank | suite << 4 | visible << 7
+    uint8_t foundation[FOUNDATION_PILES]; // top card of each foundation, 0 if empty
+    uint8_t tableau_count[TABLEAU_COLUMNS];
+    uint8_t waste_count;
+    uint8_t stock_count;
+    uint8_t cards[DECK_CARDS]; // tableau columns bottom to top, then the waste, then the stock
+} PackedGame;
+
+// called by reset_game to pick a seed for a winnable deal, NULL when no deal index is loaded
+typedef bool (*WinnableSeedPicker)(unsigned int *seed);
+extern WinnableSeedPicker winnable_seed_picker;
+
+// called by move_card in place of the move when set, it makes the move with move_card_unhooked(), NULL to just move
+typedef bool (*MoveCardHook)(Game *game);
+extern MoveCardHook move_card_hook;
 
 Game *create_game();
-void reset_game(Game *game);
+bool reset_game(Game *game, bool winnable_only);
+void deal_game(Game *game, unsigned int seed);
+uint64_t deal_random(unsigned int seed, uint32_t counter);
+void deal_permutation(unsigned int seed, uint8_t *cards);
 void reset_selected(Game *game);
 void update_display(Game *game);
 void update_visible(Game *game);
 bool can_stack(Card card, Card above, bool is_foundation);
 void clear_highlight(Game *game);
 void highlight_source(Game *game);
-int highlight_stackable(Card *card, bool tableau, Game *game, bool *only_foundation);
+int highlight_stackable(Card *card, CardLocation from, Game *game, bool *only_foundation);
 Card *get_waste_top(Game *game, bool no_rank);
 Card *get_stock_top(Game *game, bool no_rank);
 Card *get_card(CardPos pos, Game *game, bool no_rank);
@@ -61,53 +129,97 @@ bool get_suite_color(Suite suite);
 char *get_rank_str(Rank rank);
 char *get_suite_str(Suite suite);
 bool move_card(Game *game);
+bool move_card_unhooked(Game *game);
 bool is_same_pos(CardPos a, CardPos b);
 bool handle_action(Action direction, Game *game);
+bool is_game_won(Game *game);
+int get_legal_moves(Game *game, Move *moves);
+bool apply_move(Game *game, Move move);
+uint8_t pack_card(Card card);
+Card unpack_card(uint8_t packed);
+void pack_game(Game *game, PackedGame *packed);
+void unpack_game(PackedGame *packed, Game *game);
+void canonicalize_packed(PackedGame *packed);
+uint64_t hash_packed(PackedGame *packed);
+char *format_move(Move move, char *buffer);
+bool parse_move(Game *game, const char *text, Move *move);
 
 #ifdef SOLITAIRE_CARDS_IMPLEMENTATION
 
+WinnableSeedPicker winnable_seed_picker = NULL;
+MoveCardHook move_card_hook = NULL;
+
 Game *create_game() {
     // create memory for game, all game data is stored in this one memory buffer
     Game *game = malloc(sizeof(Game));
     if (!game) return NULL;
 
     // initialize stuff
-    reset_game(game);
+    reset_game(game, false);
     return game;
 }
 
-void reset_game(Game *game) {
-    reset_selected(game);
+bool reset_game(Game *game, bool winnable_only) {
+    // winnable only deals come from the deal index, returns false and leaves game alone if it has none to give
+    unsigned int seed = time(NULL);
+    if (winnable_only && (!winnable_seed_picker || !winnable_seed_picker(&seed))) return false;
+    deal_game(game, seed);
+    return true;
+}
+
+uint64_t deal_random(unsigned int seed, uint32_t counter) {
+    // counter-based random numbers (splitmix64 finaliser over seed and counter)
+    // every draw only depends on its own counter, so a deal never depends on global rand() state
+    uint64_t z = ((uint64_t) seed << 32 | counter) + 0x9e3779b97f4a7c15;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+}
+
+void deal_permutation(unsigned int seed, uint8_t *cards) {
+    // the shuffled deck for a seed, packed like pack_card (face down) in dealing order:
+    // tableau columns left to right, bottom to top, then the stock
+    uint8_t swaps[DECK_CARDS];
+    // the draws don't depend on each other, so this loop can be vectorised, only the swaps below are serial
+    for (int i = DECK_CARDS - 1; i > 0; --i) {
+        swaps[i] = (uint8_t) ((deal_random(seed, i) >> 32) * (i + 1) >> 32);
+    }
 
-    Card cards[52] = {};
-    for (int i = 0, suite = 0; suite < 4; ++suite) {
-        for (int rank = 1; rank <= 13; ++rank, ++i) {
-            // initialize card deck
-            cards[i].rank = rank;
-            cards[i].suite = suite;
-            cards[i].visible = false;
-            cards[i].highlight = NO_HIGHLIGHT;
+    // initialize card deck (every deck in suite order, one after the other)
+    for (int i = 0, deck = 0; deck < SOLITAIRE_DECKS; ++deck) {
+        for (int suite = 0; suite < 4; ++suite) {
+            for (int rank = 1; rank <= 13; ++rank, ++i) {
+                cards[i] = rank | suite << 4;
+            }
         }
     }
 
     // shuffle card deck
-    srand(time(NULL));
-    for (int i = 51; i > 0; --i) {
-        int j = rand() % (i + 1);
-        Card temp = cards[i];
-        cards[i] = cards[j];
-        cards[j] = temp;
+    for (int i = DECK_CARDS - 1; i > 0; --i) {
+        uint8_t temp = cards[i];
+        cards[i] = cards[swaps[i]];
+        cards[swaps[i]] = temp;
     }
+}
+
+void deal_game(Game *game, unsigned int seed) {
+    // deals the same cards for the same seed
+    game->seed = seed;
+
+    uint8_t packed[DECK_CARDS];
+    deal_permutation(seed, packed);
+    Card cards[DECK_CARDS];
+    for (int i = 0; i < DECK_CARDS; ++i) cards[i] = unpack_card(packed[i]);
 
-    // clear foundation cards (4 piles of each suite)
-    for (int i = 0; i < 4; ++i) {
+    // clear foundation cards (one pile per suite and deck)
+    for (int i = 0; i < FOUNDATION_PILES; ++i) {
         game->foundation[i].rank = NO_RANK;
         game->foundation[i].visible = true;
         game->foundation[i].highlight = NO_HIGHLIGHT;
     }
 
     // clear stock cards and waste cards (stock cards are not visible)
-    for (int i = 0; i < 64; ++i) {
+    for (int i = 0; i < PILE_SLOTS; ++i) {
         game->stock[i].rank = NO_RANK;
         game->stock[i].visible = false;
         game->stock[i].highlight = NO_HIGHLIGHT;
@@ -116,10 +228,10 @@ void reset_game(Game *game) {
         game->waste[i].highlight = NO_HIGHLIGHT;
     }
 
-    // put cards in tableau (main game area, 7 columns)
+    // put cards in tableau (main game area, column c gets c + 1 cards)
     int i = 0;
-    for (int column = 0; column < 7; ++column) {
-        for (int row = 0; row < 64; ++row) {
+    for (int column = 0; column < TABLEAU_COLUMNS; ++column) {
+        for (int row = 0; row < COLUMN_SLOTS; ++row) {
             game->tableau[column][row].rank = NO_RANK;
             game->tableau[column][row].visible = false;
             game->tableau[column][row].highlight = NO_HIGHLIGHT;
@@ -130,10 +242,13 @@ void reset_game(Game *game) {
     }
 
     // put the rest of the cards in the stock card pile
-    for (int j = 0; i < 52; ++i, ++j) {
+    for (int j = 0; i < DECK_CARDS; ++i, ++j) {
         game->stock[j] = cards[i];
     }
 
+    // the cursor goes to the first face up card, so only once the new deal is out and turned up
+    update_visible(game);
+    reset_selected(game);
     update_display(game);
 }
 
@@ -146,7 +261,7 @@ void update_display(Game *game) {
         if (!card) {
             game->moving.active = false;
         } else {
-            highlight_stackable(card, game->moving.location == TABLEAU, game, NULL);
+            highlight_stackable(card, game->moving.location, game, NULL);
         }
     }
     highlight_source(game);
@@ -154,8 +269,8 @@ void update_display(Game *game) {
 
 void update_visible(Game *game) {
     // make the top card of each tableau column visible
-    for (int column = 0; column < 7; ++column) {
-        for (int row = 0; row < 64; ++row) {
+    for (int column = 0; column < TABLEAU_COLUMNS; ++column) {
+        for (int row = 0; row < COLUMN_SLOTS; ++row) {
             if (game->tableau[column][row].rank == NO_RANK) {
                 if (row > 0) game->tableau[column][row - 1].visible = true;
                 break;
@@ -178,16 +293,23 @@ bool can_stack(Card card, Card above, bool is_foundation) {
 
 void clear_highlight(Game *game) {
     // clears the "highlight"
-    for (int i = 0; i < 4; ++i) {
+    // only up to the first empty slot of each pile, nothing past it is ever highlighted or looked at,
+    // and a card moved there is copied over whole
+    for (int i = 0; i < FOUNDATION_PILES; ++i) {
         game->foundation[i].highlight = NO_HIGHLIGHT;
     }
-    for (int i = 0; i < 64; ++i) {
+    for (int i = 0; i < PILE_SLOTS; ++i) {
         game->stock[i].highlight = NO_HIGHLIGHT;
+        if (game->stock[i].rank == NO_RANK) break;
+    }
+    for (int i = 0; i < PILE_SLOTS; ++i) {
         game->waste[i].highlight = NO_HIGHLIGHT;
+        if (game->waste[i].rank == NO_RANK) break;
     }
-    for (int column = 0; column < 7; ++column) {
-        for (int row = 0; row < 64; ++row) {
+    for (int column = 0; column < TABLEAU_COLUMNS; ++column) {
+        for (int row = 0; row < COLUMN_SLOTS; ++row) {
             game->tableau[column][row].highlight = NO_HIGHLIGHT;
+            if (game->tableau[column][row].rank == NO_RANK) break;
         }
     }
 }
@@ -200,7 +322,7 @@ void highlight_source(Game *game) {
     card->highlight = SOURCE;
 }
 
-int highlight_stackable(Card *card, bool tableau, Game *game, bool *only_foundation) {
+int highlight_stackable(Card *card, CardLocation from, Game *game, bool *only_foundation) {
     // highlights cards that a card can be stacked on as "highlighted", which the action function uses
     clear_highlight(game);
     int count_stackable = 0;
@@ -209,8 +331,9 @@ int highlight_stackable(Card *card, bool tableau, Game *game, bool *only_foundat
 
     // if we are on the tableau and the next card is not empty, don't highlight moving to foundation
     // we cannot move more than one card at a time to the foundation
-    if (!tableau || card[1].rank == NO_RANK) {
-        for (int i = 0; i < 4; ++i) {
+    // a foundation card never goes onto another foundation, with two decks there is one of the same suit to take it
+    if (from == WASTE || (from == TABLEAU && card[1].rank == NO_RANK)) {
+        for (int i = 0; i < FOUNDATION_PILES; ++i) {
             bool stack = can_stack(*card, game->foundation[i], true);
             if (stack) {
                 only_foundation_ = true;
@@ -220,8 +343,8 @@ int highlight_stackable(Card *card, bool tableau, Game *game, bool *only_foundat
         }
     }
 
-    for (int column = 0; column < 7; ++column) {
-        for (int row = 0; row < 64; ++row) {
+    for (int column = 0; column < TABLEAU_COLUMNS; ++column) {
+        for (int row = 0; row < COLUMN_SLOTS; ++row) {
             if (game->tableau[column][row].rank == NO_RANK) {
                 if (row > 0) {
                     if (game->tableau[column][row - 1].visible) {
@@ -251,7 +374,7 @@ Card *get_waste_top(Game *game, bool no_rank) {
     // will return NULL if there is no card there (has NO_RANK) and if the no-rank argument is set to false
     // otherwise will return the first "non-existent" card if no-rank is true
     Card *card = NULL;
-    for (int i = 0; i < 64; ++i) {
+    for (int i = 0; i < PILE_SLOTS; ++i) {
         if (game->waste[i].rank == NO_RANK) {
             if (no_rank && !card) return &game->waste[i];
             return card;
@@ -267,7 +390,7 @@ Card *get_stock_top(Game *game, bool no_rank) {
     // will return NULL if there is no card there (has NO_RANK) and if the no-rank argument is set to false
     // otherwise will return the first "non-existent" card if no-rank is true
     Card *card = NULL;
-    for (int i = 0; i < 64; ++i) {
+    for (int i = 0; i < PILE_SLOTS; ++i) {
         if (game->stock[i].rank == NO_RANK) {
             if (no_rank && !card) return &game->stock[i];
             return card;
@@ -285,7 +408,7 @@ Card *get_card(CardPos pos, Game *game, bool no_rank) {
     Card *card = NULL;
     switch (pos.location) {
         case TABLEAU:
-            if (pos.column >= 0 && pos.column < 7 && pos.row >= 0 && pos.row < 64)
+            if (pos.column >= 0 && pos.column < TABLEAU_COLUMNS && pos.row >= 0 && pos.row < COLUMN_SLOTS)
                 card = &game->tableau[pos.column][pos.row];
             if (!no_rank && card && card->rank == NO_RANK) return NULL;
             break;
@@ -293,7 +416,7 @@ Card *get_card(CardPos pos, Game *game, bool no_rank) {
             card = get_waste_top(game, no_rank);
             break;
         case FOUNDATION:
-            if (pos.column >= 0 && pos.column < 4)
+            if (pos.column >= 0 && pos.column < FOUNDATION_PILES)
                 card = &game->foundation[pos.column];
             break;
         case STOCK:
@@ -308,9 +431,9 @@ int get_amount_stacked_cards(CardPos pos, Game *game) {
     // only works for cards in the tableau
     if (!pos.active) return 0;
     if (pos.location != TABLEAU) return 1;
-    if (pos.column < 0 || pos.column >= 7 || pos.row < 0 || pos.row >= 64) return 0;
+    if (pos.column < 0 || pos.column >= TABLEAU_COLUMNS || pos.row < 0 || pos.row >= COLUMN_SLOTS) return 0;
     int i = 0;
-    for (int row = pos.row; row < 64; ++row, ++i) {
+    for (int row = pos.row; row < COLUMN_SLOTS; ++row, ++i) {
         if (game->tableau[pos.column][row].rank == NO_RANK) return i;
     }
     return i;
@@ -402,6 +525,10 @@ void reset_selected(Game *game) {
 }
 
 bool move_card(Game *game) {
+    return move_card_hook ? move_card_hook(game) : move_card_unhooked(game);
+}
+
+bool move_card_unhooked(Game *game) {
     // main part of the game lol
 
     // don't move if there is no selected card
@@ -464,6 +591,8 @@ bool move_card(Game *game) {
             }
         }
     } else if (destination.location == FOUNDATION) {
+        // the card would be copied and the pile under it emptied
+        if (game->moving.location == FOUNDATION) return false;
         if (game->moving.location == TABLEAU) {
             CardPos above = game->moving;
             ++above.row;
@@ -514,9 +643,9 @@ bool handle_action(Action direction, Game *game) {
                             waste_card->rank = NO_RANK;
                         }
                     } else {
-                        for (int i = 0; i < 64; ++i) {
+                        for (int i = 0; i < PILE_SLOTS; ++i) {
                             if (game->waste[i].rank == NO_RANK) {
-                                if (i < 63) game->waste[i + 1].rank = NO_RANK;
+                                if (i < PILE_SLOTS - 1) game->waste[i + 1].rank = NO_RANK;
                                 card->visible = true;
                                 game->waste[i] = *card;
                                 card->rank = NO_RANK;
@@ -540,14 +669,14 @@ bool handle_action(Action direction, Game *game) {
                         }
                     } else {
                         bool foundation = false;
-                        int count = highlight_stackable(card, game->selected.location == TABLEAU, game, &foundation);
+                        int count = highlight_stackable(card, game->selected.location, game, &foundation);
                         if (count < 1) return false;
                         highlight_source(game);
                         game->moving = game->selected;
                         game->moving.active = true;
                         if (count == 1 || foundation) {
-                            for (int column = 0; column < 7; ++column) {
-                                for (int row = 0; row < 64; ++row) {
+                            for (int column = 0; column < TABLEAU_COLUMNS; ++column) {
+                                for (int row = 0; row < COLUMN_SLOTS; ++row) {
                                     if (game->tableau[column][row].highlight == HIGHLIGHTED) {
                                         game->selected = (CardPos) {true, TABLEAU, column, row};
                                         return move_card(game);
@@ -555,7 +684,7 @@ bool handle_action(Action direction, Game *game) {
                                     if (game->tableau[column][row].rank == NO_RANK) break;
                                 }
                             }
-                            for (int x = 0; x < 4; ++x) {
+                            for (int x = 0; x < FOUNDATION_PILES; ++x) {
                                 if (game->foundation[x].highlight == HIGHLIGHTED) {
                                     game->selected = (CardPos) {true, FOUNDATION, x, 0};
                                     return move_card(game);
@@ -594,14 +723,14 @@ bool handle_action(Action direction, Game *game) {
                     card_dir = get_card(pos_dir, game, false);
                     if (game->selected.row <= 0 || !card_dir || !card_dir->visible) {
                         game->selected.row = 0;
-                        if (game->selected.column >= 4) {
+                        if (game->selected.column >= FOUNDATION_PILES) {
                             if (game->waste[0].rank != NO_RANK) {
                                 game->selected.column = 0;
                                 game->selected.location = WASTE;
-                            } else if (game->selected.column == 4) {
-                                game->selected.column = 3;
+                            } else if (game->selected.column == FOUNDATION_PILES) {
+                                game->selected.column = FOUNDATION_PILES - 1;
                                 game->selected.location = FOUNDATION;
-                            } else if (game->selected.column >= 6) {
+                            } else if (game->selected.column >= STOCK_SLOT) {
                                 game->selected.column = 0;
                                 game->selected.location = STOCK;
                             }
@@ -614,7 +743,7 @@ bool handle_action(Action direction, Game *game) {
                     --game->selected.row;
                     return true;
                 case RIGHT:
-                    if (game->selected.column >= 6) {
+                    if (game->selected.column >= TABLEAU_COLUMNS - 1) {
                         game->selected.row = 0;
                         game->selected.column = 0;
                         game->selected.location = STOCK;
@@ -647,7 +776,7 @@ bool handle_action(Action direction, Game *game) {
                 case UP:
                     return false;
                 case RIGHT:
-                    if (game->selected.column >= 3) {
+                    if (game->selected.column >= FOUNDATION_PILES - 1) {
                         game->selected.column = 0;
                         if (game->waste[0].rank != NO_RANK) {
                             game->selected.location = WASTE;
@@ -677,19 +806,21 @@ bool handle_action(Action direction, Game *game) {
                     return false;
                 case RIGHT:
                     if (game->selected.location == WASTE) {
-                        game->selected.column = 3;
+                        game->selected.column = FOUNDATION_PILES - 1;
                         game->selected.location = STOCK;
                         return true;
                     }
                     return false;
                 case DOWN:
-                    game->selected.column = game->selected.location == WASTE ? 5 : 6;
+                    // straight below, or the last column when the top row is wider than the tableau
+                    game->selected.column = game->selected.location == WASTE ? WASTE_SLOT : STOCK_SLOT;
+                    if (game->selected.column >= TABLEAU_COLUMNS) game->selected.column = TABLEAU_COLUMNS - 1;
                     game->selected.location = TABLEAU;
                     fix_selected_tableau(game);
                     return true;
                 case LEFT:
                     if (game->waste[0].rank == NO_RANK || game->selected.location == WASTE) {
-                        game->selected.column = 3;
+                        game->selected.column = FOUNDATION_PILES - 1;
                         game->selected.location = FOUNDATION;
                     } else {
                         game->selected.column = 0;
@@ -703,5 +834,293 @@ bool handle_action(Action direction, Game *game) {
     return false;
 }
 
+bool is_game_won(Game *game) {
+    for (int i = 0; i < FOUNDATION_PILES; ++i) {
+        if (game->foundation[i].rank != KING) return false;
+    }
+    return true;
+}
+
+int get_legal_moves(Game *game, Move *moves) {
+    // lists every move that move_card (or a draw) would accept, without touching the cursor
+    // moves must have room for MAX_LEGAL_MOVES entries
+    int count = 0;
+
+    // destinations: the top of every tableau column and every foundation
+    int heights[TABLEAU_COLUMNS];
+    for (int column = 0; column < TABLEAU_COLUMNS; ++column) {
+        int row = 0;
+        while (row < COLUMN_SLOTS && game->tableau[column][row].rank != NO_RANK) ++row;
+        heights[column] = row;
+    }
+
+    // sources: every visible tableau card, the top of the waste and the top of each foundation
+    Card *waste_top = NULL;
+    int waste_row = 0;
+    while (waste_row < PILE_SLOTS && game->waste[waste_row].rank != NO_RANK) ++waste_row;
+    if (waste_row > 0) waste_top = &game->waste[waste_row - 1];
+
+    for (int source = 0; source < TABLEAU_COLUMNS + 1 + FOUNDATION_PILES; ++source) {
+        int first_row, last_row;
+        CardLocation location;
+        int column;
+        if (source < TABLEAU_COLUMNS) {
+            location = TABLEAU, column = source, first_row = 0, last_row = heights[source];
+        } else if (source == TABLEAU_COLUMNS) {
+            if (!waste_top) continue;
+            location = WASTE, column = 0, first_row = 0, last_row = 1;
+        } else {
+            column = source - TABLEAU_COLUMNS - 1;
+            if (game->foundation[column].rank == NO_RANK) continue;
+            location = FOUNDATION, first_row = 0, last_row = 1;
+        }
+
+        for (int row = first_row; row < last_row; ++row) {
+            Card card;
+            if (location == TABLEAU) {
+                card = game->tableau[column][row];
+                if (!card.visible) continue;
+            } else if (location == WASTE) {
+                card = *waste_top;
+            } else {
+                card = game->foundation[column];
+            }
+            CardPos from = {true, location, column, row};
+
+            // only a single card can go up to the foundation, and never from one foundation to another
+            bool single = location != TABLEAU || row == last_row - 1;
+            if (single && location != FOUNDATION) {
+                for (int i = 0; i < FOUNDATION_PILES; ++i) {
+                    if (can_stack(card, game->foundation[i], true)) {
+                        moves[count++] = (Move) {from, {true, FOUNDATION, i, 0}};
+                    }
+                }
+            }
+
+            for (int destination = 0; destination < TABLEAU_COLUMNS; ++destination) {
+                if (location == TABLEAU && destination == column) continue;
+                int height = heights[destination];
+                if (height == 0) {
+                    if (card.rank != KING) continue;
+                    moves[count++] = (Move) {from, {true, TABLEAU, destination, 0}};
+                } else {
+                    Card above = game->tableau[destination][height - 1];
+                    if (!above.visible || !can_stack(card, above, false)) continue;
+                    moves[count++] = (Move) {from, {true, TABLEAU, destination, height - 1}};
+                }
+            }
+        }
+    }
+
+    // drawing from the stock, or turning the waste back over
+    if (game->stock[0].rank != NO_RANK || waste_top) {
+        moves[count++] = (Move) {{true, STOCK, 0, 0}, {true, WASTE, 0, 0}};
+    }
+    return count;
+}
+
+bool apply_move(Game *game, Move move) {
+    // applies a move from get_legal_moves, the cursor ends up wherever move_card leaves it
+    if (move.from.location == STOCK) {
+        game->moving.active = false;
+        game->selected = (CardPos) {true, STOCK, 0, 0};
+        return handle_action(CONFIRM, game);
+    }
+    game->moving = move.from;
+    game->selected = move.to;
+    if (move_card(game)) return true;
+    game->moving.active = false;
+    return false;
+}
+
+uint8_t pack_card(Card card) {
+    if (card.rank == NO_RANK) return 0;
+    return card.rank | card.suite << 4 | card.visible << 7;
+}
+
+Card unpack_card(uint8_t packed) {
+    Card card = {packed >> 7, NO_HIGHLIGHT, (packed >> 4) & 3, packed & 15};
+    return card;
+}
+
+void pack_game(Game *game, PackedGame *packed) {
+    // only the tableau keeps the visible bit, waste cards are always face up and stock cards face down
+    int i = 0;
+    for (int f = 0; f < FOUNDATION_PILES; ++f) {
+        packed->foundation[f] = pack_card(game->foundation[f]) & 0x7f;
+    }
+    for (int column = 0; column < TABLEAU_COLUMNS; ++column) {
+        int row = 0;
+        for (; row < COLUMN_SLOTS && game->tableau[column][row].rank != NO_RANK; ++row) {
+            packed->cards[i++] = pack_card(game->tableau[column][row]);
+        }
+        packed->tableau_count[column] = row;
+    }
+    int count = 0;
+    for (; count < PILE_SLOTS && game->waste[count].rank != NO_RANK; ++count) {
+        packed->cards[i++] = pack_card(game->waste[count]) & 0x7f;
+    }
+    packed->waste_count = count;
+    for (count = 0; count < PILE_SLOTS && game->stock[count].rank != NO_RANK; ++count) {
+        packed->cards[i++] = pack_card(game->stock[count]) & 0x7f;
+    }
+    packed->stock_count = count;
+    // unused card slots (cards on the foundation) are zeroed so equal positions pack to equal bytes
+    for (; i < DECK_CARDS; ++i) packed->cards[i] = 0;
+}
+
+void unpack_game(PackedGame *packed, Game *game) {
+    // the cursor goes back to the start, like after a deal
+    for (int f = 0; f < FOUNDATION_PILES; ++f) {
+        game->foundation[f] = unpack_card(packed->foundation[f]);
+        game->foundation[f].visible = true;
+    }
+    int i = 0;
+    for (int column = 0; column < TABLEAU_COLUMNS; ++column) {
+        for (int row = 0; row < COLUMN_SLOTS; ++row) {
+            game->tableau[column][row] = row < packed->tableau_count[column] ? unpack_card(packed->cards[i++]) : unpack_card(0);
+        }
+    }
+    for (int j = 0; j < PILE_SLOTS; ++j) {
+        game->waste[j] = j < packed->waste_count ? unpack_card(packed->cards[i++] | 0x80) : unpack_card(0);
+    }
+    for (int j = 0; j < PILE_SLOTS; ++j) {
+        game->stock[j] = j < packed->stock_count ? unpack_card(packed->cards[i++]) : unpack_card(0);
+    }
+    reset_selected(game);
+}
+
+void canonicalize_packed(PackedGame *packed) {
+    // rewrites a position as the representative of every position that plays the same:
+    // the foundations and the tableau columns are sorted, as any of them takes the same cards,
+    // and the waste goes back onto the stock in drawing order, since draws alone cycle between those
+    uint8_t cards[DECK_CARDS];
+    uint8_t *columns[TABLEAU_COLUMNS];
+    int counts[TABLEAU_COLUMNS];
+    int i = 0;
+    for (int column = 0; column < TABLEAU_COLUMNS; ++column) {
+        columns[column] = &packed->cards[i];
+        counts[column] = packed->tableau_count[column];
+        i += counts[column];
+    }
+
+    // shortest column first, equal lengths by their cards
+    for (int a = 1; a < TABLEAU_COLUMNS; ++a) {
+        uint8_t *column = columns[a];
+        int count = counts[a], b = a;
+        for (; b > 0; --b) {
+            int order = counts[b - 1] - count;
+            if (order == 0) order = memcmp(columns[b - 1], column, count);
+            if (order <= 0) break;
+            columns[b] = columns[b - 1];
+            counts[b] = counts[b - 1];
+        }
+        columns[b] = column;
+        counts[b] = count;
+    }
+    int n = 0;
+    for (int column = 0; column < TABLEAU_COLUMNS; ++column) {
+        memcpy(&cards[n], columns[column], counts[column]);
+        n += counts[column];
+        packed->tableau_count[column] = counts[column];
+    }
+
+    // drawing order after a recycle is waste bottom to top, then stock top to bottom
+    // so the stock (bottom to top) becomes the stock followed by the waste reversed
+    uint8_t *waste = &packed->cards[i], *stock = waste + packed->waste_count;
+    memcpy(&cards[n], stock, packed->stock_count);
+    n += packed->stock_count;
+    for (int j = packed->waste_count - 1; j >= 0; --j) cards[n++] = waste[j];
+    packed->stock_count += packed->waste_count;
+    packed->waste_count = 0;
+    memcpy(packed->cards, cards, n);
+
+    for (int a = 1; a < FOUNDATION_PILES; ++a) {
+        uint8_t top = packed->foundation[a];
+        int b = a;
+        for (; b > 0 && packed->foundation[b - 1] < top; --b) packed->foundation[b] = packed->foundation[b - 1];
+        packed->foundation[b] = top;
+    }
+}
+
+uint64_t hash_packed(PackedGame *packed) {
+    // FNV-1a over the packed bytes, finished off with a mix so the low bits are usable as a table index
+    uint64_t hash = 0xcbf29ce484222325;
+    uint8_t *bytes = (uint8_t *) packed;
+    for (size_t i = 0; i < sizeof(PackedGame); ++i) {
+        hash = (hash ^ bytes[i]) * 0x100000001b3;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccd;
+    return hash ^ hash >> 33;
+}
+
+char *format_move(Move move, char *buffer) {
+    // text form of a move: "s" draws, otherwise source ">" destination
+    // sources are "w", "f<foundation>" or "t<column>:<row>", destinations "f<foundation>" or "t<column>"
+    // buffer needs room for 16 characters
+    char *end = buffer;
+    switch (move.from.location) {
+        case STOCK:
+            strcpy(buffer, "s");
+            return buffer;
+        case WASTE:
+            *end++ = 'w';
+            break;
+        case FOUNDATION:
+            end += sprintf(end, "f%d", move.from.column);
+            break;
+        case TABLEAU:
+            end += sprintf(end, "t%d:%d", move.from.column, move.from.row);
+            break;
+    }
+    if (move.to.location == FOUNDATION) sprintf(end, ">f%d", move.to.column);
+    else sprintf(end, ">t%d", move.to.column);
+    return buffer;
+}
+
+bool parse_move(Game *game, const char *text, Move *move) {
+    // reads a move written by format_move, the destination row comes from the game
+    if (text[0] == 's' && (text[1] == '\0' || text[1] == ' ' || text[1] == '\n')) {
+        *move = (Move) {{true, STOCK, 0, 0}, {true, WASTE, 0, 0}};
+        return true;
+    }
+    int column = 0, row = 0;
+    char *end;
+    switch (text[0]) {
+        case 'w':
+            move->from = (CardPos) {true, WASTE, 0, 0};
+            end = (char *) text + 1;
+            break;
+        case 'f':
+            column = (int) strtol(text + 1, &end, 10);
+            if (end == text + 1 || column < 0 || column >= FOUNDATION_PILES) return false;
+            move->from = (CardPos) {true, FOUNDATION, column, 0};
+            break;
+        case 't':
+            column = (int) strtol(text + 1, &end, 10);
+            if (end == text + 1 || *end != ':' || column < 0 || column >= TABLEAU_COLUMNS) return false;
+            row = (int) strtol(end + 1, &end, 10);
+            if (row < 0 || row >= COLUMN_SLOTS) return false;
+            move->from = (CardPos) {true, TABLEAU, column, row};
+            break;
+        default:
+            return false;
+    }
+    if (*end++ != '>') return false;
+    char kind = *end++;
+    column = (int) strtol(end, &end, 10);
+    if (kind == 'f' && column >= 0 && column < FOUNDATION_PILES) {
+        move->to = (CardPos) {true, FOUNDATION, column, 0};
+    } else if (kind == 't' && column >= 0 && column < TABLEAU_COLUMNS) {
+        row = 0;
+        while (row < COLUMN_SLOTS - 1 && game->tableau[column][row + 1].rank != NO_RANK) ++row;
+        move->to = (CardPos) {true, TABLEAU, column, row};
+    } else {
+        return false;
+    }
+    return true;
+}
+
 #endif
 #endif
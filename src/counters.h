@@ -0,0 +1,304 @@
+#ifndef SOLITAIRE_COUNTERS
+#define SOLITAIRE_COUNTERS
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// hardware counters around the phases of the game loop and the engine, switched on at run time (--profile for the
+// game, --profile-bench for the engine on its own)
+// cycles, instructions, L1 data cache misses, last level cache misses and branch misses are opened through
+// perf_event_open() as one group, so a phase gets all of them from a single read(), and they are added up per phase
+// a counter the kernel won't give (no PMU in a VM, perf_event_paranoid, not Linux) is left out, without any the
+// phases are still timed
+
+typedef enum {
+    PROFILE_ACTION, PROFILE_DISPLAY, PROFILE_RENDER, PROFILE_REFRESH, // the game loop
+    PROFILE_LEGAL_MOVES, PROFILE_APPLY_MOVE, PROFILE_HIGHLIGHT, PROFILE_GET_CARD, // --profile-bench
+    PROFILE_PHASES
+} ProfilePhase;
+
+typedef enum {
+    COUNTER_CYCLES, COUNTER_INSTRUCTIONS, COUNTER_L1D_MISSES, COUNTER_LLC_MISSES, COUNTER_BRANCH_MISSES, COUNTERS
+} CounterKind;
+
+typedef struct {
+    uint64_t time;
+    uint64_t enabled; // nanoseconds the group was enabled and running, they differ when the kernel multiplexes it
+    uint64_t running;
+    uint64_t values[COUNTERS]; // raw counts, only a difference between two samples is scaled
+} ProfileSample;
+
+typedef struct {
+    uint64_t calls;
+    uint64_t samples; // begin and end pairs, one can cover many calls of something small
+    uint64_t nanoseconds;
+    uint64_t values[COUNTERS];
+} ProfileTotals;
+
+typedef struct {
+    bool enabled;
+    int group; // the group leader, -1 when timing only
+    int fds[COUNTERS]; // -1 for a counter that isn't open
+    int slots[COUNTERS]; // where a counter is in a group read
+    int opened;
+    bool kernel; // the counts include the kernel (syscalls in refresh), perf_event_paranoid decides
+    bool scaled; // the kernel had to multiplex the counters, the counts are estimates
+    int error; // errno of the first counter that didn't open
+    ProfileSample overhead; // one empty begin and end pair
+    ProfileTotals phases[PROFILE_PHASES];
+} Profiler;
+
+extern Profiler profiler;
+
+// adds code to phase, only reads anything when the profiler is started
+#define PROFILE_TIME(phase, code) do { \
+    ProfileSample profile_start_; \
+    bool profiled_ = profile_begin(&profile_start_); \
+    code; \
+    if (profiled_) profile_end(phase, &profile_start_, 1); \
+} while (0)
+
+bool start_profiler();
+void stop_profiler();
+void profile_read(ProfileSample *sample);
+void profile_end(ProfilePhase phase, ProfileSample *start, uint64_t calls);
+void profile_delta(ProfileSample *start, ProfileSample *end, uint64_t *values);
+const char *profile_phase_name(ProfilePhase phase);
+const char *counter_name(CounterKind kind);
+void print_profile(FILE *file);
+
+static inline bool profile_begin(ProfileSample *sample) {
+    if (!profiler.enabled) return false;
+    profile_read(sample);
+    return true;
+}
+
+#ifdef SOLITAIRE_COUNTERS_IMPLEMENTATION
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+Profiler profiler = {.group = -1};
+
+#ifdef __linux__
+static const struct {
+    uint32_t type;
+    uint64_t config;
+} counter_events[COUNTERS] = {
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16},
+        {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL | PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+};
+
+int open_counter(CounterKind kind, int group, bool kernel) {
+    // counts this thread on any cpu, the leader starts stopped and the whole group is started at once
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = counter_events[kind].type;
+    attr.config = counter_events[kind].config;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr.disabled = group < 0;
+    attr.exclude_kernel = !kernel;
+    attr.exclude_hv = 1;
+    return (int) syscall(SYS_perf_event_open, &attr, 0, -1, group, PERF_FLAG_FD_CLOEXEC);
+}
+#endif
+
+bool start_profiler() {
+    // returns whether any counter opened, the phases are timed either way
+    for (int kind = 0; kind < COUNTERS; ++kind) profiler.fds[kind] = profiler.slots[kind] = -1;
+    profiler.group = -1;
+    profiler.opened = 0;
+    profiler.error = 0;
+    profiler.kernel = true;
+#ifdef __linux__
+    for (int kind = 0; kind < COUNTERS; ++kind) {
+        int fd = open_counter(kind, profiler.group, profiler.kernel);
+        if (fd < 0 && (errno == EACCES || errno == EPERM) && profiler.kernel && profiler.group < 0) {
+            // perf_event_paranoid 2 and up only lets us count user space
+            profiler.kernel = false;
+            fd = open_counter(kind, profiler.group, profiler.kernel);
+        }
+        if (fd < 0) {
+            if (!profiler.error) profiler.error = errno;
+            continue;
+        }
+        if (profiler.group < 0) profiler.group = fd;
+        profiler.fds[kind] = fd;
+        profiler.slots[kind] = profiler.opened++;
+    }
+    if (profiler.group >= 0) {
+        ioctl(profiler.group, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(profiler.group, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+#else
+    profiler.error = ENOSYS;
+#endif
+    profiler.enabled = true;
+
+    // what an empty phase costs, mostly the read() itself
+    ProfileSample start, end;
+    profile_read(&start);
+    for (int i = 0; i < 999; ++i) profile_read(&end);
+    profile_read(&end);
+    profiler.overhead.time = (end.time - start.time) / 1000;
+    profile_delta(&start, &end, profiler.overhead.values);
+    for (int kind = 0; kind < COUNTERS; ++kind) profiler.overhead.values[kind] /= 1000;
+    return profiler.group >= 0;
+}
+
+void stop_profiler() {
+    for (int kind = 0; kind < COUNTERS; ++kind) {
+        if (profiler.fds[kind] >= 0) close(profiler.fds[kind]);
+        profiler.fds[kind] = -1;
+    }
+    profiler.group = -1;
+    profiler.enabled = false;
+}
+
+void profile_read(ProfileSample *sample) {
+    // counters that aren't open stay 0
+    memset(sample->values, 0, sizeof(sample->values));
+    sample->enabled = sample->running = 0;
+#ifdef __linux__
+    if (profiler.group >= 0) {
+        uint64_t buffer[3 + COUNTERS]; // count, time enabled, time running, then the values in slot order
+        if (read(profiler.group, buffer, sizeof(buffer)) >= (ssize_t) (3 * sizeof(uint64_t))) {
+            sample->enabled = buffer[1];
+            sample->running = buffer[2];
+            for (int kind = 0; kind < COUNTERS; ++kind) {
+                int slot = profiler.slots[kind];
+                if (slot >= 0 && (uint64_t) slot < buffer[0]) sample->values[kind] = buffer[3 + slot];
+            }
+        }
+    }
+#endif
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    sample->time = (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void profile_delta(ProfileSample *start, ProfileSample *end, uint64_t *values) {
+    // the counts from start to end, scaled up by how much of that time the group was enabled but not counting
+    // (the ratio over the whole run would be wrong here, it changes as the kernel rotates groups)
+    uint64_t enabled = end->enabled - start->enabled, running = end->running - start->running;
+    double scale = 1;
+    if (running > 0 && running < enabled) {
+        scale = (double) enabled / running;
+        profiler.scaled = true;
+    }
+    for (int kind = 0; kind < COUNTERS; ++kind) {
+        uint64_t count = end->values[kind] >= start->values[kind] ? end->values[kind] - start->values[kind] : 0;
+        values[kind] = (uint64_t) (count * scale);
+    }
+}
+
+void profile_end(ProfilePhase phase, ProfileSample *start, uint64_t calls) {
+    // adds what happened since start, as calls calls
+    ProfileSample end;
+    profile_read(&end);
+    ProfileTotals *totals = &profiler.phases[phase];
+    totals->calls += calls;
+    ++totals->samples;
+    totals->nanoseconds += end.time - start->time;
+    uint64_t values[COUNTERS];
+    profile_delta(start, &end, values);
+    for (int kind = 0; kind < COUNTERS; ++kind) totals->values[kind] += values[kind];
+}
+
+const char *profile_phase_name(ProfilePhase phase) {
+    switch (phase) {
+        case PROFILE_ACTION:
+            return "action";
+        case PROFILE_DISPLAY:
+            return "display";
+        case PROFILE_RENDER:
+            return "render";
+        case PROFILE_REFRESH:
+            return "refresh";
+        case PROFILE_LEGAL_MOVES:
+            return "legal";
+        case PROFILE_APPLY_MOVE:
+            return "apply";
+        case PROFILE_HIGHLIGHT:
+            return "highlight";
+        case PROFILE_GET_CARD:
+            return "get_card";
+        default:
+            return "";
+    }
+}
+
+const char *counter_name(CounterKind kind) {
+    switch (kind) {
+        case COUNTER_CYCLES:
+            return "cycles";
+        case COUNTER_INSTRUCTIONS:
+            return "instr";
+        case COUNTER_L1D_MISSES:
+            return "L1d miss";
+        case COUNTER_LLC_MISSES:
+            return "LLC miss";
+        case COUNTER_BRANCH_MISSES:
+            return "br miss";
+        default:
+            return "";
+    }
+}
+
+static inline double profile_per_call(ProfileTotals *totals, uint64_t total, uint64_t overhead) {
+    // what a phase took less what reading the counters took, per call
+    double net = (double) total - (double) totals->samples * overhead;
+    return net > 0 ? net / totals->calls : 0;
+}
+
+void print_profile(FILE *file) {
+    // per call averages of every phase that ran, less the overhead of the samples, - for a counter that isn't there
+    if (profiler.group >= 0) {
+        fprintf(file, "# counting %s%s", profiler.kernel ? "user and kernel space" : "user space only", profiler.scaled ? ", multiplexed (scaled estimates)" : "");
+        for (int kind = 0; kind < COUNTERS; ++kind) {
+            if (profiler.fds[kind] < 0) fprintf(file, ", no %s", counter_name(kind));
+        }
+        fprintf(file, "\n");
+    } else {
+        fprintf(file, "# no hardware counters (%s), timing only\n", strerror(profiler.error));
+    }
+    fprintf(file, "# taken off every sample, the overhead of reading: %lu ns", (unsigned long) profiler.overhead.time);
+    for (int kind = 0; kind < COUNTERS; ++kind) {
+        if (profiler.fds[kind] >= 0) fprintf(file, ", %lu %s", (unsigned long) profiler.overhead.values[kind], counter_name(kind));
+    }
+    fprintf(file, "\n%-10s %10s %10s", "phase", "calls", "ns/call");
+    for (int kind = 0; kind < COUNTERS; ++kind) fprintf(file, " %10s", counter_name(kind));
+    fprintf(file, " %6s\n", "IPC");
+    for (int phase = 0; phase < PROFILE_PHASES; ++phase) {
+        ProfileTotals *totals = &profiler.phases[phase];
+        if (!totals->calls) continue;
+        fprintf(file, "%-10s %10lu %10.1f", profile_phase_name(phase), (unsigned long) totals->calls,
+                profile_per_call(totals, totals->nanoseconds, profiler.overhead.time));
+        double values[COUNTERS];
+        for (int kind = 0; kind < COUNTERS; ++kind) {
+            values[kind] = profile_per_call(totals, totals->values[kind], profiler.overhead.values[kind]);
+            if (profiler.fds[kind] >= 0) fprintf(file, " %10.1f", values[kind]);
+            else fprintf(file, " %10s", "-");
+        }
+        if (profiler.fds[COUNTER_CYCLES] >= 0 && profiler.fds[COUNTER_INSTRUCTIONS] >= 0 && values[COUNTER_CYCLES] > 0) {
+            fprintf(file, " %6.2f\n", values[COUNTER_INSTRUCTIONS] / values[COUNTER_CYCLES]);
+        } else {
+            fprintf(file, " %6s\n", "-");
+        }
+    }
+}
+
+#endif
+#endif
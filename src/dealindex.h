@@ -0,0 +1,561 @@
+#ifndef SOLITAIRE_DEAL_INDEX
+#define SOLITAIRE_DEAL_INDEX
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "./cards.h"
+#include "./solver.h"
+#include "./optimal.h"
+#include "./policy.h"
+#include "./workers.h"
+
+#define DEAL_INDEX_MAGIC "SOLIDX\0\0"
+#define DEAL_INDEX_VERSION (2 | LAYOUT_VERSION)
+#define DEAL_INDEX_DIFFICULTIES 101 // difficulty goes from 0 to 100
+
+#define INDEX_WINNABLE 1
+#define INDEX_GAVE_UP 2 // the solver ran out of nodes, winnability unknown
+#define INDEX_PAR 4 // par is the fewest moves that win the deal, not just a lower bound
+#define INDEX_SOLVED 8 // the record holds a result, a resumed shard solves the records without it
+
+#define DEAL_SHARD_MAGIC "SOLSHRD\0"
+#define DEAL_SHARD_CHECKPOINT_SECONDS 30
+
+typedef struct {
+    // file layout: header, records sorted by seed, difficulty table, winnable record numbers grouped by difficulty
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint64_t count;
+    uint64_t winnable;
+    // record numbers for difficulty d are entries[difficulty_start[d]] up to entries[difficulty_start[d + 1]]
+    uint32_t difficulty_start[DEAL_INDEX_DIFFICULTIES + 1];
+} DealIndexHeader;
+
+typedef struct {
+    uint32_t seed;
+    uint16_t solution_length;
+    uint16_t difficulty;
+    uint32_t flags;
+    uint16_t par; // see INDEX_PAR, 0 if it wasn't searched for
+    uint16_t reserved;
+} DealIndexRecord;
+
+typedef struct {
+    // file layout: header, then a record for every deal first_seed + shard + k * shards in the sweep, in seed order
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t first_seed;
+    uint32_t shard;
+    uint32_t shards;
+    uint32_t canonical;
+    uint64_t deals; // in the whole sweep, over all shards
+    uint64_t count; // records in this shard
+    uint64_t node_limit;
+    double par_seconds;
+} DealShardHeader;
+
+typedef struct {
+    void *map;
+    size_t size;
+    DealIndexHeader *header;
+    DealIndexRecord *records;
+    uint32_t *entries;
+} DealIndex;
+
+bool build_deal_index(const char *path, unsigned int first_seed, long deals, int threads, SolverOptions options, double par_seconds);
+bool build_deal_shard(const char *path, unsigned int first_seed, long deals, int shard, int shards, int threads, SolverOptions options,
+                      double par_seconds, long *resumed);
+bool merge_deal_shards(const char *path, char **shard_paths, int count, char message[256]);
+DealIndex *open_deal_index(const char *path);
+void close_deal_index(DealIndex *index);
+DealIndexRecord *deal_index_lookup(DealIndex *index, unsigned int seed);
+bool deal_index_pick(DealIndex *index, int min_difficulty, int max_difficulty, uint64_t random, unsigned int *seed);
+
+#ifdef SOLITAIRE_DEAL_INDEX_IMPLEMENTATION
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+typedef struct {
+    DealIndexRecord *records;
+    unsigned int first_seed;
+    unsigned int stride; // record i is the deal first_seed + i * stride
+    long deals;
+    SolverOptions options;
+    double par_seconds; // time solve_optimal() gets per winnable deal, 0 to leave par out
+    atomic_long next_deal;
+    atomic_long done;
+    atomic_long cache_lookups;
+    atomic_long cache_hits;
+    atomic_long cached_deals;
+    void *checkpoint; // the shard file mapping to flush every DEAL_SHARD_CHECKPOINT_SECONDS, or NULL
+    size_t checkpoint_size;
+    atomic_long next_checkpoint; // in milliseconds of monotonic_seconds()
+} DealIndexBuild;
+
+void *deal_index_thread(void *arg) {
+    DealIndexBuild *build = arg;
+    Solver *solver = create_solver(build->options);
+    Game *game = malloc(sizeof(Game));
+    SolveResult *result = malloc(sizeof(SolveResult));
+    OptimalSolver *optimal = build->par_seconds > 0 ? create_optimal_solver((OptimalOptions) {build->par_seconds, 64}) : NULL;
+    OptimalResult *par = build->par_seconds > 0 ? malloc(sizeof(OptimalResult)) : NULL;
+    if (!solver || !game || !result || (build->par_seconds > 0 && (!optimal || !par))) {
+        free_solver(solver);
+        free(game);
+        free(result);
+        free_optimal_solver(optimal);
+        free(par);
+        return NULL;
+    }
+
+    while (true) {
+        long deal = atomic_fetch_add(&build->next_deal, 1);
+        if (deal >= build->deals) break;
+        DealIndexRecord *record = &build->records[deal];
+        if (record->flags & INDEX_SOLVED) continue; // solved before a resumed shard stopped
+        unsigned int seed = build->first_seed + (unsigned int) deal * build->stride;
+        deal_game(game, seed);
+        solve_game(solver, game, result);
+
+        // each thread writes straight into its own records of the mapped file
+        uint32_t flags = INDEX_SOLVED | (result->status == SOLVE_WON ? INDEX_WINNABLE : 0) | (result->status == SOLVE_GAVE_UP ? INDEX_GAVE_UP : 0);
+        record->seed = seed;
+        record->solution_length = result->status == SOLVE_WON ? result->length : 0;
+        record->difficulty = solve_difficulty(result, solver->options.node_limit);
+        record->par = 0;
+        record->reserved = 0;
+        if (optimal && result->status == SOLVE_WON) {
+            // the solution just found is the upper bound, when time runs out the lower bound is kept
+            // only a line that replays to a win bounds par, the length of one that ends in a cache hit is just a claim
+            deal_game(game, seed);
+            int upper = replays_to_win(game, result) ? result->length : 0;
+            if (solve_optimal(optimal, game, upper, par) == OPTIMAL_FOUND) flags |= INDEX_PAR;
+            record->par = (uint16_t) par->bound;
+        }
+        // INDEX_SOLVED goes in last, a shard killed halfway through a record solves it again
+        atomic_signal_fence(memory_order_release);
+        record->flags = flags;
+
+        if (build->checkpoint) {
+            long now = (long) (monotonic_seconds() * 1000);
+            long next = atomic_load(&build->next_checkpoint);
+            if (now >= next && atomic_compare_exchange_strong(&build->next_checkpoint, &next, now + DEAL_SHARD_CHECKPOINT_SECONDS * 1000)) {
+                msync(build->checkpoint, build->checkpoint_size, MS_SYNC);
+            }
+        }
+
+        atomic_fetch_add(&build->cache_lookups, result->cache_lookups);
+        atomic_fetch_add(&build->cache_hits, result->cache_hits);
+        if (result->from_cache) atomic_fetch_add(&build->cached_deals, 1);
+        long done = atomic_fetch_add(&build->done, 1) + 1;
+        if (done % 1000 == 0) fprintf(stderr, "\r%ld/%ld deals", done, build->deals);
+    }
+
+    free_solver(solver);
+    free(game);
+    free(result);
+    free_optimal_solver(optimal);
+    free(par);
+    return NULL;
+}
+
+size_t deal_index_size(uint64_t count, uint64_t winnable) {
+    return sizeof(DealIndexHeader) + count * sizeof(DealIndexRecord) + winnable * sizeof(uint32_t);
+}
+
+void run_deal_index_build(DealIndexBuild *build, int threads) {
+    run_workers(deal_index_thread, build, 0, threads);
+    fprintf(stderr, "\r%ld/%ld deals\n", build->deals, build->deals);
+    if (build->options.cache) {
+        long lookups = atomic_load(&build->cache_lookups), hits = atomic_load(&build->cache_hits), cached = atomic_load(&build->cached_deals);
+        fprintf(stderr, "position cache: %ld lookups, %ld hits (%.1f%%), %ld of %ld deals answered straight from it (%.1f%%)\n",
+                lookups, hits, lookups ? 100.0 * hits / lookups : 0.0, cached, build->deals, 100.0 * cached / build->deals);
+    }
+}
+
+bool build_deal_index(const char *path, unsigned int first_seed, long deals, int threads, SolverOptions options, double par_seconds) {
+    // solves every seed in [first_seed, first_seed + deals) and writes the results to path
+    if (deals < 1 || (uint64_t) first_seed + deals - 1 > UINT32_MAX) return false;
+
+    // the records are solved into a scratch mapping first, the winnable count decides the final file size
+    size_t records_size = deals * sizeof(DealIndexRecord);
+    DealIndexRecord *records = mmap(NULL, records_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (records == MAP_FAILED) return false;
+
+    DealIndexBuild build = {records, first_seed, 1, deals, options, par_seconds, 0, 0, 0, 0, 0, NULL, 0, 0};
+    run_deal_index_build(&build, threads);
+
+    // group winnable deals by difficulty (counting sort)
+    DealIndexHeader header = {DEAL_INDEX_MAGIC, DEAL_INDEX_VERSION, sizeof(DealIndexRecord), deals, 0, {0}};
+    for (long i = 0; i < deals; ++i) {
+        if (!(records[i].flags & INDEX_WINNABLE)) continue;
+        ++header.difficulty_start[records[i].difficulty + 1];
+        ++header.winnable;
+    }
+    for (int d = 0; d < DEAL_INDEX_DIFFICULTIES; ++d) {
+        header.difficulty_start[d + 1] += header.difficulty_start[d];
+    }
+
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        munmap(records, records_size);
+        return false;
+    }
+    size_t size = deal_index_size(header.count, header.winnable);
+    void *map = MAP_FAILED;
+    if (ftruncate(fd, (off_t) size) == 0) map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        munmap(records, records_size);
+        unlink(path);
+        return false;
+    }
+
+    memcpy(map, &header, sizeof(header));
+    memcpy((char *) map + sizeof(header), records, records_size);
+    uint32_t *entries = (uint32_t *) ((char *) map + sizeof(header) + records_size);
+    uint32_t fill[DEAL_INDEX_DIFFICULTIES];
+    memcpy(fill, header.difficulty_start, sizeof(fill));
+    for (long i = 0; i < deals; ++i) {
+        if (records[i].flags & INDEX_WINNABLE) entries[fill[records[i].difficulty]++] = (uint32_t) i;
+    }
+
+    bool ok = msync(map, size, MS_SYNC) == 0;
+    munmap(map, size);
+    munmap(records, records_size);
+    return ok;
+}
+
+bool build_deal_shard(const char *path, unsigned int first_seed, long deals, int shard, int shards, int threads, SolverOptions options,
+                      double par_seconds, long *resumed) {
+    // solves the deals first_seed + shard + k * shards of [first_seed, first_seed + deals) into a shard file at path,
+    // the records are written in place and flushed every DEAL_SHARD_CHECKPOINT_SECONDS, so running the same shard
+    // again picks up where a killed run stopped instead of starting over
+    if (deals < 1 || (uint64_t) first_seed + deals - 1 > UINT32_MAX || shards < 1 || shard < 0 || shard >= shards) {
+        errno = EINVAL;
+        return false;
+    }
+    long count = shard < deals ? (deals - shard + shards - 1) / shards : 0;
+    DealShardHeader expected = {DEAL_SHARD_MAGIC, DEAL_INDEX_VERSION, sizeof(DealIndexRecord), first_seed, shard, shards,
+                                options.canonical, deals, count, options.node_limit, par_seconds};
+    size_t size = sizeof(DealShardHeader) + count * sizeof(DealIndexRecord);
+
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (st.st_size == 0 && ftruncate(fd, (off_t) size) != 0)) {
+        close(fd);
+        return false;
+    }
+    bool fresh = st.st_size == 0;
+    if (!fresh && (size_t) st.st_size != size) {
+        // some other sweep, or a different shard of this one
+        close(fd);
+        errno = EINVAL;
+        return false;
+    }
+    void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return false;
+    if (fresh) {
+        memcpy(map, &expected, sizeof(expected));
+    } else if (memcmp(map, &expected, sizeof(expected)) != 0) {
+        munmap(map, size);
+        errno = EINVAL;
+        return false;
+    }
+
+    DealIndexRecord *records = (DealIndexRecord *) ((char *) map + sizeof(DealShardHeader));
+    *resumed = 0;
+    for (long i = 0; i < count; ++i) *resumed += (records[i].flags & INDEX_SOLVED) != 0;
+
+    DealIndexBuild build = {records, first_seed + shard, shards, count, options, par_seconds, 0, 0, 0, 0, 0, map, size,
+                            (long) (monotonic_seconds() * 1000) + DEAL_SHARD_CHECKPOINT_SECONDS * 1000};
+    run_deal_index_build(&build, threads);
+    bool ok = msync(map, size, MS_SYNC) == 0;
+    munmap(map, size);
+    return ok;
+}
+
+typedef struct {
+    FILE *file;
+    const char *path;
+    DealShardHeader header;
+    DealIndexRecord record; // the next record to merge
+    uint64_t left; // records still in the file after record
+} ShardCursor;
+
+bool read_shard_record(ShardCursor *cursor) {
+    return fread(&cursor->record, sizeof(DealIndexRecord), 1, cursor->file) == 1;
+}
+
+void sift_shard_heap(ShardCursor **heap, int count, int i) {
+    // min-heap on the seed of each cursor's next record
+    while (true) {
+        int smallest = i, left = 2 * i + 1, right = 2 * i + 2;
+        if (left < count && heap[left]->record.seed < heap[smallest]->record.seed) smallest = left;
+        if (right < count && heap[right]->record.seed < heap[smallest]->record.seed) smallest = right;
+        if (smallest == i) return;
+        ShardCursor *swap = heap[i];
+        heap[i] = heap[smallest];
+        heap[smallest] = swap;
+        i = smallest;
+    }
+}
+
+bool merge_deal_shards(const char *path, char **shard_paths, int count, char message[256]) {
+    // merges the shard files of one sweep into a deal index at path, streaming through the shards twice:
+    // once to count the winnable deals per difficulty (which fixes the file layout), then a k-way merge by seed
+    bool ok = false;
+    ShardCursor *cursors = calloc(count > 0 ? count : 1, sizeof(ShardCursor));
+    ShardCursor **heap = malloc(sizeof(ShardCursor *) * (count > 0 ? count : 1));
+    bool *seen = NULL;
+    void *map = MAP_FAILED;
+    size_t size = 0;
+    if (!cursors || !heap) {
+        snprintf(message, 256, "out of memory");
+        goto done;
+    }
+    if (count < 1) {
+        snprintf(message, 256, "no shard files to merge");
+        goto done;
+    }
+
+    for (int i = 0; i < count; ++i) {
+        ShardCursor *cursor = &cursors[i];
+        cursor->path = shard_paths[i];
+        cursor->file = fopen(cursor->path, "rb");
+        struct stat st;
+        if (!cursor->file || fstat(fileno(cursor->file), &st) != 0) {
+            snprintf(message, 256, "%s: %s", cursor->path, strerror(errno));
+            goto done;
+        }
+        setvbuf(cursor->file, NULL, _IOFBF, 1 << 20);
+        DealShardHeader *header = &cursor->header;
+        if (fread(header, sizeof(DealShardHeader), 1, cursor->file) != 1 || memcmp(header->magic, DEAL_SHARD_MAGIC, 8) != 0 ||
+            header->version != DEAL_INDEX_VERSION || header->record_size != sizeof(DealIndexRecord) || header->shards < 1 ||
+            header->shard >= header->shards || (uint64_t) st.st_size != sizeof(DealShardHeader) + header->count * sizeof(DealIndexRecord)) {
+            snprintf(message, 256, "%s: not a shard file of this version", cursor->path);
+            goto done;
+        }
+        DealShardHeader *first = &cursors[0].header;
+        if (header->first_seed != first->first_seed || header->deals != first->deals || header->shards != first->shards ||
+            header->canonical != first->canonical || header->node_limit != first->node_limit || header->par_seconds != first->par_seconds) {
+            snprintf(message, 256, "%s: from a different sweep than %s", cursor->path, cursors[0].path);
+            goto done;
+        }
+    }
+    uint32_t shards = cursors[0].header.shards;
+    if ((uint32_t) count != shards) {
+        snprintf(message, 256, "the sweep has %u shards, %d given", shards, count);
+        goto done;
+    }
+    seen = calloc(shards, sizeof(bool));
+    if (!seen) {
+        snprintf(message, 256, "out of memory");
+        goto done;
+    }
+    for (int i = 0; i < count; ++i) {
+        if (seen[cursors[i].header.shard]) {
+            snprintf(message, 256, "%s: shard %u/%u given twice", cursors[i].path, cursors[i].header.shard, shards);
+            goto done;
+        }
+        seen[cursors[i].header.shard] = true;
+    }
+
+    // first pass, every record has to be solved
+    DealIndexHeader header = {DEAL_INDEX_MAGIC, DEAL_INDEX_VERSION, sizeof(DealIndexRecord), cursors[0].header.deals, 0, {0}};
+    for (int i = 0; i < count; ++i) {
+        ShardCursor *cursor = &cursors[i];
+        uint64_t unsolved = 0;
+        for (uint64_t r = 0; r < cursor->header.count; ++r) {
+            if (!read_shard_record(cursor)) {
+                snprintf(message, 256, "%s: %s", cursor->path, ferror(cursor->file) ? strerror(errno) : "truncated");
+                goto done;
+            }
+            if (!(cursor->record.flags & INDEX_SOLVED)) {
+                ++unsolved;
+            } else if (cursor->record.flags & INDEX_WINNABLE) {
+                ++header.difficulty_start[cursor->record.difficulty + 1];
+                ++header.winnable;
+            }
+        }
+        if (unsolved > 0) {
+            snprintf(message, 256, "%s: shard %u/%u still has %lu of %lu deals to solve", cursor->path, cursor->header.shard, shards,
+                     (unsigned long) unsolved, (unsigned long) cursor->header.count);
+            goto done;
+        }
+        if (fseek(cursor->file, sizeof(DealShardHeader), SEEK_SET) != 0) {
+            snprintf(message, 256, "%s: %s", cursor->path, strerror(errno));
+            goto done;
+        }
+    }
+    for (int d = 0; d < DEAL_INDEX_DIFFICULTIES; ++d) {
+        header.difficulty_start[d + 1] += header.difficulty_start[d];
+    }
+
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        snprintf(message, 256, "%s: %s", path, strerror(errno));
+        goto done;
+    }
+    size = deal_index_size(header.count, header.winnable);
+    if (ftruncate(fd, (off_t) size) == 0) map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        snprintf(message, 256, "%s: %s", path, strerror(errno));
+        unlink(path);
+        goto done;
+    }
+    memcpy(map, &header, sizeof(header));
+    DealIndexRecord *records = (DealIndexRecord *) ((char *) map + sizeof(header));
+    uint32_t *entries = (uint32_t *) (records + header.count);
+    uint32_t fill[DEAL_INDEX_DIFFICULTIES];
+    memcpy(fill, header.difficulty_start, sizeof(fill));
+
+    // second pass, k-way merge
+    int live = 0;
+    for (int i = 0; i < count; ++i) {
+        ShardCursor *cursor = &cursors[i];
+        if (cursor->header.count == 0) continue;
+        if (!read_shard_record(cursor)) {
+            snprintf(message, 256, "%s: changed while merging", cursor->path);
+            goto done;
+        }
+        cursor->left = cursor->header.count - 1;
+        heap[live++] = cursor;
+    }
+    for (int i = live / 2 - 1; i >= 0; --i) sift_shard_heap(heap, live, i);
+    uint64_t written = 0;
+    while (live > 0) {
+        ShardCursor *cursor = heap[0];
+        if (written > 0 && cursor->record.seed <= records[written - 1].seed) {
+            snprintf(message, 256, "%s: seed %u out of order", cursor->path, cursor->record.seed);
+            goto done;
+        }
+        records[written] = cursor->record;
+        if (cursor->record.flags & INDEX_WINNABLE) entries[fill[cursor->record.difficulty]++] = (uint32_t) written;
+        ++written;
+        if (cursor->left > 0) {
+            if (!read_shard_record(cursor)) {
+                snprintf(message, 256, "%s: changed while merging", cursor->path);
+                goto done;
+            }
+            --cursor->left;
+        } else {
+            heap[0] = heap[--live];
+        }
+        sift_shard_heap(heap, live, 0);
+    }
+    if (written != header.count) {
+        snprintf(message, 256, "the shards hold %lu deals, the sweep has %lu", (unsigned long) written, (unsigned long) header.count);
+        goto done;
+    }
+    ok = msync(map, size, MS_SYNC) == 0;
+    if (!ok) snprintf(message, 256, "%s: %s", path, strerror(errno));
+
+done:
+    if (map != MAP_FAILED) {
+        munmap(map, size);
+        if (!ok) unlink(path);
+    }
+    for (int i = 0; cursors && i < count; ++i) {
+        if (cursors[i].file) fclose(cursors[i].file);
+    }
+    free(cursors);
+    free(heap);
+    free(seen);
+    return ok;
+}
+
+bool check_deal_index_entries(void *map) {
+    // deal_index_pick() trusts the difficulty ranges and the entries, so a damaged file mustn't get that far
+    DealIndexHeader *header = map;
+    for (int i = 0; i < DEAL_INDEX_DIFFICULTIES; ++i) {
+        if (header->difficulty_start[i] > header->difficulty_start[i + 1]) return false;
+    }
+    uint32_t *entries = (uint32_t *) ((DealIndexRecord *) ((char *) map + sizeof(DealIndexHeader)) + header->count);
+    for (uint64_t i = 0; i < header->winnable; ++i) {
+        if (entries[i] >= header->count) return false;
+    }
+    return true;
+}
+
+DealIndex *open_deal_index(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(DealIndexHeader)) {
+        close(fd);
+        return NULL;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return NULL;
+
+    DealIndexHeader *header = map;
+    if (memcmp(header->magic, DEAL_INDEX_MAGIC, 8) != 0 || header->version != DEAL_INDEX_VERSION ||
+        header->record_size != sizeof(DealIndexRecord) || header->winnable > header->count ||
+        deal_index_size(header->count, header->winnable) > (size_t) st.st_size ||
+        header->difficulty_start[DEAL_INDEX_DIFFICULTIES] != header->winnable || !check_deal_index_entries(map)) {
+        munmap(map, st.st_size);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    DealIndex *index = malloc(sizeof(DealIndex));
+    if (!index) {
+        munmap(map, st.st_size);
+        return NULL;
+    }
+    index->map = map;
+    index->size = st.st_size;
+    index->header = header;
+    index->records = (DealIndexRecord *) ((char *) map + sizeof(DealIndexHeader));
+    index->entries = (uint32_t *) (index->records + header->count);
+    return index;
+}
+
+void close_deal_index(DealIndex *index) {
+    if (!index) return;
+    munmap(index->map, index->size);
+    free(index);
+}
+
+DealIndexRecord *deal_index_lookup(DealIndex *index, unsigned int seed) {
+    // records are sorted by seed
+    uint64_t low = 0, high = index->header->count;
+    while (low < high) {
+        uint64_t mid = low + (high - low) / 2;
+        if (index->records[mid].seed < seed) low = mid + 1;
+        else high = mid;
+    }
+    if (low < index->header->count && index->records[low].seed == seed) return &index->records[low];
+    return NULL;
+}
+
+bool deal_index_pick(DealIndex *index, int min_difficulty, int max_difficulty, uint64_t random, unsigned int *seed) {
+    // picks a random winnable deal with a difficulty in [min_difficulty, max_difficulty]
+    if (min_difficulty < 0) min_difficulty = 0;
+    if (max_difficulty >= DEAL_INDEX_DIFFICULTIES) max_difficulty = DEAL_INDEX_DIFFICULTIES - 1;
+    if (min_difficulty > max_difficulty) return false;
+    uint32_t start = index->header->difficulty_start[min_difficulty];
+    uint32_t end = index->header->difficulty_start[max_difficulty + 1];
+    if (end <= start) return false;
+    uint32_t entry = index->entries[start + random % (end - start)];
+    *seed = index->records[entry].seed;
+    return true;
+}
+
+#endif
+#endif
@@ -0,0 +1,106 @@
+#ifndef SOLITAIRE_DEALS
+#define SOLITAIRE_DEALS
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "./cards.h"
+#include "./workers.h"
+
+// bulk deal generation for statistics, deal n is seed first_seed + n and matches deal_game() for that seed
+
+typedef enum {
+    DEALS_PERMUTATION, // DECK_CARDS bytes per deal (52 for one deck), deal_permutation() order
+    DEALS_PACKED, // a PackedGame per deal, as pack_game() would give right after deal_game()
+} DealFormat;
+
+// deals each thread generates before the batch is written out
+#define DEALS_BATCH (1 << 16)
+
+size_t deal_format_size(DealFormat format);
+void pack_deal(unsigned int seed, PackedGame *packed);
+void generate_deals(unsigned int first_seed, long count, DealFormat format, int threads, uint8_t *out);
+bool write_deals(const char *path, unsigned int first_seed, long count, DealFormat format, int threads);
+
+#ifdef SOLITAIRE_DEALS_IMPLEMENTATION
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+size_t deal_format_size(DealFormat format) {
+    return format == DEALS_PACKED ? sizeof(PackedGame) : DECK_CARDS;
+}
+
+void pack_deal(unsigned int seed, PackedGame *packed) {
+    // straight from the permutation, without going through a Game
+    memset(packed->foundation, 0, sizeof(packed->foundation));
+    for (int column = 0; column < TABLEAU_COLUMNS; ++column) packed->tableau_count[column] = column + 1;
+    packed->waste_count = 0;
+    packed->stock_count = STOCK_CARDS;
+    deal_permutation(seed, packed->cards);
+    // the top card of each column is face up, column c ends at 1 + 2 + ... + (c + 1) - 1
+    for (int column = 0; column < TABLEAU_COLUMNS; ++column) packed->cards[column * (column + 3) / 2] |= 0x80;
+}
+
+typedef struct {
+    unsigned int first_seed;
+    long count;
+    DealFormat format;
+    uint8_t *out;
+} DealWork;
+
+void *deals_thread(void *arg) {
+    DealWork *work = arg;
+    if (work->format == DEALS_PACKED) {
+        PackedGame *out = (PackedGame *) work->out;
+        for (long i = 0; i < work->count; ++i) pack_deal(work->first_seed + (unsigned int) i, &out[i]);
+    } else {
+        for (long i = 0; i < work->count; ++i) deal_permutation(work->first_seed + (unsigned int) i, &work->out[i * DECK_CARDS]);
+    }
+    return NULL;
+}
+
+void generate_deals(unsigned int first_seed, long count, DealFormat format, int threads, uint8_t *out) {
+    // fills out with count deals, split evenly over the threads
+    if (threads < 1) threads = 1;
+    if (threads > count) threads = count > 0 ? (int) count : 1;
+    DealWork work[threads];
+    size_t size = deal_format_size(format);
+    for (int t = 0; t < threads; ++t) {
+        long start = count * t / threads, end = count * (t + 1) / threads;
+        work[t] = (DealWork) {first_seed + (unsigned int) start, end - start, format, out + start * size};
+    }
+    run_workers(deals_thread, work, sizeof(DealWork), threads);
+}
+
+bool write_deals(const char *path, unsigned int first_seed, long count, DealFormat format, int threads) {
+    // writes to path, or to stdout for "-"
+    int fd = strcmp(path, "-") == 0 ? STDOUT_FILENO : open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return false;
+    size_t size = deal_format_size(format);
+    long batch = (long) DEALS_BATCH * (threads > 0 ? threads : 1);
+    uint8_t *buffer = malloc(batch * size);
+    bool ok = buffer != NULL;
+    for (long done = 0; ok && done < count; done += batch) {
+        long n = count - done < batch ? count - done : batch;
+        generate_deals(first_seed + (unsigned int) done, n, format, threads, buffer);
+        for (size_t written = 0, total = n * size; ok && written < total;) {
+            ssize_t result = write(fd, buffer + written, total - written);
+            if (result < 0 && errno == EINTR) continue;
+            ok = result > 0;
+            if (ok) written += result;
+        }
+    }
+    free(buffer);
+    if (fd != STDOUT_FILENO) {
+        int saved = errno;
+        if (close(fd) != 0) ok = false;
+        else errno = saved;
+    }
+    return ok;
+}
+
+#endif
+#endif
@@ -0,0 +1,382 @@
+#ifndef SOLITAIRE_DIFFERENTIAL
+#define SOLITAIRE_DIFFERENTIAL
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "./cards.h"
+#include "./reference.h"
+#include "./workers.h"
+
+// plays the engine in cards.h and the reference copy in reference.h side by side over seeded random games
+// and stops at the first step where they disagree, that game is then shrunk to the shortest trace that still does
+// a step is a cursor action or one of the legal moves, picked at random as the game goes, the trace keeps the move
+// itself so leaving out earlier steps doesn't change what the later ones do (a move that isn't legal any more is skipped)
+
+#define DIFF_STEPS 2000 // steps per game
+#define DIFF_MESSAGE 160
+
+typedef struct {
+    Action action; // NO_ACTION for a move
+    Move move;
+} DiffStep;
+
+typedef struct {
+    uint64_t games;
+    uint64_t steps;
+    bool mismatch;
+    unsigned int seed; // the game that went wrong
+    DiffStep *trace; // its shrunk steps, malloc'd
+    int length;
+    char message[DIFF_MESSAGE]; // what differed after the last step of the trace
+} DiffResult;
+
+bool run_differential(unsigned int first_seed, long games, int threads, DiffResult *result);
+void print_diff_trace(FILE *file, DiffResult *result);
+
+#ifdef SOLITAIRE_DIFFERENTIAL_IMPLEMENTATION
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *diff_action_names[] = {"none", "up", "right", "down", "left", "confirm", "cancel", "quit"};
+
+uint64_t diff_move_key(Move move) {
+    // a byte for every field, rows go up to COLUMN_SLOTS - 1
+    return (uint64_t) move.from.location << 40 | (uint64_t) move.from.column << 32 | (uint64_t) move.from.row << 24 |
+           (uint64_t) move.to.location << 16 | (uint64_t) move.to.column << 8 | (uint64_t) move.to.row;
+}
+
+void diff_sort_moves(Move *moves, int count) {
+    // into a fixed order, the engines may list the same moves differently
+    for (int i = 1; i < count; ++i) {
+        Move move = moves[i];
+        uint64_t key = diff_move_key(move);
+        int j = i;
+        for (; j > 0 && diff_move_key(moves[j - 1]) > key; --j) moves[j] = moves[j - 1];
+        moves[j] = move;
+    }
+}
+
+bool diff_same_pos(CardPos a, CardPos b) {
+    if (a.active != b.active) return false;
+    return !a.active || (a.location == b.location && a.column == b.column && a.row == b.row);
+}
+
+bool diff_same_highlight(Game *a, Game *b, char *where) {
+    // the highlight of every card, and of the empty slot a king would go in, where says the first that differs
+    // the cards have to be the same already, nothing past the top of a pile is ever highlighted or looked at
+    for (int i = 0; i < FOUNDATION_PILES; ++i) {
+        if (a->foundation[i].highlight == b->foundation[i].highlight) continue;
+        sprintf(where, "f%d", i);
+        return false;
+    }
+    for (int i = 0; i < PILE_SLOTS && a->waste[i].rank != NO_RANK; ++i) {
+        if (a->waste[i].highlight == b->waste[i].highlight) continue;
+        sprintf(where, "waste card %d", i);
+        return false;
+    }
+    for (int i = 0; i < PILE_SLOTS && a->stock[i].rank != NO_RANK; ++i) {
+        if (a->stock[i].highlight == b->stock[i].highlight) continue;
+        sprintf(where, "stock card %d", i);
+        return false;
+    }
+    for (int column = 0; column < TABLEAU_COLUMNS; ++column) {
+        for (int row = 0; row < COLUMN_SLOTS; ++row) {
+            if (a->tableau[column][row].highlight != b->tableau[column][row].highlight) {
+                sprintf(where, "t%d:%d", column, row);
+                return false;
+            }
+            if (a->tableau[column][row].rank == NO_RANK) break;
+        }
+    }
+    return true;
+}
+
+typedef struct {
+    Game *game;
+    Game *ref;
+    Move moves[MAX_LEGAL_MOVES];
+    Move ref_moves[MAX_LEGAL_MOVES];
+    int count;
+    PackedGame listed; // the cards moves were listed for, -1 count until there are any
+} DiffPair;
+
+bool diff_compare(DiffPair *pair, char *message) {
+    // after a step: the cards, the cursor, what highlight_stackable() lit up and the legal moves from here on, message
+    // says what differed
+    // the reference lists its moves from ref_highlight_stackable(), so the fast get_legal_moves() is checked against
+    // what the cursor offers
+    // the legal moves only depend on the cards, so after a step that left them as they were (a cursor key, a refused
+    // move) both engines would list the same moves as last time, and they are only compared again after a change
+    PackedGame a, b;
+    pack_game(pair->game, &a);
+    pack_game(pair->ref, &b);
+    if (memcmp(&a, &b, sizeof(PackedGame)) != 0) {
+        snprintf(message, DIFF_MESSAGE, "the cards differ");
+        return false;
+    }
+    if (!diff_same_pos(pair->game->selected, pair->ref->selected)) {
+        snprintf(message, DIFF_MESSAGE, "the selected card differs");
+        return false;
+    }
+    if (!diff_same_pos(pair->game->moving, pair->ref->moving)) {
+        snprintf(message, DIFF_MESSAGE, "the moving card differs");
+        return false;
+    }
+    char where[32];
+    if (!diff_same_highlight(pair->game, pair->ref, where)) {
+        snprintf(message, DIFF_MESSAGE, "the highlight of %s differs", where);
+        return false;
+    }
+    if (pair->count >= 0 && memcmp(&a, &pair->listed, sizeof(PackedGame)) == 0) return true;
+
+    int count = get_legal_moves(pair->game, pair->moves);
+    int ref_count = ref_get_legal_moves(pair->ref, pair->ref_moves);
+    diff_sort_moves(pair->moves, count);
+    diff_sort_moves(pair->ref_moves, ref_count);
+    pair->count = -1; // until the lists agree
+    for (int i = 0; i < count || i < ref_count; ++i) {
+        char text[16];
+        if (i >= ref_count || (i < count && diff_move_key(pair->moves[i]) < diff_move_key(pair->ref_moves[i]))) {
+            snprintf(message, DIFF_MESSAGE, "legal move %s is missing from the reference", format_move(pair->moves[i], text));
+            return false;
+        }
+        if (i >= count || diff_move_key(pair->moves[i]) != diff_move_key(pair->ref_moves[i])) {
+            snprintf(message, DIFF_MESSAGE, "legal move %s is missing from the engine", format_move(pair->ref_moves[i], text));
+            return false;
+        }
+    }
+    pair->count = count;
+    pair->listed = a;
+    return true;
+}
+
+DiffStep diff_pick(DiffPair *pair, uint32_t random) {
+    // the low 2 bits pick a cursor action (0) or a legal move (1 to 3), the rest picks which one
+    // pair->count and pair->moves have to be from the diff_compare() before it
+    DiffStep step = {NO_ACTION, {{0}, {0}}};
+    if ((random & 3) == 0) step.action = (Action) (UP + (random >> 2) % (CANCEL - UP + 1));
+    else if (pair->count > 0) step.move = pair->moves[(random >> 2) % pair->count];
+    return step;
+}
+
+bool diff_legal(DiffPair *pair, Move move) {
+    if (!move.from.active) return false;
+    uint64_t key = diff_move_key(move);
+    for (int i = 0; i < pair->count; ++i) {
+        if (diff_move_key(pair->moves[i]) == key) return true;
+    }
+    return false;
+}
+
+bool diff_listed_from(DiffPair *pair, CardPos from, CardPos to) {
+    // is there a legal move from a card onto a pile, the cursor leaves the destination on whichever row it likes
+    // and the waste on whichever column
+    for (int i = 0; i < pair->count; ++i) {
+        Move move = pair->moves[i];
+        if (move.from.location == from.location && (from.location == WASTE || move.from.column == from.column) &&
+            (from.location != TABLEAU || move.from.row == from.row) &&
+            move.to.location == to.location && move.to.column == to.column) return true;
+    }
+    return false;
+}
+
+bool diff_step(DiffPair *pair, DiffStep step, char *message) {
+    // plays one step on both and compares them, pair->count and pair->moves have to be from the diff_compare() before it
+    bool handled, ref_handled;
+    if (step.action != NO_ACTION) {
+        // a confirm either puts down the card being moved or picks up the selected one and moves it straight away
+        CardPos from = pair->game->moving.active ? pair->game->moving : pair->game->selected;
+        // like the game loop, the display is worked out after every key
+        handled = handle_action(step.action, pair->game);
+        update_display(pair->game);
+        ref_handled = ref_handle_action(step.action, pair->ref);
+        ref_update_display(pair->ref);
+
+        // whatever the cursor moves has to be a move get_legal_moves() listed, two decks have foundations of the same
+        // suit that the cursor could take a card between
+        PackedGame now;
+        pack_game(pair->game, &now);
+        if (handled && step.action == CONFIRM && from.location != STOCK && pair->count >= 0 &&
+            memcmp(&now, &pair->listed, sizeof(PackedGame)) != 0 && !diff_listed_from(pair, from, pair->game->selected)) {
+            char text[16];
+            snprintf(message, DIFF_MESSAGE, "the cursor made %s, which isn't a legal move",
+                     format_move((Move) {from, pair->game->selected}, text));
+            return false;
+        }
+    } else {
+        if (!diff_legal(pair, step.move)) return true;
+        handled = apply_move(pair->game, step.move);
+        update_display(pair->game);
+        ref_handled = ref_apply_move(pair->ref, step.move);
+        ref_update_display(pair->ref);
+    }
+    if (handled != ref_handled) {
+        snprintf(message, DIFF_MESSAGE, "the engine %s the step and the reference %s it",
+                 handled ? "took" : "refused", ref_handled ? "took" : "refused");
+        return false;
+    }
+    return diff_compare(pair, message);
+}
+
+bool diff_deal(DiffPair *pair, unsigned int seed, char *message) {
+    deal_game(pair->game, seed);
+    // the deal is shared code, both engines start from the same cards and cursor
+    *pair->ref = *pair->game;
+    ref_update_display(pair->ref);
+    return diff_compare(pair, message);
+}
+
+int diff_play(DiffPair *pair, unsigned int seed, const DiffStep *trace, int length, char *message) {
+    // the number of the step the engines disagree after (0 for the deal itself), -1 if they never do
+    if (!diff_deal(pair, seed, message)) return 0;
+    for (int i = 0; i < length; ++i) {
+        if (!diff_step(pair, trace[i], message)) return i + 1;
+    }
+    return -1;
+}
+
+int diff_random_game(DiffPair *pair, unsigned int seed, DiffStep *trace, char *message) {
+    // DIFF_STEPS random steps, with the same counter-based generator as the deals past the counters a deal uses
+    // returns like diff_play(), trace gets the steps played
+    if (!diff_deal(pair, seed, message)) return 0;
+    for (int i = 0; i < DIFF_STEPS; ++i) {
+        trace[i] = diff_pick(pair, (uint32_t) deal_random(seed, 64 + i));
+        if (!diff_step(pair, trace[i], message)) return i + 1;
+    }
+    return -1;
+}
+
+int diff_shrink(DiffPair *pair, unsigned int seed, DiffStep *trace, int length, char *message) {
+    // removes runs of steps, halving the run length whenever none can go, while the engines still disagree
+    // ends with a trace where no single step can be left out, message is from its last run
+    char scratch[DIFF_MESSAGE];
+    DiffStep *attempt = malloc(sizeof(DiffStep) * (length > 0 ? length : 1));
+    if (!attempt) return length;
+    for (int chunk = length / 2 > 0 ? length / 2 : 1; chunk >= 1 && length > 0;) {
+        bool removed = false;
+        for (int start = 0; start < length;) {
+            int end = start + chunk < length ? start + chunk : length;
+            memcpy(attempt, trace, sizeof(DiffStep) * start);
+            memcpy(attempt + start, trace + end, sizeof(DiffStep) * (length - end));
+            int fail = diff_play(pair, seed, attempt, length - (end - start), scratch);
+            if (fail >= 0) {
+                // the steps after the one that went wrong are never needed either
+                memcpy(trace, attempt, sizeof(DiffStep) * fail);
+                length = fail;
+                removed = true;
+            } else {
+                start = end;
+            }
+        }
+        if (!removed) chunk /= 2;
+        else if (chunk > length / 2 && length > 1) chunk = length / 2;
+    }
+    free(attempt);
+    diff_play(pair, seed, trace, length, message);
+    return length;
+}
+
+typedef struct {
+    unsigned int first_seed;
+    long games;
+    atomic_long next_game;
+    atomic_long done;
+    atomic_llong steps;
+    atomic_bool stop;
+    pthread_mutex_t lock;
+    DiffResult *result;
+} DiffRun;
+
+DiffPair *create_diff_pair() {
+    DiffPair *pair = malloc(sizeof(DiffPair));
+    if (!pair) return NULL;
+    pair->count = -1;
+    pair->game = malloc(sizeof(Game));
+    pair->ref = malloc(sizeof(Game));
+    if (!pair->game || !pair->ref) {
+        free(pair->game);
+        free(pair->ref);
+        free(pair);
+        return NULL;
+    }
+    return pair;
+}
+
+void free_diff_pair(DiffPair *pair) {
+    if (!pair) return;
+    free(pair->game);
+    free(pair->ref);
+    free(pair);
+}
+
+void *diff_thread(void *arg) {
+    DiffRun *run = arg;
+    DiffPair *pair = create_diff_pair();
+    DiffStep *trace = malloc(sizeof(DiffStep) * DIFF_STEPS);
+    if (!pair || !trace) {
+        free_diff_pair(pair);
+        free(trace);
+        return NULL;
+    }
+
+    char message[DIFF_MESSAGE];
+    while (!atomic_load_explicit(&run->stop, memory_order_relaxed)) {
+        long game = atomic_fetch_add(&run->next_game, 1);
+        if (game >= run->games) break;
+        unsigned int seed = run->first_seed + (unsigned int) game;
+
+        int fail = diff_random_game(pair, seed, trace, message);
+        atomic_fetch_add(&run->steps, fail < 0 ? DIFF_STEPS : fail);
+        long done = atomic_fetch_add(&run->done, 1) + 1;
+        if (done % 10000 == 0) fprintf(stderr, "\r%ld/%ld games", done, run->games);
+        if (fail < 0) continue;
+
+        // only the first mismatch gets shrunk, the other threads wind down meanwhile
+        pthread_mutex_lock(&run->lock);
+        DiffResult *result = run->result;
+        if (!result->mismatch) {
+            atomic_store(&run->stop, true);
+            result->mismatch = true;
+            result->seed = seed;
+            result->length = diff_shrink(pair, seed, trace, fail, result->message);
+            result->trace = malloc(sizeof(DiffStep) * (result->length > 0 ? result->length : 1));
+            if (result->trace) memcpy(result->trace, trace, sizeof(DiffStep) * result->length);
+        }
+        pthread_mutex_unlock(&run->lock);
+        break;
+    }
+
+    free_diff_pair(pair);
+    free(trace);
+    return NULL;
+}
+
+bool run_differential(unsigned int first_seed, long games, int threads, DiffResult *result) {
+    // false if the engines disagree somewhere in games seeds from first_seed, result has the shrunk trace
+    if (threads < 1) threads = 1;
+    memset(result, 0, sizeof(DiffResult));
+    DiffRun run = {first_seed, games, 0, 0, 0, false, PTHREAD_MUTEX_INITIALIZER, result};
+    run_workers(diff_thread, &run, 0, threads);
+    fprintf(stderr, "\r%ld/%ld games\n", atomic_load(&run.done), games);
+    result->games = atomic_load(&run.done);
+    result->steps = atomic_load(&run.steps);
+    return !result->mismatch;
+}
+
+void print_diff_trace(FILE *file, DiffResult *result) {
+    // the steps as they were played, moves in the format_move() form
+    fprintf(file, "seed %u, %d steps: %s\n", result->seed, result->length, result->message);
+    for (int i = 0; i < result->length; ++i) {
+        char text[16];
+        DiffStep step = result->trace[i];
+        if (step.action != NO_ACTION) fprintf(file, "%3d  %s\n", i + 1, diff_action_names[step.action]);
+        else fprintf(file, "%3d  move %s\n", i + 1, step.move.from.active ? format_move(step.move, text) : "(none)");
+    }
+}
+
+#endif
+#endif
@@ -0,0 +1,200 @@
+#ifndef SOLITAIRE_ESTIMATE
+#define SOLITAIRE_ESTIMATE
+
+#include <stdint.h>
+#include "./cards.h"
+#include "./workers.h"
+
+// cheap difficulty estimate for a fresh deal, in one pass over its cards and without any search
+// it works on deal_permutation() bytes, so batches come straight from generate_deals()
+
+// deals estimate_deals() works through side by side, a deck's worth of vectors this many lanes wide stays in L1
+#define ESTIMATE_LANES 64
+
+typedef enum {
+    FEATURE_BURIED_ACES, // cards on top of the aces in the tableau
+    FEATURE_BURIED_TWOS, // cards on top of the twos in the tableau
+    FEATURE_BURIED_KINGS, // cards under the kings, a king is only stuck if it isn't at the bottom of its column
+    FEATURE_SUIT_BLOCKS, // same suit pairs in a column with the lower card underneath, it has to come out first
+    FEATURE_PARENT_BLOCKS, // cards with a card they could go on buried underneath them in the same column
+    FEATURE_STOCK_LOW, // draws needed to reach each ace and two in the stock
+    FEATURE_PLAYABLE, // face up cards that can go somewhere straight away
+    FEATURES
+} Feature;
+
+// with one deck no feature gets past 255 and the lanes stay a byte wide, more decks need wider ones
+#if SOLITAIRE_DECKS == 1
+typedef uint8_t FeatureValue;
+typedef int16_t FeatureScore;
+#else
+typedef uint16_t FeatureValue;
+typedef int32_t FeatureScore;
+#endif
+
+typedef struct {
+    FeatureValue values[FEATURES];
+} DealFeatures;
+
+void deal_features(const uint8_t *deal, DealFeatures *features);
+void game_features(Game *game, DealFeatures *features);
+int estimate_difficulty(const DealFeatures *features);
+void estimate_deals(const uint8_t *deals, long count, int threads, uint8_t *estimates);
+
+#ifdef SOLITAIRE_ESTIMATE_IMPLEMENTATION
+
+#include <string.h>
+
+// logistic fit of the solver not winning at a 50000 node limit, on seeds 0 to 1999, in 1/256ths
+// parent blocks carry most of it, buried kings came out slightly in favour of a win
+// the fit is for the single deck game, other layouts get the same weights
+static const int feature_weights[FEATURES] = {11, 11, -6, 10, 79, 2, -58};
+#define FEATURE_BIAS (-474)
+
+// the top card of each column in deal order, column c ends at 1 + 2 + ... + (c + 1) - 1
+#define FEATURE_TOP(column) ((column) * ((column) + 3) / 2)
+
+void deal_features(const uint8_t *deal, DealFeatures *features) {
+    // deal is DECK_CARDS bytes as from deal_permutation(), column c is dealt as c + 1 cards from the bottom up
+    // the colour of a card byte is bit 5 (suit & 2), like get_suite_color()
+    int aces = 0, twos = 0, kings = 0, suit_blocks = 0, parent_blocks = 0, stock_low = 0, playable = 0;
+    for (int column = 0, start = 0; column < TABLEAU_COLUMNS; start += ++column) {
+        for (int row = 0; row <= column; ++row) {
+            int card = deal[start + row], rank = card & 15;
+            aces += (rank == ACE) * (column - row);
+            twos += (rank == RANK2) * (column - row);
+            kings += (rank == KING) * row;
+
+            // cards further down the same column
+            for (int j = start; j < start + row; ++j) {
+                int below = deal[j], differ = card ^ below;
+                suit_blocks += !(differ & 0x30) & ((below & 15) < rank);
+                parent_blocks += ((below & 15) == rank + 1) & (differ >> 5);
+            }
+        }
+    }
+    for (int a = 0; a < TABLEAU_COLUMNS; ++a) {
+        int card = deal[FEATURE_TOP(a)], fits = (card & 15) == ACE;
+        for (int b = 0; b < TABLEAU_COLUMNS; ++b) {
+            int onto = deal[FEATURE_TOP(b)];
+            fits |= ((onto & 15) == (card & 15) + 1) & ((card ^ onto) >> 5);
+        }
+        playable += fits;
+    }
+    for (int i = DEALT_CARDS; i < DECK_CARDS; ++i) {
+        // the stock is drawn from the end of the deal
+        stock_low += ((deal[i] & 15) <= RANK2) * (DECK_CARDS - i);
+    }
+    // none of them can go past what a FeatureValue holds
+    FeatureValue values[FEATURES] = {aces, twos, kings, suit_blocks, parent_blocks, stock_low, playable};
+    memcpy(features->values, values, sizeof(values));
+}
+
+void game_features(Game *game, DealFeatures *features) {
+    // for a game straight after deal_game() or reset_game()
+    uint8_t deal[DECK_CARDS];
+    int i = 0;
+    for (int column = 0; column < TABLEAU_COLUMNS; ++column) {
+        for (int row = 0; row <= column; ++row) deal[i++] = pack_card(game->tableau[column][row]) & 0x7f;
+    }
+    for (int j = 0; j < STOCK_CARDS; ++j) deal[i++] = pack_card(game->stock[j]) & 0x7f;
+    deal_features(deal, features);
+}
+
+int estimate_curve(int score) {
+    // logistic curve on score / 256 in half steps from -4 to 4, piecewise so it stays integer
+    static const uint8_t curve[17] = {2, 3, 5, 8, 12, 18, 27, 38, 50, 62, 73, 82, 88, 92, 95, 97, 98};
+    int x = score + 4 * 256;
+    if (x <= 0) return curve[0];
+    if (x >= 8 * 256) return curve[16];
+    int step = x / 128, fraction = x % 128;
+    return curve[step] + (curve[step + 1] - curve[step]) * fraction / 128;
+}
+
+int estimate_difficulty(const DealFeatures *features) {
+    // 0 to 100, the chance (in percent) that the solver doesn't win the deal
+    int score = FEATURE_BIAS;
+    for (int f = 0; f < FEATURES; ++f) score += feature_weights[f] * features->values[f];
+    return estimate_curve(score);
+}
+
+void estimate_block(const uint8_t *deals, int count, uint8_t *estimates) {
+    // deal_features() for up to ESTIMATE_LANES deals at once: the deals are turned around so card i of every deal
+    // sits next to each other, then every step of deal_features() runs across all lanes and vectorizes
+    uint8_t cards[DECK_CARDS][ESTIMATE_LANES];
+    FeatureValue values[FEATURES][ESTIMATE_LANES] = {{0}};
+    if (count < ESTIMATE_LANES) memset(cards, 0, sizeof(cards));
+    for (int lane = 0; lane < count; ++lane) {
+        for (int i = 0; i < DECK_CARDS; ++i) cards[i][lane] = deals[lane * DECK_CARDS + i];
+    }
+    for (int column = 0, start = 0; column < TABLEAU_COLUMNS; start += ++column) {
+        for (int row = 0; row <= column; ++row) {
+            uint8_t *card = cards[start + row];
+            for (int lane = 0; lane < ESTIMATE_LANES; ++lane) {
+                uint8_t rank = card[lane] & 15;
+                values[FEATURE_BURIED_ACES][lane] += (rank == ACE) * (column - row);
+                values[FEATURE_BURIED_TWOS][lane] += (rank == RANK2) * (column - row);
+                values[FEATURE_BURIED_KINGS][lane] += (rank == KING) * row;
+            }
+            for (int j = start; j < start + row; ++j) {
+                uint8_t *below = cards[j];
+                for (int lane = 0; lane < ESTIMATE_LANES; ++lane) {
+                    uint8_t differ = card[lane] ^ below[lane], rank = card[lane] & 15, below_rank = below[lane] & 15;
+                    values[FEATURE_SUIT_BLOCKS][lane] += !(differ & 0x30) & (below_rank < rank);
+                    values[FEATURE_PARENT_BLOCKS][lane] += (below_rank == rank + 1) & (differ >> 5);
+                }
+            }
+        }
+    }
+    for (int a = 0; a < TABLEAU_COLUMNS; ++a) {
+        uint8_t *card = cards[FEATURE_TOP(a)], fits[ESTIMATE_LANES];
+        for (int lane = 0; lane < ESTIMATE_LANES; ++lane) fits[lane] = (card[lane] & 15) == ACE;
+        for (int b = 0; b < TABLEAU_COLUMNS; ++b) {
+            uint8_t *onto = cards[FEATURE_TOP(b)];
+            for (int lane = 0; lane < ESTIMATE_LANES; ++lane) {
+                fits[lane] |= ((onto[lane] & 15) == (card[lane] & 15) + 1) & ((card[lane] ^ onto[lane]) >> 5);
+            }
+        }
+        for (int lane = 0; lane < ESTIMATE_LANES; ++lane) values[FEATURE_PLAYABLE][lane] += fits[lane];
+    }
+    for (int i = DEALT_CARDS; i < DECK_CARDS; ++i) {
+        for (int lane = 0; lane < ESTIMATE_LANES; ++lane) values[FEATURE_STOCK_LOW][lane] += ((cards[i][lane] & 15) <= RANK2) * (DECK_CARDS - i);
+    }
+
+    // the same score as estimate_difficulty(), with one deck it stays well inside 16 bits
+    FeatureScore scores[ESTIMATE_LANES];
+    for (int lane = 0; lane < ESTIMATE_LANES; ++lane) scores[lane] = FEATURE_BIAS;
+    for (int f = 0; f < FEATURES; ++f) {
+        for (int lane = 0; lane < ESTIMATE_LANES; ++lane) scores[lane] += feature_weights[f] * values[f][lane];
+    }
+    for (int lane = 0; lane < count; ++lane) estimates[lane] = (uint8_t) estimate_curve(scores[lane]);
+}
+
+typedef struct {
+    const uint8_t *deals;
+    long count;
+    uint8_t *estimates;
+} EstimateWork;
+
+void *estimate_thread(void *arg) {
+    EstimateWork *work = arg;
+    for (long i = 0; i < work->count; i += ESTIMATE_LANES) {
+        int count = work->count - i < ESTIMATE_LANES ? (int) (work->count - i) : ESTIMATE_LANES;
+        estimate_block(&work->deals[i * DECK_CARDS], count, &work->estimates[i]);
+    }
+    return NULL;
+}
+
+void estimate_deals(const uint8_t *deals, long count, int threads, uint8_t *estimates) {
+    // one estimate per DECK_CARDS byte deal, split evenly over the threads like generate_deals()
+    if (threads < 1) threads = 1;
+    if (threads > count) threads = count > 0 ? (int) count : 1;
+    EstimateWork work[threads];
+    for (int t = 0; t < threads; ++t) {
+        long start = count * t / threads, end = count * (t + 1) / threads;
+        work[t] = (EstimateWork) {deals + start * DECK_CARDS, end - start, estimates + start};
+    }
+    run_workers(estimate_thread, work, sizeof(EstimateWork), threads);
+}
+
+#endif
+#endif
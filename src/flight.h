@@ -0,0 +1,348 @@
+#ifndef SOLITAIRE_FLIGHT
+#define SOLITAIRE_FLIGHT
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "./cards.h"
+
+// flight recorder: the last FLIGHT_EVENTS things the game loop did, always kept in memory and appended to a file
+// when someone asks (SIGUSR1) or when one key keeps the loop busy for longer than the stall threshold, so a frozen
+// game can be looked at afterwards with --flight-decode
+// recording is a clock read, one atomic add and a 32 byte store into a static ring, nothing ever waits: writers take
+// the next slot and the dump (which may run in a signal handler) snapshots the ring seqlock style, a slot rewritten
+// while it was copied is left out of the snapshot
+
+#define FLIGHT_MAGIC 0x544c4653 // "SFLT", starts every dump
+#define FLIGHT_VERSION (1 | LAYOUT_VERSION)
+#define FLIGHT_EVENTS 8192 // a power of two
+
+typedef enum {
+    FLIGHT_NONE, // a slot that was never written
+    FLIGHT_KEY, // value: what getch() returned
+    FLIGHT_ACTION, // a: the action, b: what handle_action() returned
+    FLIGHT_MOVE, // a, b: from and to as location << 4 | column, c: whether the cards moved, value: the rows
+    FLIGHT_DISPLAY,
+    FLIGHT_RENDER,
+    FLIGHT_REFRESH,
+    FLIGHT_STALL, // the watchdog found the loop busy on one key for duration, a: the phase it was in
+    FLIGHT_SIGNAL, // value: the signal that asked for a dump
+    FLIGHT_KINDS
+} FlightKind;
+
+typedef enum {
+    FLIGHT_DUMP_SIGNAL, FLIGHT_DUMP_STALL
+} FlightReason;
+
+typedef struct {
+    _Atomic uint64_t sequence; // events recorded before this one plus one, 0 while it is being written
+    uint64_t time; // CLOCK_MONOTONIC nanoseconds at the start
+    uint32_t duration; // nanoseconds, UINT32_MAX for anything longer
+    uint32_t value;
+    uint8_t kind;
+    uint8_t a;
+    uint8_t b;
+    uint8_t c;
+    uint32_t reserved;
+} FlightEvent;
+
+typedef struct {
+    // written right before the ring, the whole dump is this followed by FLIGHT_EVENTS events in slot order
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reason;
+    uint32_t capacity;
+    uint32_t pid;
+    uint64_t head; // events recorded so far, the newest is in slot (head - 1) % capacity
+    uint64_t time; // CLOCK_MONOTONIC nanoseconds at the dump
+    uint64_t wall; // CLOCK_REALTIME nanoseconds at the dump, to put dates on the monotonic times
+    uint64_t busy_since; // when the loop got the key it was working on, 0 if it was waiting for one
+    uint8_t phase; // the FlightKind the loop was in
+    uint8_t reserved[7];
+} FlightHeader;
+
+uint64_t flight_now();
+void flight_record(FlightKind kind, uint64_t start, uint8_t a, uint8_t b, uint8_t c, uint32_t value);
+uint64_t flight_begin(FlightKind phase);
+void flight_end(FlightKind kind, uint64_t start, uint8_t a, uint8_t b);
+void flight_key(int key);
+void flight_idle();
+bool flight_dump(FlightReason reason);
+void flight_signal(int number);
+bool start_flight_recorder(const char *path, double stall_seconds);
+char *default_flight_path();
+bool decode_flight(const char *path, FILE *file);
+
+#ifdef SOLITAIRE_FLIGHT_IMPLEMENTATION
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "./save.h"
+
+typedef struct {
+    FlightEvent events[FLIGHT_EVENTS];
+    struct {
+        // written out as it is, the events are a snapshot of the ring
+        FlightHeader header;
+        FlightEvent events[FLIGHT_EVENTS];
+    } dump;
+    _Atomic uint64_t head;
+    _Atomic uint64_t busy_since;
+    _Atomic uint8_t phase;
+    atomic_flag dumping;
+    uint64_t stall; // nanoseconds, 0 for no watchdog
+    char path[4096]; // empty until start_flight_recorder(), the dump can't build it inside a signal handler
+} FlightRecorder;
+
+static FlightRecorder flight = {.dumping = ATOMIC_FLAG_INIT};
+
+uint64_t flight_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void flight_record(FlightKind kind, uint64_t start, uint8_t a, uint8_t b, uint8_t c, uint32_t value) {
+    // start is when it began, the duration runs up to now, safe to call from any thread and from signal handlers
+    uint64_t duration = flight_now() - start;
+    uint64_t sequence = atomic_fetch_add_explicit(&flight.head, 1, memory_order_relaxed);
+    FlightEvent *event = &flight.events[sequence & (FLIGHT_EVENTS - 1)];
+    atomic_store_explicit(&event->sequence, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release); // the 0 is seen before any of the new fields
+    event->time = start;
+    event->duration = duration > UINT32_MAX ? UINT32_MAX : (uint32_t) duration;
+    event->value = value;
+    event->kind = kind;
+    event->a = a;
+    event->b = b;
+    event->c = c;
+    atomic_store_explicit(&event->sequence, sequence + 1, memory_order_release);
+}
+
+uint64_t flight_begin(FlightKind phase) {
+    // the phase is what a dump reports the loop as stuck in, hand the result to flight_end()
+    atomic_store_explicit(&flight.phase, phase, memory_order_relaxed);
+    return flight_now();
+}
+
+void flight_end(FlightKind kind, uint64_t start, uint8_t a, uint8_t b) {
+    flight_record(kind, start, a, b, 0, 0);
+}
+
+void flight_key(int key) {
+    // the loop is busy from here until flight_idle()
+    uint64_t now = flight_now();
+    flight_record(FLIGHT_KEY, now, 0, 0, 0, (uint32_t) key);
+    atomic_store_explicit(&flight.busy_since, now, memory_order_relaxed);
+}
+
+void flight_idle() {
+    atomic_store_explicit(&flight.busy_since, 0, memory_order_relaxed);
+    atomic_store_explicit(&flight.phase, FLIGHT_NONE, memory_order_relaxed);
+}
+
+bool flight_move_hook(Game *game) {
+    uint64_t start = flight_now();
+    CardPos from = game->moving, to = game->selected;
+    bool moved = move_card_unhooked(game);
+    flight_record(FLIGHT_MOVE, start, (uint8_t) (from.location << 4 | (from.column & 15)),
+                  (uint8_t) (to.location << 4 | (to.column & 15)), moved, (uint32_t) (from.row & 0xffff) | (uint32_t) to.row << 16);
+    return moved;
+}
+
+void flight_snapshot(FlightEvent *into) {
+    // copies the ring, a slot that was being written, or that changed while it was copied, gets sequence 0
+    for (int i = 0; i < FLIGHT_EVENTS; ++i) {
+        FlightEvent *event = &flight.events[i];
+        uint64_t sequence = atomic_load_explicit(&event->sequence, memory_order_acquire);
+        into[i].time = event->time;
+        into[i].duration = event->duration;
+        into[i].value = event->value;
+        into[i].kind = event->kind;
+        into[i].a = event->a;
+        into[i].b = event->b;
+        into[i].c = event->c;
+        into[i].reserved = 0;
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&event->sequence, memory_order_relaxed) != sequence) sequence = 0;
+        atomic_store_explicit(&into[i].sequence, sequence, memory_order_relaxed);
+    }
+}
+
+bool flight_dump(FlightReason reason) {
+    // only open, write and close, so it can run in a signal handler
+    // a dump that starts while another is being written is dropped rather than waited for
+    if (!flight.path[0] || atomic_flag_test_and_set(&flight.dumping)) return false;
+    struct timespec wall;
+    clock_gettime(CLOCK_REALTIME, &wall);
+    FlightHeader *header = &flight.dump.header;
+    header->magic = FLIGHT_MAGIC;
+    header->version = FLIGHT_VERSION;
+    header->reason = reason;
+    header->capacity = FLIGHT_EVENTS;
+    header->pid = (uint32_t) getpid();
+    header->head = atomic_load(&flight.head);
+    header->time = flight_now();
+    header->wall = (uint64_t) wall.tv_sec * 1000000000 + wall.tv_nsec;
+    header->busy_since = atomic_load(&flight.busy_since);
+    header->phase = atomic_load(&flight.phase);
+    flight_snapshot(flight.dump.events);
+
+    bool written = false;
+    int fd = open(flight.path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd >= 0) {
+        written = write(fd, &flight.dump, sizeof(flight.dump)) == (ssize_t) sizeof(flight.dump);
+        written = close(fd) == 0 && written;
+    }
+    atomic_flag_clear(&flight.dumping);
+    return written;
+}
+
+void flight_signal(int number) {
+    // the SIGUSR1 handler, errno is kept for whatever call the signal interrupted
+    int saved_errno = errno;
+    flight_record(FLIGHT_SIGNAL, flight_now(), 0, 0, 0, (uint32_t) number);
+    flight_dump(FLIGHT_DUMP_SIGNAL);
+    errno = saved_errno;
+}
+
+void *flight_watchdog_thread(void *arg) {
+    // dumps once for every key that keeps the loop busy past the threshold, it checks a few times per threshold
+    (void) arg;
+    uint64_t dumped = 0; // busy_since of the last stall dumped
+    uint64_t interval = flight.stall / 4;
+    if (interval < 10000000) interval = 10000000;
+    if (interval > 250000000) interval = 250000000;
+    struct timespec sleep = {(time_t) (interval / 1000000000), (long) (interval % 1000000000)};
+    while (true) {
+        nanosleep(&sleep, NULL);
+        uint64_t since = atomic_load_explicit(&flight.busy_since, memory_order_relaxed);
+        if (!since || since == dumped) continue;
+        uint64_t now = flight_now();
+        if (now < since + flight.stall) continue;
+        dumped = since;
+        flight_record(FLIGHT_STALL, since, atomic_load_explicit(&flight.phase, memory_order_relaxed), 0, 0, 0);
+        flight_dump(FLIGHT_DUMP_STALL);
+    }
+    return NULL;
+}
+
+bool start_flight_recorder(const char *path, double stall_seconds) {
+    // records moves from here on, dumps go to path once its directory exists
+    // false (with errno set) if it can't make the directory or start the watchdog, events are recorded anyway
+    move_card_hook = flight_move_hook;
+    if (!path || strlen(path) >= sizeof(flight.path)) return true;
+    if (!make_parent_dirs(path)) return false;
+    strcpy(flight.path, path);
+    if (stall_seconds <= 0) return true;
+
+    flight.stall = (uint64_t) (stall_seconds * 1e9);
+    pthread_t thread;
+    pthread_attr_t attributes;
+    pthread_attr_init(&attributes);
+    pthread_attr_setdetachstate(&attributes, PTHREAD_CREATE_DETACHED);
+    int error = pthread_create(&thread, &attributes, flight_watchdog_thread, NULL);
+    pthread_attr_destroy(&attributes);
+    if (error) errno = error;
+    return error == 0;
+}
+
+char *default_flight_path() {
+    // next to the save: $XDG_STATE_HOME/solitaire/flight, or ~/.local/state/solitaire/flight
+    static char path[4096];
+    char *state = getenv("XDG_STATE_HOME");
+    char *home = getenv("HOME");
+    if (state && *state) snprintf(path, sizeof(path), "%s/%s/flight", state, EXEC);
+    else if (home && *home) snprintf(path, sizeof(path), "%s/.local/state/%s/flight", home, EXEC);
+    else return NULL;
+    return path;
+}
+
+static const char *flight_kind_names[FLIGHT_KINDS] = {
+        "none", "key", "action", "move", "display", "render", "refresh", "stall", "signal"
+};
+static const char *flight_action_names[] = {"none", "up", "right", "down", "left", "confirm", "cancel", "quit"};
+
+void print_flight_event(FILE *file, const FlightHeader *header, const FlightEvent *event) {
+    // one line: sequence, milliseconds before the dump, kind, duration in microseconds, details
+    const char *kind = event->kind < FLIGHT_KINDS ? flight_kind_names[event->kind] : "?";
+    fprintf(file, "%8lu %12.3f %-8s %10.1f", (unsigned long) (event->sequence - 1),
+            ((double) event->time - (double) header->time) / 1e6, kind, event->duration / 1e3);
+    switch (event->kind) {
+        case FLIGHT_KEY:
+            if (event->value >= 32 && event->value < 127) fprintf(file, " %u '%c'", event->value, (char) event->value);
+            else fprintf(file, " %u", event->value);
+            break;
+        case FLIGHT_ACTION:
+            fprintf(file, " %s%s", event->a <= QUIT ? flight_action_names[event->a] : "?", event->b ? "" : " (returned false)");
+            break;
+        case FLIGHT_MOVE: {
+            char text[16];
+            Move move = {{true, event->a >> 4, event->a & 15, (int) (event->value & 0xffff)},
+                         {true, event->b >> 4, event->b & 15, (int) (event->value >> 16)}};
+            fprintf(file, " %s%s", format_move(move, text), event->c ? "" : " (refused)");
+            break;
+        }
+        case FLIGHT_STALL:
+            fprintf(file, " busy in %s", event->a < FLIGHT_KINDS ? flight_kind_names[event->a] : "?");
+            break;
+        case FLIGHT_SIGNAL:
+            fprintf(file, " %u", event->value);
+            break;
+        default:
+            break;
+    }
+    fputc('\n', file);
+}
+
+bool decode_flight(const char *path, FILE *file) {
+    // every dump in the file, oldest event first, times in milliseconds relative to the dump
+    FILE *input = fopen(path, "rb");
+    if (!input) return false;
+    static FlightEvent events[FLIGHT_EVENTS];
+    FlightHeader header;
+    int dumps = 0;
+    bool ok = true;
+    while (fread(&header, sizeof(header), 1, input) == 1) {
+        if (header.magic != FLIGHT_MAGIC || header.version != FLIGHT_VERSION || header.capacity != FLIGHT_EVENTS ||
+            fread(events, sizeof(FlightEvent), FLIGHT_EVENTS, input) != FLIGHT_EVENTS) {
+            fprintf(stderr, "%s: dump %d is damaged or from another build\n", path, dumps + 1);
+            ok = false;
+            break;
+        }
+        ++dumps;
+
+        time_t seconds = (time_t) (header.wall / 1000000000);
+        char date[64];
+        strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", localtime(&seconds));
+        fprintf(file, "# dump %d: %s, pid %u, %s.%03u, %lu events recorded\n", dumps,
+                header.reason == FLIGHT_DUMP_STALL ? "stall" : "signal", header.pid, date,
+                (unsigned) (header.wall / 1000000 % 1000), (unsigned long) header.head);
+        if (header.busy_since) {
+            fprintf(file, "# busy on one key for %.3f ms, in %s\n", (header.time - header.busy_since) / 1e6,
+                    header.phase < FLIGHT_KINDS ? flight_kind_names[header.phase] : "?");
+        } else {
+            fprintf(file, "# waiting for a key\n");
+        }
+        fprintf(file, "# sequence ms kind duration_us details\n");
+
+        // oldest slot first, slots that were being written (or rewritten) while the dump copied them are skipped
+        uint64_t first = header.head > FLIGHT_EVENTS ? header.head - FLIGHT_EVENTS : 0;
+        for (uint64_t sequence = first; sequence < header.head; ++sequence) {
+            FlightEvent *event = &events[sequence & (FLIGHT_EVENTS - 1)];
+            if (event->sequence != sequence + 1) continue;
+            print_flight_event(file, &header, event);
+        }
+    }
+    if (ferror(input)) ok = false;
+    fclose(input);
+    return ok;
+}
+
+#endif
+#endif
@@ -0,0 +1,73 @@
+#ifndef SOLITAIRE_HISTOGRAM
+#define SOLITAIRE_HISTOGRAM
+
+#include <stdint.h>
+
+// log-linear buckets: 4 per power of two, so any quantile is within 25% of the real value
+#define HISTOGRAM_SUB_BUCKETS 4
+#define HISTOGRAM_BUCKETS (64 * HISTOGRAM_SUB_BUCKETS)
+
+typedef struct {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    uint32_t buckets[HISTOGRAM_BUCKETS];
+} Histogram;
+
+void histogram_add(Histogram *histogram, uint64_t value);
+void histogram_merge(Histogram *into, const Histogram *from);
+uint64_t histogram_quantile(const Histogram *histogram, double quantile);
+uint64_t histogram_bucket_low(int bucket);
+uint64_t histogram_bucket_high(int bucket);
+
+#ifdef SOLITAIRE_HISTOGRAM_IMPLEMENTATION
+
+int histogram_bucket(uint64_t value) {
+    if (value < HISTOGRAM_SUB_BUCKETS) return (int) value;
+    int exponent = 63 - __builtin_clzll(value);
+    int sub = (int) (value >> (exponent - 2)) & (HISTOGRAM_SUB_BUCKETS - 1);
+    return exponent * HISTOGRAM_SUB_BUCKETS + sub;
+}
+
+uint64_t histogram_bucket_low(int bucket) {
+    if (bucket < HISTOGRAM_SUB_BUCKETS) return bucket;
+    int exponent = bucket / HISTOGRAM_SUB_BUCKETS, sub = bucket % HISTOGRAM_SUB_BUCKETS;
+    return (uint64_t) (HISTOGRAM_SUB_BUCKETS + sub) << (exponent - 2);
+}
+
+uint64_t histogram_bucket_high(int bucket) {
+    // inclusive
+    if (bucket + 1 >= HISTOGRAM_BUCKETS) return UINT64_MAX;
+    return histogram_bucket_low(bucket + 1) - 1;
+}
+
+void histogram_add(Histogram *histogram, uint64_t value) {
+    ++histogram->buckets[histogram_bucket(value)];
+    ++histogram->count;
+    histogram->sum += value;
+    if (value > histogram->max) histogram->max = value;
+}
+
+void histogram_merge(Histogram *into, const Histogram *from) {
+    for (int i = 0; i < HISTOGRAM_BUCKETS; ++i) into->buckets[i] += from->buckets[i];
+    into->count += from->count;
+    into->sum += from->sum;
+    if (from->max > into->max) into->max = from->max;
+}
+
+uint64_t histogram_quantile(const Histogram *histogram, double quantile) {
+    // middle of the bucket the quantile falls in, never more than the largest value seen
+    if (histogram->count == 0) return 0;
+    uint64_t rank = (uint64_t) (quantile * (double) (histogram->count - 1)) + 1, seen = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+        seen += histogram->buckets[i];
+        if (seen < rank) continue;
+        uint64_t low = histogram_bucket_low(i), high = histogram_bucket_high(i);
+        uint64_t middle = low + (high - low) / 2;
+        return middle > histogram->max ? histogram->max : middle;
+    }
+    return histogram->max;
+}
+
+#endif
+#endif
@@ -0,0 +1,205 @@
+#ifndef SOLITAIRE_LEGAL
+#define SOLITAIRE_LEGAL
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "./cards.h"
+#include "./playcheck.h"
+
+// the legal moves of a game, kept up to date move by move instead of found again from scratch
+// a move from one pile to another is unique (the face up cards of a column run down one rank per row, so at most
+// one of them fits on any card), so the set is a [from][to] table of source rows, and a move only changes the
+// entries from and to the piles it touched: the piles it took cards from and put cards on, the waste for a draw
+// legal_set_moves() lists the set in the same order as get_legal_moves()
+// build with -DSOLITAIRE_LEGAL_CHECK (make LEGAL_CHECK=1) to compare the set with get_legal_moves() after every move
+
+// piles in the set, tableau columns first, the stock only shows in the draw flag
+#define LEGAL_WASTE TABLEAU_COLUMNS
+#define LEGAL_FOUNDATION (TABLEAU_COLUMNS + 1)
+#define LEGAL_PILES (LEGAL_FOUNDATION + FOUNDATION_PILES)
+#define LEGAL_ALL_PILES ((1u << LEGAL_PILES) - 1)
+#define LEGAL_NONE -1
+
+typedef struct {
+    int8_t row[LEGAL_PILES][LEGAL_PILES]; // [from][to], the row of the card that moves (0 off the waste and the foundations), or LEGAL_NONE
+    uint8_t height[TABLEAU_COLUMNS];
+    uint8_t up[TABLEAU_COLUMNS]; // first face up row of each column
+    uint8_t waste_count;
+    bool draw; // there is a card to draw, or a waste to turn over
+    int count; // moves in the set, the draw included
+} LegalSet;
+
+void rebuild_legal_set(LegalSet *set, Game *game);
+void update_legal_set(LegalSet *set, Game *game, uint32_t piles);
+uint32_t legal_move_piles(Move move);
+bool legal_set_apply(LegalSet *set, Game *game, Move move);
+int legal_set_moves(LegalSet *set, Move *moves);
+bool check_legal_set(LegalSet *set, Game *game, char *message);
+
+#ifdef SOLITAIRE_LEGAL_IMPLEMENTATION
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int8_t find_legal_row(LegalSet *set, Game *game, int from, int to) {
+    // the entry for a move from one pile to another, the same checks as get_legal_moves()
+    if (from == to || to == LEGAL_WASTE || (from >= LEGAL_FOUNDATION && to >= LEGAL_FOUNDATION)) return LEGAL_NONE;
+    Card card;
+    int row = 0;
+    if (from < TABLEAU_COLUMNS) {
+        int height = set->height[from];
+        if (height == 0) return LEGAL_NONE;
+        row = height - 1;
+    } else if (from == LEGAL_WASTE) {
+        if (set->waste_count == 0) return LEGAL_NONE;
+        card = game->waste[set->waste_count - 1];
+    } else {
+        card = game->foundation[from - LEGAL_FOUNDATION];
+        if (card.rank == NO_RANK) return LEGAL_NONE;
+    }
+
+    if (to >= LEGAL_FOUNDATION) {
+        // only the top card of a column goes up
+        if (from < TABLEAU_COLUMNS) card = game->tableau[from][row];
+        return can_stack(card, game->foundation[to - LEGAL_FOUNDATION], true) ? row : LEGAL_NONE;
+    }
+
+    int height = set->height[to];
+    Card above = height > 0 ? game->tableau[to][height - 1] : unpack_card(0);
+    if (height > 0 && !above.visible) return LEGAL_NONE;
+    if (from < TABLEAU_COLUMNS) {
+        // the one face up card that could fit is as far above the first face up card as its rank is below
+        int up = set->up[from];
+        int need = height > 0 ? (int) above.rank - 1 : KING;
+        row = up + (int) game->tableau[from][up].rank - need;
+        if (row < up || row >= set->height[from]) return LEGAL_NONE;
+        card = game->tableau[from][row];
+    }
+    if (height == 0) return card.rank == KING ? row : LEGAL_NONE;
+    return can_stack(card, above, false) ? row : LEGAL_NONE;
+}
+
+static inline void set_legal_row(LegalSet *set, int from, int to, int8_t row) {
+    set->count += (row != LEGAL_NONE) - (set->row[from][to] != LEGAL_NONE);
+    set->row[from][to] = row;
+}
+
+void update_legal_set(LegalSet *set, Game *game, uint32_t piles) {
+    // finds the entries from and to the piles in piles (a bit per pile) again, the rest of the set stays
+    for (int column = 0; column < TABLEAU_COLUMNS; ++column) {
+        if (!(piles & 1u << column)) continue;
+        int height = 0;
+        while (height < COLUMN_SLOTS && game->tableau[column][height].rank != NO_RANK) ++height;
+        int up = height;
+        while (up > 0 && game->tableau[column][up - 1].visible) --up;
+        set->height[column] = height;
+        set->up[column] = up;
+    }
+    if (piles & 1u << LEGAL_WASTE) {
+        int count = 0;
+        while (count < PILE_SLOTS && game->waste[count].rank != NO_RANK) ++count;
+        set->waste_count = count;
+    }
+
+    for (int pile = 0; pile < LEGAL_PILES; ++pile) {
+        if (!(piles & 1u << pile)) continue;
+        for (int other = 0; other < LEGAL_PILES; ++other) {
+            set_legal_row(set, pile, other, find_legal_row(set, game, pile, other));
+            set_legal_row(set, other, pile, find_legal_row(set, game, other, pile));
+        }
+    }
+
+    bool draw = game->stock[0].rank != NO_RANK || set->waste_count > 0;
+    set->count += draw - set->draw;
+    set->draw = draw;
+}
+
+void rebuild_legal_set(LegalSet *set, Game *game) {
+    memset(set->row, LEGAL_NONE, sizeof(set->row));
+    set->count = 0;
+    set->draw = false;
+    update_legal_set(set, game, LEGAL_ALL_PILES);
+}
+
+static inline uint32_t legal_pile_bit(CardPos pos) {
+    switch (pos.location) {
+        case TABLEAU:
+            return 1u << pos.column;
+        case FOUNDATION:
+            return 1u << (LEGAL_FOUNDATION + pos.column);
+        default:
+            // a draw changes the stock and the waste, only the waste is a source
+            return 1u << LEGAL_WASTE;
+    }
+}
+
+uint32_t legal_move_piles(Move move) {
+    // the piles a move changes, a column it takes the top off also turns its new top over
+    return legal_pile_bit(move.from) | legal_pile_bit(move.to);
+}
+
+bool legal_set_apply(LegalSet *set, Game *game, Move move) {
+    // apply_move(), then the set catches up with the piles the move touched
+    bool moved = apply_move(game, move);
+    if (moved) update_legal_set(set, game, legal_move_piles(move));
+#ifdef SOLITAIRE_LEGAL_CHECK
+    char message[PLAY_CHECK_MESSAGE];
+    if (!check_legal_set(set, game, message)) {
+        char text[16];
+        fprintf(stderr, "legal move set is off after %s (seed %u): %s\n", format_move(move, text), game->seed, message);
+        abort();
+    }
+#endif
+    return moved;
+}
+
+int legal_set_moves(LegalSet *set, Move *moves) {
+    // the moves in get_legal_moves() order: by source pile, then by row, and off the top row onto the foundations
+    // before the columns, moves must have room for MAX_LEGAL_MOVES entries
+    int count = 0;
+    for (int from = 0; from < LEGAL_PILES; ++from) {
+        CardLocation location = from < TABLEAU_COLUMNS ? TABLEAU : from == LEGAL_WASTE ? WASTE : FOUNDATION;
+        int column = location == TABLEAU ? from : location == WASTE ? 0 : from - LEGAL_FOUNDATION;
+        int top = location == TABLEAU ? set->height[from] - 1 : 0;
+        int8_t *rows = set->row[from];
+
+        // runs from below the top card, sorted by row (there are only a few)
+        int below[TABLEAU_COLUMNS], lower = 0;
+        for (int to = 0; to < TABLEAU_COLUMNS; ++to) {
+            if (rows[to] == LEGAL_NONE || rows[to] == top) continue;
+            int i = lower++;
+            for (; i > 0 && rows[below[i - 1]] > rows[to]; --i) below[i] = below[i - 1];
+            below[i] = to;
+        }
+        for (int i = 0; i < lower; ++i) {
+            int to = below[i];
+            moves[count++] = (Move) {{true, location, column, rows[to]}, {true, TABLEAU, to, set->height[to] > 0 ? set->height[to] - 1 : 0}};
+        }
+
+        for (int f = 0; f < FOUNDATION_PILES; ++f) {
+            if (rows[LEGAL_FOUNDATION + f] == LEGAL_NONE) continue;
+            moves[count++] = (Move) {{true, location, column, top}, {true, FOUNDATION, f, 0}};
+        }
+        for (int to = 0; to < TABLEAU_COLUMNS; ++to) {
+            if (rows[to] == LEGAL_NONE || rows[to] != top) continue;
+            moves[count++] = (Move) {{true, location, column, top}, {true, TABLEAU, to, set->height[to] > 0 ? set->height[to] - 1 : 0}};
+        }
+    }
+    if (set->draw) moves[count++] = (Move) {{true, STOCK, 0, 0}, {true, WASTE, 0, 0}};
+    return count;
+}
+
+bool check_legal_set(LegalSet *set, Game *game, char *message) {
+    // compares the set with get_legal_moves(), message (PLAY_CHECK_MESSAGE bytes) says how they first differ
+    Move moves[MAX_LEGAL_MOVES];
+    int listed = legal_set_moves(set, moves);
+    if (listed != set->count) {
+        snprintf(message, PLAY_CHECK_MESSAGE, "the set lists %d moves and counts %d", listed, set->count);
+        return false;
+    }
+    return check_listed_moves(game, moves, listed, message);
+}
+
+#endif
+#endif
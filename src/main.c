@@ -4,9 +4,55 @@
 #include <assert.h>
 #include <locale.h>
 #include <string.h>
+#include <getopt.h>
+#include <stdio.h>
 
 #define SOLITAIRE_CARDS_IMPLEMENTATION
 #include "./cards.h"
+#define SOLITAIRE_WORKERS_IMPLEMENTATION
+#include "./workers.h"
+#define SOLITAIRE_PLAY_CHECK_IMPLEMENTATION
+#include "./playcheck.h"
+#define SOLITAIRE_DEALS_IMPLEMENTATION
+#include "./deals.h"
+#define SOLITAIRE_ESTIMATE_IMPLEMENTATION
+#include "./estimate.h"
+#define SOLITAIRE_LEGAL_IMPLEMENTATION
+#include "./legal.h"
+#define SOLITAIRE_POLICY_IMPLEMENTATION
+#include "./policy.h"
+#define SOLITAIRE_POSITION_CACHE_IMPLEMENTATION
+#include "./poscache.h"
+#define SOLITAIRE_SOLVER_IMPLEMENTATION
+#include "./solver.h"
+#define SOLITAIRE_OPTIMAL_IMPLEMENTATION
+#include "./optimal.h"
+#define SOLITAIRE_DEAL_INDEX_IMPLEMENTATION
+#include "./dealindex.h"
+#define SOLITAIRE_SAVE_IMPLEMENTATION
+#include "./save.h"
+#define SOLITAIRE_SERVE_IMPLEMENTATION
+#include "./serve.h"
+#define SOLITAIRE_SPECTATE_IMPLEMENTATION
+#include "./spectate.h"
+#define SOLITAIRE_HISTOGRAM_IMPLEMENTATION
+#include "./histogram.h"
+#define SOLITAIRE_REPLAY_IMPLEMENTATION
+#include "./replay.h"
+#define SOLITAIRE_REFERENCE_IMPLEMENTATION
+#include "./reference.h"
+#define SOLITAIRE_DIFFERENTIAL_IMPLEMENTATION
+#include "./differential.h"
+#define SOLITAIRE_PERF_IMPLEMENTATION
+#include "./perf.h"
+#define SOLITAIRE_COUNTERS_IMPLEMENTATION
+#include "./counters.h"
+#define SOLITAIRE_FLIGHT_IMPLEMENTATION
+#include "./flight.h"
+#define SOLITAIRE_BATCH_IMPLEMENTATION
+#include "./batch.h"
+#define SOLITAIRE_VERSIONS_IMPLEMENTATION
+#include "./versions.h"
 #include "./colors.h"
 
 bool running = true;
@@ -15,6 +61,14 @@ void quit() {
 	running = false;
 }
 
+// times one step of the game loop for the flight recorder, the counters of --profile, and for the perf histograms
+// in PERF=1 builds
+#define LOOP_TIME(perf_phase, flight_kind, profile_phase, code) do { \
+    uint64_t flight_start_ = flight_begin(flight_kind); \
+    PERF_TIME(perf_phase, PROFILE_TIME(profile_phase, code)); \
+    flight_end(flight_kind, flight_start_, 0, 0); \
+} while (0)
+
 #define repeat(x) for (int repeat_ = 0; repeat_ < x; ++repeat_)
 
 void render_dialog() {
@@ -34,10 +88,26 @@ void render_dialog() {
     attroff(COLOR_PAIR(COLOR_DIALOG));
 }
 
+// screen column of the stock: the right end of the tableau, or past the foundations and the waste if they are wider,
+// the last three waste cards go just left of it
+#define STOCK_X (TABLEAU_COLUMNS * 10 > FOUNDATION_PILES * 10 + 24 ? TABLEAU_COLUMNS * 10 : FOUNDATION_PILES * 10 + 24)
+#define WASTE_X (STOCK_X - 24)
+
+// the top row of piles, and one whole tableau card under it, the tableau scrolls to show the rest
+#define SCREEN_MIN_WIDTH (STOCK_X + 11)
+#define SCREEN_MIN_HEIGHT 19
+
 bool size_too_small() {
     int win_x, win_y;
     getmaxyx(stdscr, win_y, win_x);
-    return win_x < 84 || win_y < 45;
+    return win_x < SCREEN_MIN_WIDTH || win_y < SCREEN_MIN_HEIGHT;
+}
+
+// cards only draw on screen rows from clip_top down, so a scrolled tableau doesn't cover the top row
+int clip_top = 0;
+
+bool row_clipped(int y) {
+    return y < clip_top || y >= getmaxy(stdscr);
 }
 
 void render_size_dialog() {
@@ -96,6 +166,7 @@ void render_card_outline(Card card, int x, int y, bool is_selected, bool right_s
         // render highlighted/selected outline
         color = is_selected ? COLOR_SELECTED : card.highlight == SOURCE ? COLOR_SOURCE : COLOR_HIGHLIGHTED;
         for (int y_ = -1; y_ <= 8; ++y_) {
+            if (row_clipped(y + y_)) continue;
             attron(COLOR_PAIR(color));
             move(y + y_, x - 1);
             if (!right_side_only && (y_ == -1 || y_ == 8)) {
@@ -134,6 +205,7 @@ void render_card(Card card, CardPos pos, int x, int y, bool is_selected) {
     }
 
     for (int y_ = 0; y_ <= 7; ++y_) {
+        if (row_clipped(y + y_)) continue;
         attron(COLOR_PAIR(color));
         move(y + y_, x);
         if (none) {
@@ -170,117 +242,331 @@ void render_card(Card card, CardPos pos, int x, int y, bool is_selected) {
     char *rank_str = get_rank_str(card.rank);
     char *suite_str = get_suite_str(card.suite);
 
-    move(y + 1, x + 2);
-    attron(COLOR_PAIR(color));
-    printw("%s", rank_str);
-    attroff(COLOR_PAIR(color));
+    if (!row_clipped(y + 1)) {
+        move(y + 1, x + 2);
+        attron(COLOR_PAIR(color));
+        printw("%s", rank_str);
+        attroff(COLOR_PAIR(color));
 
-    move(y + 6, x + (strlen(rank_str) > 1 ? 5 : 6));
-    attron(COLOR_PAIR(color));
-    printw("%s", rank_str);
-    attroff(COLOR_PAIR(color));
+        move(y + 1, x + 6);
+        attron(COLOR_PAIR(color));
+        printw("%s", suite_str);
+        attroff(COLOR_PAIR(color));
+    }
 
-    move(y + 6, x + 2);
-    attron(COLOR_PAIR(color));
-    printw("%s", suite_str);
-    attroff(COLOR_PAIR(color));
+    if (!row_clipped(y + 6)) {
+        move(y + 6, x + (strlen(rank_str) > 1 ? 5 : 6));
+        attron(COLOR_PAIR(color));
+        printw("%s", rank_str);
+        attroff(COLOR_PAIR(color));
 
-    move(y + 1, x + 6);
-    attron(COLOR_PAIR(color));
-    printw("%s", suite_str);
-    attroff(COLOR_PAIR(color));
+        move(y + 6, x + 2);
+        attron(COLOR_PAIR(color));
+        printw("%s", suite_str);
+        attroff(COLOR_PAIR(color));
+    }
 }
 
 bool game_started = false;
 
-void render(Game *game) {
-    clear();
+// screen row of the first tableau card when nothing is scrolled
+#define TABLEAU_TOP 10
 
-    if (size_too_small()) {
-        render_size_dialog();
-        return;
+// the tableau view: how far it is scrolled down, and whether face down runs are squeezed to one row per card,
+// which happens whenever the tallest column wouldn't fit the terminal otherwise
+int tableau_scroll = 0;
+bool compact_stacks = false;
+CardPos followed = {0};
+
+int column_length(Game *game, int column) {
+    int length = 0;
+    while (length < COLUMN_SLOTS && game->tableau[column][length].rank != NO_RANK) ++length;
+    return length;
+}
+
+int card_step(Card card) {
+    // rows between a card and the one stacked on it
+    return compact_stacks && !card.visible ? 1 : 2;
+}
+
+int tableau_offset(Game *game, int column, int row) {
+    // rows from the top of the tableau to a card, before scrolling
+    int offset = 0;
+    for (int r = 0; r < row; ++r) offset += card_step(game->tableau[column][r]);
+    return offset;
+}
+
+int tableau_height(Game *game) {
+    // rows the tallest column needs, from the top of the tableau down to the outline of its last card
+    int height = 0;
+    for (int column = 0; column < TABLEAU_COLUMNS; ++column) {
+        int length = column_length(game, column);
+        int column_height = tableau_offset(game, column, length > 0 ? length - 1 : 0) + 9;
+        if (column_height > height) height = column_height;
     }
+    return height;
+}
 
-    game_started = true;
+bool update_viewport(Game *game) {
+    // picks the stacking mode and keeps the scroll inside the tableau, then brings a newly selected tableau card
+    // into view, true if any of that moved cards on screen
+    int view = getmaxy(stdscr) - TABLEAU_TOP, old_scroll = tableau_scroll;
+    bool old_compact = compact_stacks;
+    compact_stacks = false;
+    if (tableau_height(game) > view) compact_stacks = true;
+    int height = tableau_height(game);
+
+    CardPos selected = game->selected;
+    if (selected.location == TABLEAU && !is_same_pos(selected, followed)) {
+        int top = tableau_offset(game, selected.column, selected.row);
+        // a covered card only shows its top rows, the last card of a column shows all of it
+        bool covered = selected.row < COLUMN_SLOTS - 1 && game->tableau[selected.column][selected.row + 1].rank != NO_RANK;
+        int bottom = top + (covered ? 2 + card_step(game->tableau[selected.column][selected.row]) : 9);
+        if (bottom - tableau_scroll > view) tableau_scroll = bottom - view;
+        if (top - tableau_scroll < 0) tableau_scroll = top;
+    }
+    followed = selected;
 
-    Card *selected_card = NULL;
-    if (game->selected.active)
-        selected_card = get_card(game->selected, game, false);
-    int selected_x = 0, selected_y = 0, selected_y_off = 0;
-    bool is_selected;
+    if (tableau_scroll > height - view) tableau_scroll = height - view;
+    if (tableau_scroll < 0) tableau_scroll = 0;
+    return tableau_scroll != old_scroll || compact_stacks != old_compact;
+}
 
-    // render foundation cards
-    for (int x = 0; x < 4; ++x) {
-        int x_ = x * 10 + 1, y_ = 1;
-        if ((is_selected = (game->selected.location == FOUNDATION && game->selected.column == x))) {
-            selected_x = x_, selected_y = y_;
-        }
-        render_card(game->foundation[x], (CardPos) { true, FOUNDATION, x, 0 }, x_, y_, is_selected);
+void scroll_tableau(int rows) {
+    // by hand, update_viewport() keeps it in range
+    tableau_scroll += rows;
+}
+
+int render_order(int i) {
+    // the top row left to right, then the tableau so its outlines win where they touch
+    if (i < FOUNDATION_PILES) return PILE_FOUNDATION + i;
+    if (i == FOUNDATION_PILES) return PILE_WASTE;
+    if (i == FOUNDATION_PILES + 1) return PILE_STOCK;
+    return i - FOUNDATION_PILES - 2;
+}
+
+int pile_of(CardPos pos) {
+    // pile number (as in spectate.h) of a position
+    switch (pos.location) {
+        case TABLEAU:
+            return pos.column;
+        case WASTE:
+            return PILE_WASTE;
+        case STOCK:
+            return PILE_STOCK;
+        default:
+            return PILE_FOUNDATION + pos.column;
     }
+}
 
-    int i;
-    for (i = 0; i < 64; ++i) {
-        if (game->waste[i].rank == NO_RANK) {
-            break;
+void render_pile(Game *game, int pile) {
+    // draws one pile over whatever is on screen
+    bool is_selected;
+    if (pile >= PILE_FOUNDATION) {
+        // foundation card
+        int x = pile - PILE_FOUNDATION;
+        is_selected = game->selected.location == FOUNDATION && game->selected.column == x;
+        render_card(game->foundation[x], (CardPos) { true, FOUNDATION, x, 0 }, x * 10 + 1, 1, is_selected);
+    } else if (pile == PILE_WASTE) {
+        int i;
+        for (i = 0; i < PILE_SLOTS; ++i) {
+            if (game->waste[i].rank == NO_RANK) {
+                break;
+            }
         }
-    }
-    // render last 3 waste cards
-    for (int x = (i > 3 ? i - 3 : 0), j = 0; x < i; ++x, ++j) {
-        int x_ = j * 6 + 47, y_ = 1;
-        if ((is_selected = (game->selected.location == WASTE && x == i - 1))) {
-            selected_x = x_, selected_y = y_;
+        // last 3 waste cards
+        for (int x = (i > 3 ? i - 3 : 0), j = 0; x < i; ++x, ++j) {
+            is_selected = game->selected.location == WASTE && x == i - 1;
+            render_card(game->waste[x], (CardPos) {true, WASTE, 0, 0 }, j * 6 + WASTE_X + 1, 1, is_selected);
+        }
+    } else if (pile == PILE_STOCK) {
+        Card *card_ = get_stock_top(game, true);
+        if (card_) {
+            is_selected = game->selected.location == STOCK;
+            render_card(*card_, (CardPos) {true, STOCK, 0, 0 }, STOCK_X + 1, 1, is_selected);
         }
-        render_card(game->waste[x], (CardPos) {true, WASTE, 0, 0 }, x_, y_, is_selected);
+    } else {
+        // tableau column, only the cards (and the empty slot a king can go to) that reach into the view
+        int column = pile, length = column_length(game, column), bottom = getmaxy(stdscr);
+        clip_top = TABLEAU_TOP - 1;
+        for (int row = 0, y = TABLEAU_TOP - tableau_scroll; row <= length && row < COLUMN_SLOTS && y - 1 < bottom; y += card_step(game->tableau[column][row++])) {
+            if (y + 8 < clip_top) continue;
+            is_selected = game->selected.location == TABLEAU && game->selected.column == column && game->selected.row == row;
+            render_card(game->tableau[column][row], (CardPos) { true, TABLEAU, column, row }, column * 10 + 1, y, is_selected);
+        }
+        clip_top = 0;
     }
+}
 
-    // render stock card
-    is_selected = false;
-    Card *card_ = get_stock_top(game, true);
-    if (card_) {
-        Card card = *card_;
-        if ((is_selected = (game->selected.location == STOCK))) { selected_x = 71, selected_y = 1; }
-        render_card(card, (CardPos) {true, STOCK, 0, 0 }, 71, 1, is_selected);
+void pile_region(int pile, int *x, int *y, int *width, int *height) {
+    // the screen area a pile can draw on, outlines included
+    int win_x, win_y;
+    getmaxyx(stdscr, win_y, win_x);
+    (void) win_x;
+    if (pile >= PILE_FOUNDATION) {
+        *x = (pile - PILE_FOUNDATION) * 10, *y = 0, *width = 11, *height = 10;
+    } else if (pile == PILE_WASTE) {
+        *x = WASTE_X, *y = 0, *width = 23, *height = 10;
+    } else if (pile == PILE_STOCK) {
+        *x = STOCK_X, *y = 0, *width = 11, *height = 10;
+    } else {
+        *x = pile * 10, *y = 9, *width = 11, *height = win_y - 9;
     }
+}
 
-    // render tableau
-    for (int column = 0; column < 7; ++column) {
-        bool prev_selected = false;
-        for (int row = 0; row < 64; ++row) {
-            int x_ = column * 10 + 1, y_ = row * 2 + 10;
-            if ((is_selected = (game->selected.location == TABLEAU && game->selected.column == column && game->selected.row == row))) {
-                selected_y_off = 0, selected_x = x_, selected_y = y_;
-            } else if (row > 0 && game->tableau[column][row].rank != NO_RANK && prev_selected) {
-                // move cursor up a bit if there is a card in the way
-                selected_y_off = -2;
-            }
-            render_card(game->tableau[column][row], (CardPos) { true, TABLEAU, column, row }, x_, y_, is_selected);
-            prev_selected = is_selected;
+void clear_pile(int pile) {
+    int x, y, width, height;
+    pile_region(pile, &x, &y, &width, &height);
+    for (int y_ = y; y_ < y + height; ++y_) {
+        move(y_, x);
+        repeat(width) addch(' ');
+    }
+}
+
+bool piles_overlap(int a, int b) {
+    int ax, ay, aw, ah, bx, by, bw, bh;
+    pile_region(a, &ax, &ay, &aw, &ah);
+    pile_region(b, &bx, &by, &bw, &bh);
+    return ax < bx + bw && bx < ax + aw && ay < by + bh && by < ay + ah;
+}
+
+void render_cursor(Game *game) {
+    // redraws the right side of the selected outline, a highlight drawn after it may have covered it, and puts the cursor there
+    int selected_x = 0, selected_y = 0, selected_y_off = 0;
+    CardPos selected = game->selected;
+    if (selected.location == FOUNDATION) {
+        selected_x = selected.column * 10 + 1, selected_y = 1;
+    } else if (selected.location == WASTE) {
+        int i = 0;
+        while (i < PILE_SLOTS && game->waste[i].rank != NO_RANK) ++i;
+        if (i > 0) selected_x = ((i > 3 ? 3 : i) - 1) * 6 + WASTE_X + 1, selected_y = 1;
+    } else if (selected.location == STOCK) {
+        selected_x = STOCK_X + 1, selected_y = 1;
+    } else {
+        selected_x = selected.column * 10 + 1;
+        selected_y = TABLEAU_TOP - tableau_scroll + tableau_offset(game, selected.column, selected.row);
+        // move cursor up a bit if there is a card in the way
+        if (selected.row < COLUMN_SLOTS - 1 && game->tableau[selected.column][selected.row + 1].rank != NO_RANK) {
+            selected_y_off = card_step(game->tableau[selected.column][selected.row]) - 4;
         }
+        clip_top = TABLEAU_TOP - 1;
     }
 
+    Card *selected_card = NULL;
+    if (selected.active)
+        selected_card = get_card(selected, game, false);
     if (selected_card) {
         render_card_outline(*selected_card, selected_x, selected_y, true, true);
     }
+    clip_top = 0;
 
     move(selected_y + 3 + selected_y_off, selected_x + 4);
 }
 
+void render(Game *game) {
+    clear();
+
+    if (size_too_small()) {
+        render_size_dialog();
+        return;
+    }
+
+    game_started = true;
+
+    update_viewport(game);
+    for (int i = 0; i < PILES; ++i) render_pile(game, render_order(i));
+
+    render_cursor(game);
+}
+
+#ifdef SOLITAIRE_PERF
+bool perf_hud = false;
+
+void render_perf_hud() {
+    // p50/p99/max per phase in the top right corner
+    int win_x, win_y;
+    getmaxyx(stdscr, win_y, win_x);
+    (void) win_y;
+    int x = win_x - 42 > 0 ? win_x - 42 : 0;
+    attron(COLOR_PAIR(COLOR_DIALOG));
+    move(0, x);
+    printw("%-8s %9s %9s %9s ", "phase", "p50 us", "p99 us", "max us");
+    for (int phase = 0; phase < PERF_PHASES; ++phase) {
+        Histogram *histogram = &perf_stats.phases[phase];
+        move(phase + 1, x);
+        printw("%-8s %9.1f %9.1f %9.1f ", perf_phase_name(phase), histogram_quantile(histogram, 0.5) / 1e3,
+               histogram_quantile(histogram, 0.99) / 1e3, histogram->max / 1e3);
+    }
+    move(PERF_PHASES + 1, x);
+    printw("bytes %10lu last frame %10lu ", (unsigned long) perf_stats.bytes_written, (unsigned long) perf_stats.frame_bytes);
+    attroff(COLOR_PAIR(COLOR_DIALOG));
+}
+#endif
+
 Game *game_instance;
 
-int main() {
-    // allow unicode characters
-    setlocale(LC_ALL, "");
+DealIndex *deal_index = NULL;
+int min_difficulty = 0, max_difficulty = 100;
 
-    // create game instance
-    game_instance = create_game();
-    assert(game_instance);
+bool pick_indexed_seed(unsigned int *seed) {
+    static uint32_t counter = 0;
+    return deal_index_pick(deal_index, min_difficulty, max_difficulty, deal_random(time(NULL), counter++), seed);
+}
+
+void print_usage(FILE *file) {
+    fprintf(file, "Usage: %s [options]\n", EXEC);
+    fprintf(file, "  -s, --seed SEED          deal the game with this seed\n");
+    fprintf(file, "  -t, --tournament DEALS   play bot policies against each other over DEALS seeded deals\n");
+    fprintf(file, "  -p, --policies LIST      comma separated policies for --tournament (default: all)\n");
+    fprintf(file, "  -j, --threads COUNT      worker threads (default: all cores)\n");
+    fprintf(file, "  -B, --build-index FILE   solve --deals deals starting at --seed and write a deal index\n");
+    fprintf(file, "      --shard I/N          with --build-index, solve every Nth deal from the Ith into FILE, resuming an unfinished FILE\n");
+    fprintf(file, "      --merge-shards FILE SHARD...  merge the shard files of a --shard sweep into the deal index FILE\n");
+    fprintf(file, "  -n, --deals COUNT        number of deals for --build-index and --generate-deals (default: 10000)\n");
+    fprintf(file, "  -N, --node-limit COUNT   positions the solver may search per deal (default: 200000)\n");
+    fprintf(file, "  -C, --canonical          let the solver treat positions that only differ in column order or stock cycle as one\n");
+    fprintf(file, "      --cache FILE         solved positions to reuse and extend across solver runs\n");
+    fprintf(file, "      --cache-size MB      size of a new --cache file (default: 256)\n");
+    fprintf(file, "      --solver-bench       solve --deals deals from --seed with and without --canonical and compare\n");
+    fprintf(file, "      --batch-bench        random playouts of --deals deals from --seed on the batch engine and on single games\n");
+    fprintf(file, "      --versions-bench     grow what-if trees for --deals deals from --seed with persistent versions and with Game copies\n");
+    fprintf(file, "      --legal-bench        random playouts of --deals deals from --seed, finding the legal moves from scratch and incrementally\n");
+    fprintf(file, "      --optimal            find par (the fewest moves that win) for --deals deals from --seed\n");
+    fprintf(file, "      --par SECONDS        time allowed per deal for --optimal, and to add par to --build-index (default: off)\n");
+    fprintf(file, "  -G, --generate-deals FILE write --deals deals starting at --seed to FILE (- for stdout)\n");
+    fprintf(file, "      --deal-format FORMAT perm (%d bytes per deal, default) or packed (a PackedGame per deal)\n", DECK_CARDS);
+    fprintf(file, "      --estimate FILE      write a difficulty estimate byte (0 to 100) for --deals deals from --seed, without solving\n");
+    fprintf(file, "      --estimate-check     compare the estimates with the solver results in --index\n");
+    fprintf(file, "  -i, --index FILE         deal index to draw winnable deals from\n");
+    fprintf(file, "  -w, --winnable           only deal games that the deal index marks as winnable\n");
+    fprintf(file, "  -d, --difficulty MIN[-MAX] difficulty range for --winnable, 0 to 100\n");
+    fprintf(file, "  -S, --save FILE          where to keep the saved game (default: %s)\n", default_save_path() ? default_save_path() : "none");
+    fprintf(file, "      --no-save            don't save or resume the game\n");
+    fprintf(file, "      --serve              run many games over a line protocol on stdin/stdout (see serve.h)\n");
+    fprintf(file, "      --serve-socket PATH  the same protocol on a unix socket\n");
+    fprintf(file, "      --spectator-socket PATH  let --spectate clients follow this game on a unix socket\n");
+    fprintf(file, "      --spectate PATH      watch the game behind a --spectator-socket\n");
+    fprintf(file, "      --perf-log FILE      write keypress to frame timings to FILE on exit (PERF=1 builds)\n");
+    fprintf(file, "      --profile FILE       count cycles, instructions, cache and branch misses per game loop phase, written to FILE on exit\n");
+    fprintf(file, "      --profile-bench      the same for the engine phases of random playouts of --deals deals from --seed\n");
+    fprintf(file, "      --record FILE        append the game to a replay archive when it ends\n");
+    fprintf(file, "      --analyze FILE...    play replay archives back and print aggregate statistics\n");
+    fprintf(file, "      --analyze-format FORMAT csv (default) or json\n");
+    fprintf(file, "      --flight-log FILE    where the flight recorder dumps its recent events (default: %s)\n", default_flight_path() ? default_flight_path() : "none");
+    fprintf(file, "      --stall SECONDS      dump the flight recorder when one key takes longer than this, 0 for never (default: 2)\n");
+    fprintf(file, "      --flight-decode FILE print the dumps in a flight recorder file\n");
+    fprintf(file, "      --differential       play --deals random games from --seed on the engine and its reference copy and compare\n");
+    fprintf(file, "  -h, --help               show this help\n");
+    fprintf(file, "  -v, --version            show the version\n");
+}
 
+bool start_screen() {
 	initscr();
 
     if (!has_colors()) {
         printw("Color is not supported on this terminal.");
         endwin();
-        return 0;
+        return false;
     }
 
     start_color();
@@ -303,18 +589,1028 @@ int main() {
 	keypad(stdscr, TRUE);
 
 	refresh();
+    return true;
+}
+
+void stop_screen() {
+    noraw();
+    echo();
+    keypad(stdscr, false);
+
+	endwin();
+}
+
+bool same_pile(Game *a, Game *b, int pile) {
+    // would the pile look the same on screen, cards, highlights and selection included
+    Card *cards_a, *cards_b;
+    int count = COLUMN_SLOTS;
+    if (pile >= PILE_FOUNDATION) {
+        cards_a = &a->foundation[pile - PILE_FOUNDATION], cards_b = &b->foundation[pile - PILE_FOUNDATION], count = 1;
+    } else if (pile == PILE_WASTE) {
+        cards_a = a->waste, cards_b = b->waste, count = PILE_SLOTS;
+    } else if (pile == PILE_STOCK) {
+        cards_a = a->stock, cards_b = b->stock, count = PILE_SLOTS;
+    } else {
+        cards_a = a->tableau[pile], cards_b = b->tableau[pile];
+    }
+    for (int i = 0; i < count; ++i) {
+        if (cards_a[i].rank != cards_b[i].rank || cards_a[i].suite != cards_b[i].suite ||
+            cards_a[i].visible != cards_b[i].visible || cards_a[i].highlight != cards_b[i].highlight) return false;
+        // past the first empty slot is never drawn
+        if (cards_a[i].rank == NO_RANK) break;
+    }
+    bool selected_a = pile_of(a->selected) == pile, selected_b = pile_of(b->selected) == pile;
+    if (selected_a != selected_b) return false;
+    return !selected_a || (a->selected.row == b->selected.row && a->selected.active == b->selected.active);
+}
+
+int spectate_main(const char *path) {
+    // follows a game from its --spectator-socket, redrawing only the piles that changed
+    struct sockaddr_un address = {0};
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *) &address, sizeof(address)) != 0) {
+        perror(path);
+        if (fd >= 0) close(fd);
+        return 1;
+    }
+
+    SpectateState state = {0};
+    Game *game = create_game(), *shown = create_game();
+    assert(game && shown);
+    spectate_to_game(&state, game);
+
+    if (!start_screen()) return 0;
+    nodelay(stdscr, TRUE);
+
+    struct sigaction quit_action = {0};
+    quit_action.sa_handler = quit;
+    sigemptyset(&quit_action.sa_mask);
+    sigaction(SIGINT, &quit_action, NULL);
+    sigaction(SIGTERM, &quit_action, NULL);
+    sigaction(SIGHUP, &quit_action, NULL);
+
+    uint8_t buffer[4096];
+    size_t length = 0;
+    bool started = false, drawn = false;
+    while (running) {
+        struct pollfd fds[2] = {{STDIN_FILENO, POLLIN, 0}, {fd, POLLIN, 0}};
+        if (poll(fds, 2, -1) < 0) continue;
+
+        int key;
+        while ((key = getch()) != ERR) {
+            if (key == 'q' || key == 'Q' || key == '\x03') running = false;
+            if (key == KEY_RESIZE) drawn = false;
+        }
+        if (fds[1].revents) {
+            ssize_t got = read(fd, buffer + length, sizeof(buffer) - length);
+            if (got == 0 || (got < 0 && errno != EINTR)) break; // the game is over
+            if (got > 0) {
+                length += got;
+                bool reset = false;
+                size_t used = spectate_apply(&state, buffer, length, &reset);
+                memmove(buffer, buffer + used, length - used);
+                length -= used;
+                if (reset) started = true, drawn = false;
+                spectate_to_game(&state, game);
+                update_display(game);
+            }
+        }
+        if (!started) continue;
+
+        // a new stacking mode or scroll moves every column, not just the changed ones
+        if (!drawn || size_too_small() || update_viewport(game)) {
+            render(game);
+            drawn = true;
+        } else {
+            bool changed[PILES], dirty[PILES] = {false};
+            for (int pile = 0; pile < PILES; ++pile) changed[pile] = !same_pile(game, shown, pile);
+            for (int pile = 0; pile < PILES; ++pile) {
+                if (!changed[pile]) continue;
+                clear_pile(pile);
+                // neighbours share outline cells, so they get drawn again too
+                for (int other = 0; other < PILES; ++other) {
+                    if (piles_overlap(pile, other)) dirty[other] = true;
+                }
+            }
+            for (int i = 0; i < PILES; ++i) {
+                if (dirty[render_order(i)]) render_pile(game, render_order(i));
+            }
+            render_cursor(game);
+        }
+        *shown = *game;
+        refresh();
+    }
+
+    stop_screen();
+    close(fd);
+    free(game);
+    free(shown);
+    return 0;
+}
+
+int tournament_main(char *policy_list, unsigned int first_seed, long deals, int threads) {
+    const Policy *entries[sizeof(policies) / sizeof(policies[0]) * 4];
+    int count = 0;
+    if (!policy_list) {
+        for (int i = 0; i < policy_count; ++i) entries[count++] = &policies[i];
+    } else {
+        for (char *name = strtok(policy_list, ","); name; name = strtok(NULL, ",")) {
+            const Policy *policy = find_policy(name);
+            if (!policy) {
+                fprintf(stderr, "Unknown policy: %s\nPolicies:", name);
+                for (int i = 0; i < policy_count; ++i) fprintf(stderr, " %s", policies[i].name);
+                fprintf(stderr, "\n");
+                return 1;
+            }
+            if (count >= (int) (sizeof(entries) / sizeof(entries[0]))) break;
+            entries[count++] = policy;
+        }
+    }
+
+    PolicyResult results[sizeof(entries) / sizeof(entries[0])];
+    if (!run_tournament(entries, count, first_seed, deals, threads, results)) {
+        fprintf(stderr, "Failed to run tournament\n");
+        return 1;
+    }
+    print_tournament(results, count, deals, threads);
+    return 0;
+}
+
+int batch_bench_main(unsigned int first_seed, long deals) {
+    // random playouts on the batch engine and on one Game at a time, after checking the batch against apply_move()
+    char message[PLAY_CHECK_MESSAGE];
+    long steps;
+    if (!check_batch(first_seed, deals, &steps, message)) {
+        fprintf(stderr, "batch engine differs: %s\n", message);
+        return 1;
+    }
+    printf("%ld moves checked against apply_move()\n", steps);
+
+    BatchResult results[2];
+    if (!play_random_batch(first_seed, deals, &results[0])) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    play_random_single(first_seed, deals, &results[1]);
+    static const char *names[] = {"batch", "single"};
+    printf("%-8s %8s %8s %12s %9s %12s\n", "engine", "games", "wins", "moves", "seconds", "moves/s");
+    for (int i = 0; i < 2; ++i) {
+        BatchResult *result = &results[i];
+        printf("%-8s %8ld %8ld %12ld %9.3f %12.0f\n", names[i], result->games, result->wins, result->steps, result->seconds,
+               result->seconds > 0 ? result->steps / result->seconds : 0);
+    }
+    double batch_rate = results[0].seconds > 0 ? results[0].steps / results[0].seconds : 0;
+    double single_rate = results[1].seconds > 0 ? results[1].steps / results[1].seconds : 0;
+    if (single_rate > 0) printf("%d lanes, %.1fx the moves per second of single games\n", BATCH_LANES, batch_rate / single_rate);
+    return 0;
+}
+
+int versions_bench_main(unsigned int first_seed, long deals) {
+    // grows a what-if tree per deal with persistent versions and with a Game copy per node, after checking the two agree
+    char message[PLAY_CHECK_MESSAGE];
+    long nodes;
+    if (!check_versions(first_seed, deals, &nodes, message)) {
+        fprintf(stderr, "versions differ: %s\n", message);
+        return 1;
+    }
+    printf("%ld positions checked against apply_move()\n", nodes);
+
+    ExploreResult results[2];
+    if (!explore_versions(first_seed, deals, &results[0]) || !explore_copies(first_seed, deals, &results[1])) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    static const char *names[] = {"versions", "copies"};
+    printf("%-8s %8s %10s %9s %12s %12s %10s\n", "kept as", "trees", "positions", "seconds", "positions/s", "bytes/tree", "bytes/pos");
+    for (int i = 0; i < 2; ++i) {
+        ExploreResult *result = &results[i];
+        printf("%-8s %8ld %10ld %9.3f %12.0f %12lu %10.1f\n", names[i], result->trees, result->nodes, result->seconds,
+               result->seconds > 0 ? result->nodes / result->seconds : 0, (unsigned long) result->peak_bytes,
+               (double) result->peak_bytes / VERSION_TREE_NODES);
+    }
+    printf("%d positions per tree, versions take %.1fx less memory\n", VERSION_TREE_NODES,
+           results[0].peak_bytes ? (double) results[1].peak_bytes / results[0].peak_bytes : 0);
+    return 0;
+}
+
+void play_random_legal(unsigned int first_seed, long deals, bool check, BatchResult *result) {
+    // play_random_single() with the legal moves kept in a LegalSet, compared with get_legal_moves() after every move
+    // when check is set
+    *result = (BatchResult) {0};
+    Game game;
+    LegalSet legal;
+    Move moves[MAX_LEGAL_MOVES];
+    char message[PLAY_CHECK_MESSAGE];
+    double start = monotonic_seconds();
+    for (long deal = 0; deal < deals; ++deal) {
+        unsigned int seed = first_seed + (unsigned int) deal;
+        deal_game(&game, seed);
+        rebuild_legal_set(&legal, &game);
+        uint64_t rng = deal_random(seed, 0x80000000u) | 1;
+        for (int step = 0; step < POLICY_MAX_MOVES && !is_game_won(&game); ++step) {
+            if (check && !check_legal_set(&legal, &game, message)) {
+                fprintf(stderr, "seed %u move %d: %s\n", seed, step, message);
+                result->games = -1;
+                return;
+            }
+            int count = legal_set_moves(&legal, moves);
+            if (count < 1) break;
+            legal_set_apply(&legal, &game, moves[(policy_random(&rng) >> 32) * count >> 32]);
+            ++result->steps;
+        }
+        ++result->games;
+        result->wins += is_game_won(&game);
+    }
+    result->seconds = monotonic_seconds() - start;
+}
+
+int legal_bench_main(unsigned int first_seed, long deals) {
+    // the same random playouts with the legal moves found from scratch and kept up to date
+    BatchResult results[2];
+    play_random_legal(first_seed, deals, true, &results[1]);
+    if (results[1].games < 0) return 1;
+    printf("%ld moves checked against get_legal_moves()\n", results[1].steps);
+
+    play_random_single(first_seed, deals, &results[0]);
+    play_random_legal(first_seed, deals, false, &results[1]);
+    if (results[0].steps != results[1].steps || results[0].wins != results[1].wins) {
+        fprintf(stderr, "the playouts went differently: %ld and %ld moves\n", results[0].steps, results[1].steps);
+        return 1;
+    }
+    static const char *names[] = {"full", "incremental"};
+    printf("%-12s %8s %8s %12s %9s %12s\n", "legal moves", "games", "wins", "moves", "seconds", "moves/s");
+    for (int i = 0; i < 2; ++i) {
+        BatchResult *result = &results[i];
+        printf("%-12s %8ld %8ld %12ld %9.3f %12.0f\n", names[i], result->games, result->wins, result->steps, result->seconds,
+               result->seconds > 0 ? result->steps / result->seconds : 0);
+    }
+    if (results[0].seconds > 0 && results[1].seconds > 0) printf("incremental is %.1fx the moves per second\n", results[0].seconds / results[1].seconds);
+    return 0;
+}
+
+int profile_bench_main(unsigned int first_seed, long deals) {
+    // the engine phases of random playouts under the counters, what the game loop adds on top needs --profile
+    start_profiler(); // print_profile() says which counters there are
+    Game game;
+    Move moves[MAX_LEGAL_MOVES];
+    volatile long found = 0;
+    for (long deal = 0; deal < deals; ++deal) {
+        unsigned int seed = first_seed + (unsigned int) deal;
+        deal_game(&game, seed);
+        uint64_t rng = deal_random(seed, 0x80000000u) | 1;
+        for (int step = 0; step < POLICY_MAX_MOVES && !is_game_won(&game); ++step) {
+            int count;
+            PROFILE_TIME(PROFILE_LEGAL_MOVES, count = get_legal_moves(&game, moves));
+            if (count < 1) break;
+            Move move = moves[(policy_random(&rng) >> 32) * count >> 32];
+
+            // picking a card up highlights where it can go, like the cursor does
+            Card *card = move.from.location != STOCK ? get_card(move.from, &game, false) : NULL;
+            if (card) PROFILE_TIME(PROFILE_HIGHLIGHT, highlight_stackable(card, move.from.location, &game, NULL));
+            PROFILE_TIME(PROFILE_APPLY_MOVE, apply_move(&game, move));
+            PROFILE_TIME(PROFILE_DISPLAY, update_display(&game));
+
+            // a single get_card() is over long before a counter read, so it is sampled over every tableau slot
+            ProfileSample start;
+            profile_begin(&start);
+            for (int column = 0; column < TABLEAU_COLUMNS; ++column) {
+                for (int row = 0; row < COLUMN_SLOTS; ++row) found += get_card((CardPos) {true, TABLEAU, column, row}, &game, false) != NULL;
+            }
+            profile_end(PROFILE_GET_CARD, &start, TABLEAU_COLUMNS * COLUMN_SLOTS);
+        }
+    }
+    print_profile(stdout);
+    stop_profiler();
+    return 0;
+}
+
+int solver_bench_main(unsigned int first_seed, long deals, long node_limit, PositionCache *cache) {
+    // positions searched per deal, keyed on the plain and on the canonical position
+    Solver *solvers[2] = {create_solver((SolverOptions) {node_limit, false, cache}), create_solver((SolverOptions) {node_limit, true, cache})};
+    Game *game = malloc(sizeof(Game));
+    SolveResult *result = malloc(sizeof(SolveResult));
+    if (!solvers[0] || !solvers[1] || !game || !result) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    long counts[2][3] = {{0}}, nodes[2] = {0}, decided_nodes[2] = {0}, decided_states[2] = {0}, decided = 0;
+    long lookups[2] = {0}, hits[2] = {0};
+    double seconds[2] = {0};
+    for (long deal = 0; deal < deals; ++deal) {
+        SolveStatus status[2];
+        long deal_nodes[2], deal_states[2];
+        for (int mode = 0; mode < 2; ++mode) {
+            deal_game(game, first_seed + (unsigned int) deal);
+            double start = monotonic_seconds();
+            status[mode] = solve_game(solvers[mode], game, result);
+            seconds[mode] += monotonic_seconds() - start;
+            deal_nodes[mode] = result->nodes;
+            deal_states[mode] = result->states;
+            lookups[mode] += result->cache_lookups;
+            hits[mode] += result->cache_hits;
+            nodes[mode] += result->nodes;
+            ++counts[mode][status[mode]];
+        }
+        // deals both searches finished on compare like for like, the rest stop at the node limit either way
+        if (status[0] != SOLVE_GAVE_UP && status[1] != SOLVE_GAVE_UP) {
+            ++decided;
+            for (int mode = 0; mode < 2; ++mode) {
+                decided_nodes[mode] += deal_nodes[mode];
+                decided_states[mode] += deal_states[mode];
+            }
+        }
+    }
+
+    // distinct states are what the visited table holds, nodes also count the walks through the stock cycle
+    printf("%-10s %6s %6s %8s %12s %14s %14s %9s\n", "key", "won", "lost", "gave up", "nodes", "decided nodes", "decided states", "seconds");
+    for (int mode = 0; mode < 2; ++mode) {
+        printf("%-10s %6ld %6ld %8ld %12ld %14ld %14ld %9.2f\n", mode ? "canonical" : "plain", counts[mode][SOLVE_WON],
+               counts[mode][SOLVE_LOST], counts[mode][SOLVE_GAVE_UP], nodes[mode], decided_nodes[mode], decided_states[mode], seconds[mode]);
+    }
+    printf("%ld deals decided by both, canonical keys store %.1f%% fewer distinct states and expand %.1f%% fewer nodes on those\n",
+           decided, decided_states[0] ? 100.0 * (decided_states[0] - decided_states[1]) / decided_states[0] : 0.0,
+           decided_nodes[0] ? 100.0 * (decided_nodes[0] - decided_nodes[1]) / decided_nodes[0] : 0.0);
+    for (int mode = 0; cache && mode < 2; ++mode) {
+        printf("%s position cache: %ld lookups, %ld hits (%.1f%%)\n", mode ? "canonical" : "plain", lookups[mode], hits[mode],
+               lookups[mode] ? 100.0 * hits[mode] / lookups[mode] : 0.0);
+    }
+
+    free_solver(solvers[0]);
+    free_solver(solvers[1]);
+    free(game);
+    free(result);
+    return 0;
+}
+
+int optimal_main(unsigned int first_seed, long deals, long node_limit, double seconds) {
+    // solve_game() first, its solution is the upper bound, then the shortest one
+    Solver *solver = create_solver((SolverOptions) {node_limit, false, NULL});
+    OptimalSolver *optimal = create_optimal_solver((OptimalOptions) {seconds, 256});
+    Game *game = malloc(sizeof(Game));
+    SolveResult *result = malloc(sizeof(SolveResult));
+    OptimalResult *par = malloc(sizeof(OptimalResult));
+    if (!solver || !optimal || !game || !result || !par) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    static const char *statuses[] = {"par", "lost", "timed out"};
+    long found = 0, shorter = 0;
+    printf("%10s %8s %6s %6s %10s %12s %9s\n", "seed", "solution", "par", "bound", "status", "nodes", "seconds");
+    for (long deal = 0; deal < deals; ++deal) {
+        unsigned int seed = first_seed + (unsigned int) deal;
+        deal_game(game, seed);
+        int upper = solve_game(solver, game, result) == SOLVE_WON ? result->length : 0;
+        OptimalStatus status = solve_optimal(optimal, game, upper, par);
+        char length[16] = "-", best[16] = "-";
+        if (upper) snprintf(length, sizeof(length), "%d", upper);
+        if (status == OPTIMAL_FOUND) {
+            snprintf(best, sizeof(best), "%d", par->length);
+            ++found;
+            if (par->length < upper) ++shorter;
+        }
+        printf("%10u %8s %6s %6d %10s %12ld %9.2f\n", seed, length, best, par->bound, statuses[status], par->nodes, par->seconds);
+        if (deals == 1 && par->searched) {
+            char text[16];
+            for (int i = 0; i < par->length; ++i) printf("%s%s", i ? " " : "", format_move(par->moves[i], text));
+            printf("\n");
+        }
+    }
+    printf("par found for %ld of %ld deals, shorter than the first solution found for %ld\n", found, deals, shorter);
+
+    free_solver(solver);
+    free_optimal_solver(optimal);
+    free(game);
+    free(result);
+    free(par);
+    return 0;
+}
+
+int estimate_main(const char *path, unsigned int first_seed, long deals, int threads) {
+    int fd = strcmp(path, "-") == 0 ? STDOUT_FILENO : open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    long batch = (long) DEALS_BATCH * threads;
+    uint8_t *buffer = malloc(batch * DECK_CARDS), *estimates = malloc(batch);
+    if (fd < 0 || !buffer || !estimates) {
+        perror(path);
+        return 1;
+    }
+
+    long counts[10] = {0};
+    double generating = 0, estimating = 0;
+    bool ok = true;
+    for (long done = 0; ok && done < deals; done += batch) {
+        long n = deals - done < batch ? deals - done : batch;
+        double start = monotonic_seconds();
+        generate_deals(first_seed + (unsigned int) done, n, DEALS_PERMUTATION, threads, buffer);
+        double generated = monotonic_seconds();
+        estimate_deals(buffer, n, threads, estimates);
+        generating += generated - start;
+        estimating += monotonic_seconds() - generated;
+        for (long i = 0; i < n; ++i) ++counts[estimates[i] < 100 ? estimates[i] / 10 : 9];
+        for (long written = 0; ok && written < n;) {
+            ssize_t result = write(fd, estimates + written, n - written);
+            if (result < 0 && errno == EINTR) continue;
+            ok = result > 0;
+            if (ok) written += result;
+        }
+    }
+    free(buffer);
+    free(estimates);
+    if (fd != STDOUT_FILENO && close(fd) != 0) ok = false;
+    if (!ok) {
+        perror(path);
+        return 1;
+    }
+
+    fprintf(stderr, "%ld deals, dealt at %.1f M deals/s, estimated at %.1f M deals/s\n", deals,
+            generating > 0 ? deals / generating / 1e6 : 0, estimating > 0 ? deals / estimating / 1e6 : 0);
+    for (int bucket = 0; bucket < 10; ++bucket) {
+        fprintf(stderr, "%3d-%-3d %10ld %5.1f%%\n", bucket * 10, bucket == 9 ? 100 : bucket * 10 + 9, counts[bucket],
+                100.0 * counts[bucket] / deals);
+    }
+    return 0;
+}
+
+int estimate_check_main(DealIndex *index) {
+    // how well the estimate ranks the deals the solver didn't win, per estimate and as a whole
+    long deals[101] = {0}, lost[101] = {0};
+    uint8_t deal[DECK_CARDS];
+    for (uint64_t i = 0; i < index->header->count; ++i) {
+        DealIndexRecord *record = &index->records[i];
+        DealFeatures features;
+        deal_permutation(record->seed, deal);
+        deal_features(deal, &features);
+        int estimate = estimate_difficulty(&features);
+        ++deals[estimate];
+        if (!(record->flags & INDEX_WINNABLE)) ++lost[estimate];
+    }
+
+    printf("%-8s %8s %8s %10s\n", "estimate", "deals", "not won", "not won %");
+    long total_lost = 0;
+    for (int bucket = 0; bucket < 10; ++bucket) {
+        long bucket_deals = 0, bucket_lost = 0;
+        for (int e = bucket * 10; e < (bucket == 9 ? 101 : bucket * 10 + 10); ++e) bucket_deals += deals[e], bucket_lost += lost[e];
+        total_lost += bucket_lost;
+        if (bucket_deals) printf("%3d-%-4d %8ld %8ld %9.1f%%\n", bucket * 10, bucket == 9 ? 100 : bucket * 10 + 9, bucket_deals, bucket_lost,
+                                 100.0 * bucket_lost / bucket_deals);
+    }
+
+    // area under the ROC curve: the chance a deal the solver didn't win gets a higher estimate than one it won, ties count half
+    double pairs = 0, mean = 0;
+    long won_below = 0, total = (long) index->header->count;
+    for (int e = 0; e <= 100; ++e) {
+        long won = deals[e] - lost[e];
+        pairs += lost[e] * (won_below + won / 2.0);
+        won_below += won;
+        mean += (double) e * deals[e];
+    }
+    long total_won = total - total_lost;
+    printf("%ld deals, %ld not won (%.1f%%), mean estimate %.1f, AUC %.3f\n", total, total_lost, total ? 100.0 * total_lost / total : 0.0,
+           total ? mean / total : 0.0, total_lost && total_won ? pairs / ((double) total_lost * total_won) : 0.5);
+    return 0;
+}
+
+int analyze_main(char **paths, int count, int threads, bool json) {
+    if (count < 1) {
+        fprintf(stderr, "--analyze needs replay archives to read\n");
+        return 1;
+    }
+    ReplayStats *stats = calloc(1, sizeof(ReplayStats));
+    if (!stats) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    double start = monotonic_seconds();
+    bool ok = true;
+    for (int i = 0; ok && i < count; ++i) {
+        ok = analyze_replays(paths[i], threads, stats);
+        if (!ok) perror(paths[i]);
+    }
+    double seconds = monotonic_seconds() - start;
+    print_replay_stats(stdout, stats, json);
+    uint64_t actions = 0;
+    for (int i = 0; i < REPLAY_ACTIONS; ++i) actions += stats->actions[i];
+    fprintf(stderr, "%lu games, %lu actions, %.1f MB in %.2f s (%.1f MB/s, %.1f M actions/s)\n", (unsigned long) stats->games,
+            (unsigned long) actions, stats->bytes / 1e6, seconds, seconds > 0 ? stats->bytes / seconds / 1e6 : 0,
+            seconds > 0 ? actions / seconds / 1e6 : 0);
+    free(stats);
+    return ok ? 0 : 1;
+}
+
+int merge_shards_main(const char *path, char **shard_paths, int count) {
+    char message[256];
+    double start = monotonic_seconds();
+    if (!merge_deal_shards(path, shard_paths, count, message)) {
+        fprintf(stderr, "%s\n", message);
+        return 1;
+    }
+    DealIndex *index = open_deal_index(path);
+    if (!index) {
+        perror(path);
+        return 1;
+    }
+    printf("%d shards merged, %lu deals, %lu winnable, %.2f s\n", count, (unsigned long) index->header->count,
+           (unsigned long) index->header->winnable, monotonic_seconds() - start);
+    close_deal_index(index);
+    return 0;
+}
+
+int differential_main(unsigned int first_seed, long games, int threads) {
+    if (threads < 1) threads = 1;
+    DiffResult result;
+    double start = monotonic_seconds();
+    bool same = run_differential(first_seed, games, threads, &result);
+    double seconds = monotonic_seconds() - start;
+    double rate = seconds > 0 ? result.steps / seconds / 1e6 : 0;
+    fprintf(stderr, "%lu games, %lu steps in %.2f s on %d threads (%.2f M steps/s, %.2f M per thread)\n",
+            (unsigned long) result.games, (unsigned long) result.steps, seconds, threads, rate, rate / threads);
+    if (same) {
+        printf("no differences\n");
+        return 0;
+    }
+    print_diff_trace(stdout, &result);
+    free(result.trace);
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    // allow unicode characters
+    setlocale(LC_ALL, "");
+
+    bool has_seed = false;
+    unsigned int seed = 0;
+    long tournament_deals = 0;
+    char *policy_list = NULL;
+    char *build_index_path = NULL;
+    char *merge_shards_path = NULL;
+    int shard = 0, shards = 0;
+    char *index_path = NULL;
+    char *generate_path = NULL;
+    char *estimate_path = NULL;
+    bool estimate_check = false;
+    DealFormat deal_format = DEALS_PERMUTATION;
+    long deals = 10000, node_limit = 200000;
+    bool canonical = false, solver_bench = false, batch_bench = false, versions_bench = false, legal_bench = false, profile_bench = false;
+    char *cache_path = NULL;
+    long cache_size = 256;
+    bool winnable_only = false;
+    char *save_path = default_save_path();
+    bool serve = false;
+    char *serve_socket_path = NULL;
+    char *spectator_socket_path = NULL;
+    char *spectate_path = NULL;
+    char *record_path = NULL;
+    bool analyze = false, analyze_json = false;
+    bool differential = false;
+    bool optimal = false;
+    double par_seconds = 0;
+    char *flight_path = default_flight_path();
+    double stall_seconds = 2;
+    char *flight_decode_path = NULL;
+    char *profile_path = NULL;
+#ifdef SOLITAIRE_PERF
+    char *perf_log_path = NULL;
+#endif
+    int threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads < 1) threads = 1;
+
+    struct option options[] = {
+            {"seed",       required_argument, NULL, 's'},
+            {"tournament", required_argument, NULL, 't'},
+            {"policies",   required_argument, NULL, 'p'},
+            {"threads",    required_argument, NULL, 'j'},
+            {"build-index", required_argument, NULL, 'B'},
+            {"deals",      required_argument, NULL, 'n'},
+            {"node-limit", required_argument, NULL, 'N'},
+            {"canonical",  no_argument,       NULL, 'C'},
+            {"solver-bench", no_argument,     NULL, 'Q'},
+            {"batch-bench", no_argument,      NULL, 'b'},
+            {"versions-bench", no_argument,   NULL, 'u'},
+            {"legal-bench", no_argument,      NULL, 'l'},
+            {"profile",    required_argument, NULL, 'e'},
+            {"profile-bench", no_argument,    NULL, 'o'},
+            {"shard",      required_argument, NULL, 'x'},
+            {"merge-shards", required_argument, NULL, 'm'},
+            {"cache",      required_argument, NULL, 'K'},
+            {"cache-size", required_argument, NULL, 'Z'},
+            {"optimal",    no_argument,       NULL, 'W'},
+            {"par",        required_argument, NULL, 'H'},
+            {"generate-deals", required_argument, NULL, 'G'},
+            {"deal-format", required_argument, NULL, 'F'},
+            {"estimate",   required_argument, NULL, 'E'},
+            {"estimate-check", no_argument,   NULL, 'Y'},
+            {"index",      required_argument, NULL, 'i'},
+            {"winnable",   no_argument,       NULL, 'w'},
+            {"difficulty", required_argument, NULL, 'd'},
+            {"save",       required_argument, NULL, 'S'},
+            {"no-save",    no_argument,       NULL, 'X'},
+            {"perf-log",   required_argument, NULL, 'P'},
+            {"serve",      no_argument,       NULL, 'R'},
+            {"serve-socket", required_argument, NULL, 'U'},
+            {"spectator-socket", required_argument, NULL, 'L'},
+            {"spectate",   required_argument, NULL, 'V'},
+            {"record",     required_argument, NULL, 'O'},
+            {"analyze",    no_argument,       NULL, 'A'},
+            {"analyze-format", required_argument, NULL, 'J'},
+            {"differential", no_argument,     NULL, 'D'},
+            {"flight-log", required_argument, NULL, 'f'},
+            {"stall",      required_argument, NULL, 'k'},
+            {"flight-decode", required_argument, NULL, 'g'},
+            {"help",       no_argument,       NULL, 'h'},
+            {"version",    no_argument,       NULL, 'v'},
+            {NULL, 0,                         NULL, 0}
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "s:t:p:j:B:n:N:CG:i:wd:S:hv", options, NULL)) != -1) {
+        switch (opt) {
+            case 's':
+                has_seed = true;
+                seed = (unsigned int) strtoul(optarg, NULL, 0);
+                break;
+            case 't':
+                tournament_deals = strtol(optarg, NULL, 0);
+                if (tournament_deals < 1) {
+                    fprintf(stderr, "Invalid deal count: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'p':
+                policy_list = optarg;
+                break;
+            case 'j':
+                threads = atoi(optarg);
+                if (threads < 1) {
+                    fprintf(stderr, "Invalid thread count: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'B':
+                build_index_path = optarg;
+                break;
+            case 'n':
+                deals = strtol(optarg, NULL, 0);
+                if (deals < 1) {
+                    fprintf(stderr, "Invalid deal count: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'N':
+                node_limit = strtol(optarg, NULL, 0);
+                if (node_limit < 1) {
+                    fprintf(stderr, "Invalid node limit: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'C':
+                canonical = true;
+                break;
+            case 'Q':
+                solver_bench = true;
+                break;
+            case 'b':
+                batch_bench = true;
+                break;
+            case 'u':
+                versions_bench = true;
+                break;
+            case 'l':
+                legal_bench = true;
+                break;
+            case 'e':
+                profile_path = optarg;
+                break;
+            case 'o':
+                profile_bench = true;
+                break;
+            case 'x': {
+                char *end;
+                shard = (int) strtol(optarg, &end, 10);
+                shards = *end == '/' ? (int) strtol(end + 1, &end, 10) : 0;
+                if (*end || shards < 1 || shard < 0 || shard >= shards) {
+                    fprintf(stderr, "Invalid shard (want I/N with 0 <= I < N): %s\n", optarg);
+                    return 1;
+                }
+                break;
+            }
+            case 'm':
+                merge_shards_path = optarg;
+                break;
+            case 'K':
+                cache_path = optarg;
+                break;
+            case 'Z':
+                cache_size = strtol(optarg, NULL, 0);
+                if (cache_size < 1) {
+                    fprintf(stderr, "Invalid cache size: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'W':
+                optimal = true;
+                break;
+            case 'H':
+                par_seconds = strtod(optarg, NULL);
+                if (par_seconds <= 0) {
+                    fprintf(stderr, "Invalid time limit: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'G':
+                generate_path = optarg;
+                break;
+            case 'F':
+                if (strcmp(optarg, "perm") == 0) {
+                    deal_format = DEALS_PERMUTATION;
+                } else if (strcmp(optarg, "packed") == 0) {
+                    deal_format = DEALS_PACKED;
+                } else {
+                    fprintf(stderr, "Unknown deal format: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'E':
+                estimate_path = optarg;
+                break;
+            case 'Y':
+                estimate_check = true;
+                break;
+            case 'i':
+                index_path = optarg;
+                break;
+            case 'w':
+                winnable_only = true;
+                break;
+            case 'd': {
+                char *end;
+                min_difficulty = max_difficulty = (int) strtol(optarg, &end, 10);
+                if (*end == '-') max_difficulty = (int) strtol(end + 1, &end, 10);
+                if (*end || min_difficulty < 0 || max_difficulty > 100 || min_difficulty > max_difficulty) {
+                    fprintf(stderr, "Invalid difficulty: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            }
+            case 'S':
+                save_path = optarg;
+                break;
+            case 'X':
+                save_path = NULL;
+                break;
+            case 'R':
+                serve = true;
+                break;
+            case 'U':
+                serve_socket_path = optarg;
+                break;
+            case 'L':
+                spectator_socket_path = optarg;
+                break;
+            case 'V':
+                spectate_path = optarg;
+                break;
+            case 'O':
+                record_path = optarg;
+                break;
+            case 'A':
+                analyze = true;
+                break;
+            case 'J':
+                if (strcmp(optarg, "csv") == 0) {
+                    analyze_json = false;
+                } else if (strcmp(optarg, "json") == 0) {
+                    analyze_json = true;
+                } else {
+                    fprintf(stderr, "Unknown analyze format: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'D':
+                differential = true;
+                break;
+            case 'f':
+                flight_path = optarg;
+                break;
+            case 'k': {
+                char *end;
+                stall_seconds = strtod(optarg, &end);
+                if (*end || stall_seconds < 0) {
+                    fprintf(stderr, "Invalid stall threshold: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            }
+            case 'g':
+                flight_decode_path = optarg;
+                break;
+            case 'P':
+#ifdef SOLITAIRE_PERF
+                perf_log_path = optarg;
+                break;
+#else
+                fprintf(stderr, "--perf-log needs a build with PERF=1\n");
+                return 1;
+#endif
+            case 'h':
+                print_usage(stdout);
+                return 0;
+            case 'v':
+                printf("%s %s\n", EXEC, VERSION);
+                return 0;
+            default:
+                print_usage(stderr);
+                return 1;
+        }
+    }
+
+    if (flight_decode_path) {
+        if (!decode_flight(flight_decode_path, stdout)) {
+            perror(flight_decode_path);
+            return 1;
+        }
+        return 0;
+    }
+    if (differential) return differential_main(has_seed ? seed : 0, deals, threads);
+    if (analyze) return analyze_main(argv + optind, argc - optind, threads, analyze_json);
+    if (merge_shards_path) return merge_shards_main(merge_shards_path, argv + optind, argc - optind);
+
+    if (tournament_deals > 0) {
+        return tournament_main(policy_list, has_seed ? seed : (unsigned int) time(NULL), tournament_deals, threads);
+    }
+
+    if (serve_socket_path) {
+        struct sigaction quit_action = {0};
+        quit_action.sa_handler = quit;
+        sigaction(SIGINT, &quit_action, NULL);
+        sigaction(SIGTERM, &quit_action, NULL);
+        signal(SIGPIPE, SIG_IGN);
+        if (!serve_socket(serve_socket_path, &running)) {
+            perror(serve_socket_path);
+            return 1;
+        }
+        return 0;
+    }
+    if (serve) return serve_stream(STDIN_FILENO, STDOUT_FILENO) ? 0 : 1;
+    if (spectate_path) return spectate_main(spectate_path);
+
+    if (shards > 0 && !build_index_path) {
+        fprintf(stderr, "--shard needs a shard file to write (--build-index)\n");
+        return 1;
+    }
+
+    PositionCache *cache = NULL;
+    if (cache_path && (solver_bench || build_index_path)) {
+        cache = open_position_cache(cache_path, cache_size);
+        if (!cache) {
+            perror(cache_path);
+            return 1;
+        }
+    }
+    if (solver_bench) {
+        int status = solver_bench_main(has_seed ? seed : 0, deals, node_limit, cache);
+        close_position_cache(cache);
+        return status;
+    }
+
+    if (batch_bench) return batch_bench_main(has_seed ? seed : 0, deals);
+    if (versions_bench) return versions_bench_main(has_seed ? seed : 0, deals);
+    if (legal_bench) return legal_bench_main(has_seed ? seed : 0, deals);
+    if (profile_bench) return profile_bench_main(has_seed ? seed : 0, deals);
+
+    if (optimal) return optimal_main(has_seed ? seed : 0, deals, node_limit, par_seconds > 0 ? par_seconds : 10);
+
+    if (generate_path) {
+        double start = monotonic_seconds();
+        if (!write_deals(generate_path, has_seed ? seed : 0, deals, deal_format, threads)) {
+            perror(generate_path);
+            return 1;
+        }
+        double seconds = monotonic_seconds() - start;
+        fprintf(stderr, "%ld deals in %.3f s (%.1f M deals/s)\n", deals, seconds, seconds > 0 ? deals / seconds / 1e6 : 0);
+        return 0;
+    }
 
-    // set up signal handlers
-	signal(SIGINT, quit);
-	signal(SIGTERM, quit);
-	signal(SIGQUIT, quit);
-	signal(SIGHUP, quit);
-	signal(SIGPIPE, quit);
-	signal(SIGUSR1, quit);
-	signal(SIGUSR2, quit);
+    if (estimate_path) return estimate_main(estimate_path, has_seed ? seed : 0, deals, threads);
+
+    if (build_index_path && shards > 0) {
+        long resumed = 0;
+        double start = monotonic_seconds();
+        bool built = build_deal_shard(build_index_path, has_seed ? seed : 0, deals, shard, shards, threads,
+                                      (SolverOptions) {node_limit, canonical, cache}, par_seconds, &resumed);
+        close_position_cache(cache);
+        if (!built) {
+            perror(build_index_path);
+            return 1;
+        }
+        printf("shard %d/%d done, %ld deals were already solved, %.1f s\n", shard, shards, resumed, monotonic_seconds() - start);
+        return 0;
+    }
+    if (build_index_path) {
+        bool built = build_deal_index(build_index_path, has_seed ? seed : 0, deals, threads, (SolverOptions) {node_limit, canonical, cache}, par_seconds);
+        close_position_cache(cache);
+        if (!built) {
+            perror(build_index_path);
+            return 1;
+        }
+        DealIndex *index = open_deal_index(build_index_path);
+        if (!index) {
+            perror(build_index_path);
+            return 1;
+        }
+        printf("%lu deals, %lu winnable\n", (unsigned long) index->header->count, (unsigned long) index->header->winnable);
+        if (par_seconds > 0) {
+            unsigned long exact = 0;
+            for (uint64_t i = 0; i < index->header->count; ++i) exact += (index->records[i].flags & INDEX_PAR) != 0;
+            printf("par proven for %lu, the others have a lower bound\n", exact);
+        }
+        close_deal_index(index);
+        return 0;
+    }
+
+    if (index_path) {
+        deal_index = open_deal_index(index_path);
+        if (!deal_index) {
+            perror(index_path);
+            return 1;
+        }
+        if (estimate_check) return estimate_check_main(deal_index);
+        winnable_seed_picker = pick_indexed_seed;
+    } else if (estimate_check) {
+        fprintf(stderr, "--estimate-check needs a deal index (--index)\n");
+        return 1;
+    } else if (winnable_only) {
+        fprintf(stderr, "--winnable needs a deal index (--index)\n");
+        return 1;
+    }
+
+    // create game instance
+    game_instance = create_game();
+    assert(game_instance);
+    if (has_seed) {
+        deal_game(game_instance, seed);
+    } else if (winnable_only && !reset_game(game_instance, true)) {
+        fprintf(stderr, "%s has no winnable deal with a difficulty of %d to %d\n", index_path, min_difficulty, max_difficulty);
+        return 1;
+    }
+
+    Spectate *spectate = NULL;
+    if (spectator_socket_path) {
+        spectate = open_spectate(spectator_socket_path);
+        if (!spectate) {
+            perror(spectator_socket_path);
+            return 1;
+        }
+    }
+
+    // pick up where the last game left off, unless a specific deal was asked for
+    Save *save = NULL;
+    if (save_path) {
+        save = open_save(save_path);
+        if (!save && errno == EWOULDBLOCK) {
+            fprintf(stderr, "%s is in use by another game, this one won't be saved\n", save_path);
+        } else if (!save) {
+            perror(save_path);
+        } else if (has_seed || winnable_only || !resume_save(save, game_instance) || is_game_won(game_instance)) {
+            if (!has_seed && !winnable_only) reset_game(game_instance, false);
+            save_new_game(save, game_instance);
+        }
+    }
+
+    Recording *recording = NULL;
+    if (record_path) {
+        recording = open_recording(record_path, game_instance);
+        if (!recording) {
+            perror(record_path);
+            return 1;
+        }
+    }
+
+    if (!start_flight_recorder(flight_path, stall_seconds)) perror(flight_path);
+    if (profile_path && !start_profiler()) fprintf(stderr, "no hardware counters (%s), --profile only times\n", strerror(profiler.error));
+
+    if (!start_screen()) return 0;
+
+    // set up signal handlers, without SA_RESTART so a blocking getch() returns and the game gets saved
+    struct sigaction quit_action = {0};
+    quit_action.sa_handler = quit;
+    sigemptyset(&quit_action.sa_mask);
+    int quit_signals[] = {SIGINT, SIGTERM, SIGQUIT, SIGHUP, SIGPIPE, SIGUSR2};
+    for (size_t i = 0; i < sizeof(quit_signals) / sizeof(quit_signals[0]); ++i) {
+        sigaction(quit_signals[i], &quit_action, NULL);
+    }
+    // SIGUSR1 dumps the flight recorder and carries on
+    struct sigaction dump_action = {0};
+    dump_action.sa_handler = flight_signal;
+    dump_action.sa_flags = SA_RESTART;
+    sigemptyset(&dump_action.sa_mask);
+    sigaction(SIGUSR1, &dump_action, NULL);
 
     // render the game
     render(game_instance);
+    spectate_publish(spectate, game_instance);
 
     bool quitting = false;
     bool quitting2 = false;
@@ -322,13 +1618,34 @@ int main() {
         Action action = NO_ACTION;
 
         // handle key presses
-		switch (getch()) {
+        flight_idle();
+        int key = getch();
+        if (key != ERR) flight_key(key);
+        PERF_START(key_time);
+		switch (key) {
 			case ERR:
 				break;
 
             case KEY_RESIZE:
+                LOOP_TIME(PERF_RENDER, FLIGHT_RENDER, PROFILE_RENDER, render(game_instance));
+                break;
+
+            case KEY_PPAGE:
+            case KEY_NPAGE:
+                // half a screen of tableau at a time
+                scroll_tableau((key == KEY_PPAGE ? -1 : 1) * (getmaxy(stdscr) - TABLEAU_TOP) / 2);
+                LOOP_TIME(PERF_RENDER, FLIGHT_RENDER, PROFILE_RENDER, render(game_instance));
+                if (quitting) render_quit_dialog(quitting2);
+                break;
+
+#ifdef SOLITAIRE_PERF
+            case 'p':
+            case 'P':
+                perf_hud = !perf_hud;
                 render(game_instance);
+                if (perf_hud) render_perf_hud();
                 break;
+#endif
 
 			case KEY_UP:
 			case 'w':
@@ -374,6 +1691,7 @@ int main() {
 			default:
 				break;
 		}
+        PERF_STOP(PERF_INPUT, key_time);
 		refresh();
         if (!running) break;
         if (action != NO_ACTION) {
@@ -387,10 +1705,16 @@ int main() {
                         quitting2 = false;
                     }
                 }
-                handle_action(action, game_instance);
-                update_display(game_instance);
+                record_action(recording, action);
+                bool handled;
+                uint64_t action_start = flight_begin(FLIGHT_ACTION);
+                PERF_TIME(PERF_ACTION, PROFILE_TIME(PROFILE_ACTION, handled = handle_action(action, game_instance)));
+                flight_end(FLIGHT_ACTION, action_start, action, handled);
+                LOOP_TIME(PERF_DISPLAY, FLIGHT_DISPLAY, PROFILE_DISPLAY, update_display(game_instance));
+                if (save && action != QUIT) save_action(save, game_instance, action);
+                spectate_publish(spectate, game_instance);
             }
-            render(game_instance);
+            LOOP_TIME(PERF_RENDER, FLIGHT_RENDER, PROFILE_RENDER, render(game_instance));
             if (quitting) {
                 switch (action) {
                     // move quit dialog option
@@ -417,13 +1741,30 @@ int main() {
             }
         }
 
-        refresh();
+#ifdef SOLITAIRE_PERF
+        if (perf_hud && action != NO_ACTION) render_perf_hud();
+#endif
+        PERF_OUTPUT(LOOP_TIME(PERF_REFRESH, FLIGHT_REFRESH, PROFILE_REFRESH, refresh()));
+#ifdef SOLITAIRE_PERF
+        if (key != ERR) PERF_STOP(PERF_FRAME, key_time);
+#endif
 	}
 
-    noraw();
-    echo();
-    keypad(stdscr, false);
-
-	endwin();
+    stop_screen();
+    if (profile_path) {
+        FILE *file = fopen(profile_path, "w");
+        if (file) print_profile(file);
+        if (!file || fclose(file) != 0) perror(profile_path);
+        stop_profiler();
+    }
+#ifdef SOLITAIRE_PERF
+    if (perf_log_path && !perf_dump(perf_log_path)) perror(perf_log_path);
+#endif
+    if (!close_save(save, game_instance)) {
+        fprintf(stderr, "%s: %s, the last moves may not have been saved\n", save_path, strerror(errno));
+    }
+    if (!close_recording(recording)) perror(record_path);
+    close_spectate(spectate);
+    close_deal_index(deal_index);
 	return 0;
 }
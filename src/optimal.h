@@ -0,0 +1,267 @@
+#ifndef SOLITAIRE_OPTIMAL
+#define SOLITAIRE_OPTIMAL
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "./cards.h"
+#include "./solver.h"
+
+// shortest solutions (par), by iterative deepening A* over the same moves as solve_game(), every move counts as one,
+// draws and recycles included
+// the only moves left out are ones that can't make a solution shorter: a safe foundation move is made straight away
+// (is_safe_foundation_move()) and a king is never moved from one empty column to another
+
+typedef enum {
+    OPTIMAL_FOUND, // length is par
+    OPTIMAL_LOST, // every line runs out before a win, or takes more than SOLVER_MAX_DEPTH moves
+    OPTIMAL_TIMED_OUT, // no solution is shorter than bound, and the one from upper (if any) isn't proven to be par
+} OptimalStatus;
+
+typedef struct {
+    double time_limit; // seconds, 0 for no limit
+    long table_megabytes; // size of the table of positions seen
+} OptimalOptions;
+
+typedef struct {
+    OptimalStatus status;
+    int length; // moves in the solution, only for OPTIMAL_FOUND
+    bool searched; // moves holds the solution, false when it was the one from upper
+    int bound; // the proven lower bound on par, par itself for OPTIMAL_FOUND
+    int iterations;
+    long nodes;
+    double seconds;
+    Move moves[SOLVER_MAX_DEPTH];
+} OptimalResult;
+
+typedef struct {
+    // one table slot: the rest of the key above the index bits, the fewest moves the position was reached in
+    // and the iteration that was in, 8 bytes each
+    uint32_t check;
+    uint16_t depth;
+    uint16_t iteration;
+} OptimalSlot;
+
+typedef struct {
+    OptimalOptions options;
+    OptimalSlot *table;
+    size_t table_mask;
+    SolverFrame *frames;
+} OptimalSolver;
+
+OptimalSolver *create_optimal_solver(OptimalOptions options);
+void free_optimal_solver(OptimalSolver *solver);
+int optimal_heuristic(Game *game);
+OptimalStatus solve_optimal(OptimalSolver *solver, Game *game, int upper, OptimalResult *result);
+
+#ifdef SOLITAIRE_OPTIMAL_IMPLEMENTATION
+
+#include <string.h>
+
+OptimalSolver *create_optimal_solver(OptimalOptions options) {
+    // one per thread, like create_solver()
+    OptimalSolver *solver = malloc(sizeof(OptimalSolver));
+    if (!solver) return NULL;
+    if (options.table_megabytes < 1) options.table_megabytes = 64;
+    solver->options = options;
+
+    size_t size = 1024;
+    while (size * 2 * sizeof(OptimalSlot) <= (size_t) options.table_megabytes << 20) size <<= 1;
+    solver->table_mask = size - 1;
+    solver->table = malloc(size * sizeof(OptimalSlot));
+    solver->frames = malloc((SOLVER_MAX_DEPTH + 1) * sizeof(SolverFrame));
+    if (!solver->table || !solver->frames) {
+        free_optimal_solver(solver);
+        return NULL;
+    }
+    return solver;
+}
+
+void free_optimal_solver(OptimalSolver *solver) {
+    if (!solver) return;
+    free(solver->table);
+    free(solver->frames);
+    free(solver);
+}
+
+int optimal_heuristic(Game *game) {
+    // a lower bound on the moves left, each of these needs moves the others don't count:
+    // - every card not on the foundation has to go up on a move of its own
+    // - every card in the stock has to be drawn first
+    // - a card on top of a lower card of its own suit has to go to another column before that one can go up,
+    //   one move can take several of them off a column, but only ones joined by a run of face up cards
+    // - likewise a waste card on top of a lower one of its suit has to be played to a column, or the waste turned over
+    int moves = DECK_CARDS;
+    for (int i = 0; i < FOUNDATION_PILES; ++i) moves -= game->foundation[i].rank;
+    for (int i = 0; i < PILE_SLOTS && game->stock[i].rank != NO_RANK; ++i) ++moves;
+    // with more than one deck the other copy of the lower card can go up in its place, so nothing is blocked
+    if (SOLITAIRE_DECKS > 1) return moves;
+
+    for (int column = 0; column < TABLEAU_COLUMNS; ++column) {
+        // the lowest rank of each suit further down the column
+        int lowest[4] = {KING + 1, KING + 1, KING + 1, KING + 1};
+        bool joined = false; // a run of face up cards goes from the last blocked card to here
+        for (int row = 0; row < COLUMN_SLOTS; ++row) {
+            Card *card = &game->tableau[column][row];
+            if (card->rank == NO_RANK) break;
+            if (joined) {
+                Card *below = &game->tableau[column][row - 1];
+                joined = card->visible && below->rank == card->rank + 1 && is_opposite_color(card->suite, below->suite);
+            }
+            if (card->rank > lowest[card->suite]) {
+                if (!joined) ++moves;
+                joined = card->visible;
+            } else {
+                lowest[card->suite] = card->rank;
+            }
+        }
+    }
+
+    int lowest[4] = {KING + 1, KING + 1, KING + 1, KING + 1};
+    for (int i = 0; i < PILE_SLOTS && game->waste[i].rank != NO_RANK; ++i) {
+        Card *card = &game->waste[i];
+        if (card->rank > lowest[card->suite]) {
+            ++moves;
+            break;
+        }
+        lowest[card->suite] = card->rank;
+    }
+    return moves;
+}
+
+uint64_t optimal_key(Game *game) {
+    // plain keys, canonical ones would merge positions a different number of draws apart
+    PackedGame packed;
+    pack_game(game, &packed);
+    return hash_packed(&packed);
+}
+
+bool optimal_visit(OptimalSolver *solver, uint64_t key, int depth, int iteration) {
+    // false if the position was already reached in this iteration in as few moves, whatever it could reach then
+    // was searched with at least as much of the bound left
+    // slots are simply overwritten, losing one only means searching a position again
+    OptimalSlot *slot = &solver->table[key & solver->table_mask];
+    uint32_t check = (uint32_t) (key >> 32);
+    if (slot->check == check && slot->iteration == (uint16_t) iteration && slot->depth <= depth) return false;
+    *slot = (OptimalSlot) {check, (uint16_t) depth, (uint16_t) iteration};
+    return true;
+}
+
+void optimal_generate(SolverFrame *frame) {
+    // like solver_generate(), but a move is only dropped when it can't be part of a shortest solution
+    Game *game = &frame->game;
+    Move moves[MAX_LEGAL_MOVES];
+    int count = get_legal_moves(game, moves);
+    frame->count = 0;
+    frame->next = 0;
+
+    for (int i = 0; i < count; ++i) {
+        if (moves[i].to.location != FOUNDATION || moves[i].from.location == FOUNDATION) continue;
+        Card card;
+        if (moves[i].from.location == TABLEAU) card = game->tableau[moves[i].from.column][moves[i].from.row];
+        else card = *get_waste_top(game, false);
+        if (is_safe_foundation_move(game, card)) {
+            frame->moves[frame->count++] = moves[i];
+            return;
+        }
+    }
+
+    // solver_move_order() only decides the order here, what it would drop goes last
+    for (int order = 0; order <= 7; ++order) {
+        for (int i = 0; i < count; ++i) {
+            Move move = moves[i];
+            if (move.from.location == TABLEAU && move.from.row == 0 && move.to.location == TABLEAU) {
+                if (game->tableau[move.from.column][0].rank == KING) continue;
+            }
+            int move_order = solver_move_order(game, move);
+            if ((move_order < 0 ? 7 : move_order) == order) frame->moves[frame->count++] = move;
+        }
+    }
+}
+
+OptimalStatus solve_optimal(OptimalSolver *solver, Game *game, int upper, OptimalResult *result) {
+    // upper is the length of a known solution (from solve_game()), or 0, it's par once the bound reaches it
+    // each iteration is a depth first search of every line whose moves plus optimal_heuristic() stay within the bound,
+    // the next bound is the smallest that went over it
+    double start = monotonic_seconds();
+    memset(solver->table, 0, (solver->table_mask + 1) * sizeof(OptimalSlot));
+    result->nodes = 0;
+    result->iterations = 0;
+    result->length = 0;
+    result->searched = false;
+    result->bound = optimal_heuristic(game);
+    result->status = OPTIMAL_TIMED_OUT;
+
+    while (true) {
+        if (upper > 0 && result->bound >= upper) {
+            // nothing shorter than the known solution, so it is par
+            result->status = OPTIMAL_FOUND;
+            result->length = result->bound = upper;
+            break;
+        }
+        if (result->bound > SOLVER_MAX_DEPTH) {
+            result->status = OPTIMAL_LOST;
+            break;
+        }
+
+        // iteration numbers tell this iteration's table entries from older ones, 0 is the cleared table
+        // the bound goes up by at least one each time, so they never get past SOLVER_MAX_DEPTH
+        int iteration = ++result->iterations;
+        int next_bound = INT32_MAX;
+        bool found = false, timed_out = false;
+
+        int depth = 0;
+        solver->frames[0].game = *game;
+        optimal_visit(solver, optimal_key(game), 0, iteration);
+        optimal_generate(&solver->frames[0]);
+        while (depth >= 0) {
+            SolverFrame *frame = &solver->frames[depth];
+            if (is_game_won(&frame->game)) {
+                found = true;
+                result->length = depth;
+                for (int i = 0; i < depth; ++i) result->moves[i] = solver->frames[i].moves[solver->frames[i].next - 1];
+                break;
+            }
+            if (frame->next >= frame->count) {
+                --depth;
+                continue;
+            }
+            if ((result->nodes & 4095) == 0 && solver->options.time_limit > 0 &&
+                monotonic_seconds() - start >= solver->options.time_limit) {
+                timed_out = true;
+                break;
+            }
+
+            SolverFrame *child = &solver->frames[depth + 1];
+            child->game = frame->game;
+            Move move = frame->moves[frame->next++];
+            if (!apply_move(&child->game, move)) continue;
+            ++result->nodes;
+            int cost = depth + 1 + optimal_heuristic(&child->game);
+            if (cost > result->bound) {
+                if (cost < next_bound) next_bound = cost;
+                continue;
+            }
+            if (!optimal_visit(solver, optimal_key(&child->game), depth + 1, iteration)) continue;
+            optimal_generate(child);
+            ++depth;
+        }
+
+        if (found) {
+            result->status = OPTIMAL_FOUND;
+            result->searched = true;
+            result->bound = result->length;
+            break;
+        }
+        if (timed_out) break;
+        if (next_bound == INT32_MAX) {
+            result->status = OPTIMAL_LOST;
+            break;
+        }
+        result->bound = next_bound;
+    }
+    result->seconds = monotonic_seconds() - start;
+    return result->status;
+}
+
+#endif
+#endif
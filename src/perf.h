@@ -0,0 +1,131 @@
+#ifndef SOLITAIRE_PERF_TIMING
+#define SOLITAIRE_PERF_TIMING
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "./histogram.h"
+
+// keypress to frame instrumentation, only compiled in with PERF=1 (which defines SOLITAIRE_PERF)
+// without it the macros below expand to the bare code and nothing here is linked in
+
+typedef enum {
+    PERF_INPUT, PERF_ACTION, PERF_DISPLAY, PERF_RENDER, PERF_REFRESH, PERF_FRAME, PERF_PHASES
+} PerfPhase;
+
+#ifdef SOLITAIRE_PERF
+
+#define PERF_START(name) uint64_t name = perf_now()
+#define PERF_STOP(phase, name) perf_record(phase, perf_now() - (name))
+#define PERF_TIME(phase, code) do { uint64_t perf_start_ = perf_now(); code; perf_record(phase, perf_now() - perf_start_); } while (0)
+// the bytes the code sent to the terminal, for a refresh()
+#define PERF_OUTPUT(code) do { uint64_t perf_written_ = perf_written(); code; perf_output(perf_written() - perf_written_); } while (0)
+
+typedef struct {
+    Histogram phases[PERF_PHASES];
+    uint64_t bytes_written; // everything the game loop's refreshes sent to the terminal
+    uint64_t frame_bytes; // bytes written by the last refresh
+} PerfStats;
+
+extern PerfStats perf_stats;
+
+uint64_t perf_now();
+void perf_record(PerfPhase phase, uint64_t nanoseconds);
+uint64_t perf_written();
+void perf_output(uint64_t bytes);
+const char *perf_phase_name(PerfPhase phase);
+bool perf_dump(const char *path);
+
+#ifdef SOLITAIRE_PERF_IMPLEMENTATION
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+PerfStats perf_stats;
+
+uint64_t perf_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void perf_record(PerfPhase phase, uint64_t nanoseconds) {
+    histogram_add(&perf_stats.phases[phase], nanoseconds);
+}
+
+const char *perf_phase_name(PerfPhase phase) {
+    switch (phase) {
+        case PERF_INPUT:
+            return "input";
+        case PERF_ACTION:
+            return "action";
+        case PERF_DISPLAY:
+            return "display";
+        case PERF_RENDER:
+            return "render";
+        case PERF_REFRESH:
+            return "refresh";
+        case PERF_FRAME:
+            return "frame";
+        default:
+            return "";
+    }
+}
+
+uint64_t perf_written() {
+    // bytes the calling thread has passed to write() so far, from its io accounting, 0 where there is none
+    // curses writes from the thread that refreshes, so the difference around a refresh is what it sent, while the
+    // save writer and the other threads count on their own
+    static __thread int fd = -2;
+    if (fd == -2) fd = open("/proc/thread-self/io", O_RDONLY | O_CLOEXEC);
+    char buffer[512];
+    ssize_t size = fd >= 0 ? pread(fd, buffer, sizeof(buffer) - 1, 0) : -1;
+    if (size <= 0) return 0;
+    buffer[size] = '\0';
+    char *wchar = strstr(buffer, "wchar: ");
+    return wchar ? strtoull(wchar + 7, NULL, 10) : 0;
+}
+
+void perf_output(uint64_t bytes) {
+    perf_stats.bytes_written += bytes;
+    perf_stats.frame_bytes = bytes;
+}
+
+bool perf_dump(const char *path) {
+    // summary per phase, then every non-empty bucket
+    FILE *file = fopen(path, "w");
+    if (!file) return false;
+    fprintf(file, "# phase count p50_ns p99_ns max_ns mean_ns\n");
+    for (int phase = 0; phase < PERF_PHASES; ++phase) {
+        Histogram *histogram = &perf_stats.phases[phase];
+        fprintf(file, "%s %lu %lu %lu %lu %lu\n", perf_phase_name(phase), (unsigned long) histogram->count,
+                (unsigned long) histogram_quantile(histogram, 0.5), (unsigned long) histogram_quantile(histogram, 0.99),
+                (unsigned long) histogram->max, (unsigned long) (histogram->count ? histogram->sum / histogram->count : 0));
+    }
+    fprintf(file, "# bytes_written %lu\n", (unsigned long) perf_stats.bytes_written);
+    fprintf(file, "# phase low_ns high_ns count\n");
+    for (int phase = 0; phase < PERF_PHASES; ++phase) {
+        Histogram *histogram = &perf_stats.phases[phase];
+        for (int i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+            if (!histogram->buckets[i]) continue;
+            fprintf(file, "%s %lu %lu %u\n", perf_phase_name(phase), (unsigned long) histogram_bucket_low(i),
+                    (unsigned long) histogram_bucket_high(i), histogram->buckets[i]);
+        }
+    }
+    return fclose(file) == 0;
+}
+
+#endif
+
+#else
+
+#define PERF_START(name)
+#define PERF_STOP(phase, name)
+#define PERF_TIME(phase, code) do { code; } while (0)
+#define PERF_OUTPUT(code) do { code; } while (0)
+
+#endif
+#endif
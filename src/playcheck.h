@@ -0,0 +1,77 @@
+#ifndef SOLITAIRE_PLAY_CHECK
+#define SOLITAIRE_PLAY_CHECK
+
+#include <stdbool.h>
+#include "./cards.h"
+
+// checks for the engines that keep a game their own way (batch lanes, versions, the legal move set): played next
+// to a Game, they have to list the same moves as get_legal_moves() and end up where apply_move() does
+// the checks fill in message (PLAY_CHECK_MESSAGE bytes) with how they first differ, prefix_check_message() says where
+
+#define PLAY_CHECK_MESSAGE 256
+
+bool check_listed_moves(Game *game, const Move *moves, int count, char *message);
+bool check_played_move(Game *game, Move move, const PackedGame *position, bool won, char *message);
+void prefix_check_message(char *message, const char *format, ...);
+
+#ifdef SOLITAIRE_PLAY_CHECK_IMPLEMENTATION
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+bool check_listed_moves(Game *game, const Move *moves, int count, char *message) {
+    // the moves have to be get_legal_moves() for game in the same order, a NULL moves only checks the count
+    Move expected[MAX_LEGAL_MOVES];
+    int legal = get_legal_moves(game, expected);
+    if (legal != count) {
+        snprintf(message, PLAY_CHECK_MESSAGE, "%d legal moves, the engine lists %d", legal, count);
+        return false;
+    }
+    for (int i = 0; moves && i < count; ++i) {
+        if (!is_same_pos(expected[i].from, moves[i].from) || !is_same_pos(expected[i].to, moves[i].to)) {
+            char want[16], have[16];
+            snprintf(message, PLAY_CHECK_MESSAGE, "move %d is %s, the engine lists %s", i, format_move(expected[i], want),
+                     format_move(moves[i], have));
+            return false;
+        }
+    }
+    return true;
+}
+
+bool check_played_move(Game *game, Move move, const PackedGame *position, bool won, char *message) {
+    // applies move to game, the engine's own game has to be at position afterwards, won if game is
+    char text[16];
+    if (!apply_move(game, move)) {
+        snprintf(message, PLAY_CHECK_MESSAGE, "%s is not legal", format_move(move, text));
+        return false;
+    }
+    PackedGame expected;
+    pack_game(game, &expected);
+    if (memcmp(&expected, position, sizeof(PackedGame)) != 0 || won != is_game_won(game)) {
+        snprintf(message, PLAY_CHECK_MESSAGE, "%s leaves a different position", format_move(move, text));
+        return false;
+    }
+    return true;
+}
+
+void prefix_check_message(char *message, const char *format, ...) {
+    // puts "<format>: " in front of a check's message, cutting off its end if it gets too long
+    char prefix[PLAY_CHECK_MESSAGE];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(prefix, sizeof(prefix) - 2, format, args);
+    va_end(args);
+    if (length < 0) return;
+    if (length > (int) sizeof(prefix) - 3) length = sizeof(prefix) - 3;
+    memcpy(prefix + length, ": ", 2);
+    length += 2;
+    size_t kept = strlen(message);
+    if (kept > PLAY_CHECK_MESSAGE - 1 - (size_t) length) kept = PLAY_CHECK_MESSAGE - 1 - length;
+    memmove(message + length, message, kept);
+    message[length + kept] = '\0';
+    memcpy(message, prefix, length);
+}
+
+#endif
+#endif
@@ -0,0 +1,303 @@
+#ifndef SOLITAIRE_POLICY
+#define SOLITAIRE_POLICY
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "./cards.h"
+#include "./legal.h"
+#include "./workers.h"
+
+// a policy picks one of the legal moves, returns its index, or -1 to give up
+typedef int (*PolicyFunc)(Game *game, Move *moves, int count, uint64_t *rng);
+
+typedef struct {
+    const char *name;
+    PolicyFunc choose;
+} Policy;
+
+typedef struct {
+    const Policy *policy;
+    long games;
+    long wins;
+    long moves;
+    double seconds; // time spent playing, summed over all threads
+} PolicyResult;
+
+// games that don't finish by then count as losses
+#define POLICY_MAX_MOVES 1000
+
+extern const Policy policies[];
+extern const int policy_count;
+
+const Policy *find_policy(const char *name);
+int play_policy(Game *game, const Policy *policy, uint64_t rng, bool *won);
+bool run_tournament(const Policy **entries, int count, unsigned int first_seed, long deals, int threads, PolicyResult *results);
+void print_tournament(PolicyResult *results, int count, long deals, int threads);
+double monotonic_seconds();
+
+#ifdef SOLITAIRE_POLICY_IMPLEMENTATION
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+uint64_t policy_random(uint64_t *rng) {
+    // xorshift64*, each game gets its own state so threads never share one
+    *rng ^= *rng >> 12;
+    *rng ^= *rng << 25;
+    *rng ^= *rng >> 27;
+    return *rng * 0x2545f4914f6cdd1d;
+}
+
+bool move_reveals(Game *game, Move move) {
+    // does the move flip over a face-down tableau card?
+    return move.from.location == TABLEAU && move.from.row > 0 && !game->tableau[move.from.column][move.from.row - 1].visible;
+}
+
+bool move_empties_column(Move move) {
+    return move.from.location == TABLEAU && move.from.row == 0;
+}
+
+Card *move_card_of(Game *game, Move move) {
+    // the (bottom) card a move picks up
+    switch (move.from.location) {
+        case TABLEAU:
+            return &game->tableau[move.from.column][move.from.row];
+        case FOUNDATION:
+            return &game->foundation[move.from.column];
+        case WASTE:
+            return get_waste_top(game, false);
+        default:
+            return NULL;
+    }
+}
+
+bool king_waiting(Game *game) {
+    // is there a king that could use an empty column?
+    Card *waste_top = get_waste_top(game, false);
+    if (waste_top && waste_top->rank == KING) return true;
+    for (int column = 0; column < TABLEAU_COLUMNS; ++column) {
+        for (int row = 1; row < COLUMN_SLOTS && game->tableau[column][row].rank != NO_RANK; ++row) {
+            if (game->tableau[column][row].visible && game->tableau[column][row].rank == KING) return true;
+        }
+    }
+    return false;
+}
+
+int pick_best(int *scores, int count, uint64_t *rng) {
+    // highest score wins, ties are broken randomly, negative scores are never picked
+    int best = -1, ties = 0;
+    for (int i = 0; i < count; ++i) {
+        if (scores[i] < 0) continue;
+        if (best < 0 || scores[i] > scores[best]) {
+            best = i;
+            ties = 1;
+        } else if (scores[i] == scores[best] && policy_random(rng) % ++ties == 0) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+int score_common(Game *game, Move move) {
+    // scoring shared by the heuristic policies, -1 for moves that just shuffle cards around
+    if (move.from.location == STOCK) return 0;
+    if (move.to.location == FOUNDATION) return 100;
+    if (move.from.location == FOUNDATION) return -1;
+    if (move.from.location == WASTE) return 30;
+    if (move_reveals(game, move)) return 50;
+    if (move_empties_column(move) && move_card_of(game, move)->rank != KING) return 20;
+    return -1;
+}
+
+int policy_random_choose(Game *game, Move *moves, int count, uint64_t *rng) {
+    (void) game;
+    return count > 0 ? (int) (policy_random(rng) % count) : -1;
+}
+
+int policy_greedy_foundation(Game *game, Move *moves, int count, uint64_t *rng) {
+    int scores[MAX_LEGAL_MOVES];
+    for (int i = 0; i < count; ++i) scores[i] = score_common(game, moves[i]);
+    return pick_best(scores, count, rng);
+}
+
+int policy_reveal_first(Game *game, Move *moves, int count, uint64_t *rng) {
+    int scores[MAX_LEGAL_MOVES];
+    for (int i = 0; i < count; ++i) {
+        Move move = moves[i];
+        int score = score_common(game, move);
+        if (move_reveals(game, move)) {
+            // dig into the tallest face-down pile first
+            score = 200 + move.from.row;
+        } else if (move.to.location == FOUNDATION && move_card_of(game, move)->rank > RANK2) {
+            // keep higher cards around to build on until nothing is left to reveal
+            score = 40;
+        }
+        scores[i] = score;
+    }
+    return pick_best(scores, count, rng);
+}
+
+int policy_king_placement(Game *game, Move *moves, int count, uint64_t *rng) {
+    int scores[MAX_LEGAL_MOVES];
+    bool waiting = king_waiting(game);
+    for (int i = 0; i < count; ++i) {
+        Move move = moves[i];
+        int score = score_common(game, move);
+        Card *card = move_card_of(game, move);
+        if (move.to.location == TABLEAU && move.to.row == 0 && game->tableau[move.to.column][0].rank == NO_RANK) {
+            // a king into an empty column, only worth it if it frees something up
+            score = move_empties_column(move) ? -1 : 80 + (move_reveals(game, move) ? 20 : 0);
+        } else if (move_empties_column(move) && card->rank != KING && move.to.location == TABLEAU) {
+            // only empty a column if a king is ready to take it
+            score = waiting ? 60 : -1;
+        }
+        scores[i] = score;
+    }
+    return pick_best(scores, count, rng);
+}
+
+const Policy policies[] = {
+        {"random", policy_random_choose},
+        {"greedy-foundation", policy_greedy_foundation},
+        {"reveal-first", policy_reveal_first},
+        {"king-placement", policy_king_placement},
+};
+const int policy_count = sizeof(policies) / sizeof(policies[0]);
+
+const Policy *find_policy(const char *name) {
+    for (int i = 0; i < policy_count; ++i) {
+        if (strcmp(policies[i].name, name) == 0) return &policies[i];
+    }
+    return NULL;
+}
+
+int play_policy(Game *game, const Policy *policy, uint64_t rng, bool *won) {
+    // plays a dealt game until it's won, the policy gives up, or it only draws for a full pass of the stock
+    // returns how many moves were made
+    // the legal moves are kept up to date move by move, in get_legal_moves() order
+    Move moves[MAX_LEGAL_MOVES];
+    LegalSet legal;
+    int made = 0, draws = 0;
+    if (!rng) rng = 1;
+    *won = false;
+    rebuild_legal_set(&legal, game);
+    while (made < POLICY_MAX_MOVES) {
+        if (is_game_won(game)) {
+            *won = true;
+            break;
+        }
+        int count = legal_set_moves(&legal, moves);
+        if (count < 1) break;
+        int choice = policy->choose(game, moves, count, &rng);
+        if (choice < 0 || choice >= count) break;
+        if (!legal_set_apply(&legal, game, moves[choice])) break;
+        ++made;
+
+        if (moves[choice].from.location == STOCK) {
+            int cards = 0;
+            for (int i = 0; i < PILE_SLOTS && game->stock[i].rank != NO_RANK; ++i) ++cards;
+            for (int i = 0; i < PILE_SLOTS && game->waste[i].rank != NO_RANK; ++i) ++cards;
+            if (++draws > cards + 1) break;
+        } else {
+            draws = 0;
+        }
+    }
+    return made;
+}
+
+typedef struct {
+    const Policy **entries;
+    int count;
+    unsigned int first_seed;
+    long deals;
+    atomic_long next_deal;
+    PolicyResult *results; // one row of count entries per thread
+} Tournament;
+
+typedef struct {
+    Tournament *tournament;
+    PolicyResult *results;
+} TournamentWorker;
+
+double monotonic_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+void *tournament_thread(void *arg) {
+    TournamentWorker *worker = arg;
+    Tournament *tournament = worker->tournament;
+    Game *game = malloc(sizeof(Game));
+    if (!game) return NULL;
+
+    while (true) {
+        long deal = atomic_fetch_add(&tournament->next_deal, 1);
+        if (deal >= tournament->deals) break;
+        unsigned int seed = tournament->first_seed + (unsigned int) deal;
+
+        // every policy plays the exact same deal
+        for (int i = 0; i < tournament->count; ++i) {
+            PolicyResult *result = &worker->results[i];
+            bool won;
+            deal_game(game, seed);
+            double start = monotonic_seconds();
+            int made = play_policy(game, tournament->entries[i], deal_random(seed, 0x80000000u + (uint32_t) (tournament->entries[i] - policies)), &won);
+            result->seconds += monotonic_seconds() - start;
+            result->moves += made;
+            result->wins += won;
+            ++result->games;
+        }
+    }
+
+    free(game);
+    return NULL;
+}
+
+bool run_tournament(const Policy **entries, int count, unsigned int first_seed, long deals, int threads, PolicyResult *results) {
+    // plays every policy over the same seeded deals, spread over threads
+    if (threads < 1) threads = 1;
+    Tournament tournament = {entries, count, first_seed, deals, 0, NULL};
+    tournament.results = calloc((size_t) threads * count, sizeof(PolicyResult));
+    TournamentWorker *workers = malloc(sizeof(TournamentWorker) * threads);
+    if (!tournament.results || !workers) {
+        free(tournament.results);
+        free(workers);
+        return false;
+    }
+    for (int t = 0; t < threads; ++t) workers[t] = (TournamentWorker) {&tournament, &tournament.results[t * count]};
+    run_workers(tournament_thread, workers, sizeof(TournamentWorker), threads);
+
+    // merge the per-thread rows
+    for (int i = 0; i < count; ++i) {
+        results[i] = (PolicyResult) {entries[i], 0, 0, 0, 0};
+        for (int thread = 0; thread < threads; ++thread) {
+            PolicyResult *row = &tournament.results[thread * count + i];
+            results[i].games += row->games;
+            results[i].wins += row->wins;
+            results[i].moves += row->moves;
+            results[i].seconds += row->seconds;
+        }
+    }
+
+    free(tournament.results);
+    free(workers);
+    return true;
+}
+
+void print_tournament(PolicyResult *results, int count, long deals, int threads) {
+    printf("%ld deals, %d threads\n", deals, threads);
+    printf("%-20s %8s %10s %10s %12s\n", "policy", "wins", "win rate", "avg moves", "moves/s");
+    for (int i = 0; i < count; ++i) {
+        PolicyResult *result = &results[i];
+        double games = result->games > 0 ? (double) result->games : 1;
+        printf("%-20s %8ld %9.2f%% %10.1f %12.0f\n", result->policy->name, result->wins,
+               100.0 * (double) result->wins / games, (double) result->moves / games,
+               result->seconds > 0 ? (double) result->moves / result->seconds : 0);
+    }
+}
+
+#endif
+#endif
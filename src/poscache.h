@@ -0,0 +1,202 @@
+#ifndef SOLITAIRE_POSITION_CACHE
+#define SOLITAIRE_POSITION_CACHE
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "./cards.h"
+
+// solved positions kept in a memory-mapped file, shared by every solver thread and process that opens it
+// the table is fixed at creation, new results replace the least recently used entry of their bucket
+// slots are written without locks: each holds key ^ value next to the value, so a torn or racing write
+// just reads back as a miss
+
+#define POSITION_CACHE_MAGIC "SOLPOSC\0"
+#define POSITION_CACHE_VERSION (2 | LAYOUT_VERSION)
+#define POSITION_CACHE_WAYS 4 // slots per bucket, the replacement candidates for a new entry
+#define CACHE_UNKNOWN_LENGTH 0xffff // the depth of a win whose solution length isn't known
+
+typedef enum {
+    CACHE_MISS, CACHE_WON, CACHE_LOST,
+    CACHE_GAVE_UP, // a whole deal the solver gave up on, not a result, but a repeated sweep can skip it
+} CacheResult;
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t slot_size;
+    uint64_t slots; // power of two
+    uint64_t clock; // bumped by every solve, entries are stamped with it when used
+} PositionCacheHeader;
+
+typedef struct {
+    uint64_t check; // key ^ value
+    uint64_t value; // result, depth and effort, with the last-use stamp in the top half
+} PositionCacheSlot;
+
+typedef struct {
+    CacheResult result;
+    int depth; // moves in a known solution for CACHE_WON (or CACHE_UNKNOWN_LENGTH), the node limit in thousands for CACHE_GAVE_UP
+    int effort; // bit length of the nodes it took to solve it as a whole deal, 0 if it never was one
+} CacheEntry;
+
+typedef struct {
+    int fd;
+    size_t size;
+    PositionCacheHeader *header;
+    PositionCacheSlot *slots;
+    uint64_t mask;
+} PositionCache;
+
+PositionCache *open_position_cache(const char *path, size_t megabytes);
+void close_position_cache(PositionCache *cache);
+uint64_t position_cache_tick(PositionCache *cache);
+bool position_cache_get(PositionCache *cache, uint64_t key, uint64_t stamp, CacheEntry *entry);
+void position_cache_put(PositionCache *cache, uint64_t key, uint64_t stamp, CacheEntry entry);
+
+#ifdef SOLITAIRE_POSITION_CACHE_IMPLEMENTATION
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+PositionCache *open_position_cache(const char *path, size_t megabytes) {
+    // creates the file with room for megabytes of entries if it doesn't exist yet, an existing file keeps its size
+    PositionCache *cache = calloc(1, sizeof(PositionCache));
+    if (!cache) return NULL;
+    cache->fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (cache->fd < 0) {
+        free(cache);
+        return NULL;
+    }
+
+    // the lock only covers setting up a new file, the entries themselves are never locked
+    flock(cache->fd, LOCK_EX);
+    struct stat st;
+    bool ok = fstat(cache->fd, &st) == 0;
+    bool create = ok && st.st_size == 0;
+    if (create) {
+        uint64_t slots = 1024;
+        while (slots * 2 * sizeof(PositionCacheSlot) <= (uint64_t) megabytes << 20) slots *= 2;
+        st.st_size = (off_t) (sizeof(PositionCacheHeader) + slots * sizeof(PositionCacheSlot));
+        ok = ftruncate(cache->fd, st.st_size) == 0;
+    }
+    if (ok && (size_t) st.st_size < sizeof(PositionCacheHeader)) {
+        errno = EINVAL;
+        ok = false;
+    }
+    if (ok) {
+        cache->size = st.st_size;
+        cache->header = mmap(NULL, cache->size, PROT_READ | PROT_WRITE, MAP_SHARED, cache->fd, 0);
+        ok = cache->header != MAP_FAILED;
+        if (!ok) cache->header = NULL;
+    }
+    if (ok && create) {
+        memcpy(cache->header->magic, POSITION_CACHE_MAGIC, 8);
+        cache->header->version = POSITION_CACHE_VERSION;
+        cache->header->slot_size = sizeof(PositionCacheSlot);
+        cache->header->slots = (cache->size - sizeof(PositionCacheHeader)) / sizeof(PositionCacheSlot);
+        cache->header->clock = 1;
+    }
+    if (ok) {
+        PositionCacheHeader *header = cache->header;
+        uint64_t slots = header->slots;
+        if (memcmp(header->magic, POSITION_CACHE_MAGIC, 8) != 0 || header->version != POSITION_CACHE_VERSION ||
+            header->slot_size != sizeof(PositionCacheSlot) || slots < POSITION_CACHE_WAYS || (slots & (slots - 1)) ||
+            sizeof(PositionCacheHeader) + slots * sizeof(PositionCacheSlot) > cache->size) {
+            errno = EINVAL;
+            ok = false;
+        }
+    }
+    flock(cache->fd, LOCK_UN);
+
+    if (!ok) {
+        close_position_cache(cache);
+        return NULL;
+    }
+    cache->slots = (PositionCacheSlot *) (cache->header + 1);
+    cache->mask = cache->header->slots - 1;
+    return cache;
+}
+
+void close_position_cache(PositionCache *cache) {
+    if (!cache) return;
+    if (cache->header) munmap(cache->header, cache->size);
+    close(cache->fd);
+    free(cache);
+}
+
+uint64_t position_cache_tick(PositionCache *cache) {
+    // a new stamp for a solve, 32 bits is plenty since only the order within a bucket matters
+    return __atomic_add_fetch(&cache->header->clock, 1, __ATOMIC_RELAXED) & 0xffffffff;
+}
+
+uint64_t position_cache_encode(CacheEntry entry, uint64_t stamp) {
+    uint64_t depth = entry.depth < 0 ? 0 : entry.depth > 0xffff ? 0xffff : entry.depth;
+    uint64_t effort = entry.effort < 0 ? 0 : entry.effort > 63 ? 63 : entry.effort;
+    return (uint64_t) entry.result | depth << 2 | effort << 18 | stamp << 32;
+}
+
+CacheEntry position_cache_decode(uint64_t value) {
+    return (CacheEntry) {(CacheResult) (value & 3), (int) (value >> 2 & 0xffff), (int) (value >> 18 & 63)};
+}
+
+bool position_cache_read(PositionCacheSlot *slot, uint64_t *key, uint64_t *value) {
+    // false for an empty slot
+    *value = __atomic_load_n(&slot->value, __ATOMIC_RELAXED);
+    *key = __atomic_load_n(&slot->check, __ATOMIC_RELAXED) ^ *value;
+    return (*value & 3) != CACHE_MISS;
+}
+
+void position_cache_write(PositionCacheSlot *slot, uint64_t key, uint64_t value) {
+    // readers in between see a mismatched check and miss
+    __atomic_store_n(&slot->value, value, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->check, key ^ value, __ATOMIC_RELAXED);
+}
+
+bool position_cache_get(PositionCache *cache, uint64_t key, uint64_t stamp, CacheEntry *entry) {
+    PositionCacheSlot *bucket = &cache->slots[key & cache->mask & ~(uint64_t) (POSITION_CACHE_WAYS - 1)];
+    for (int i = 0; i < POSITION_CACHE_WAYS; ++i) {
+        uint64_t slot_key, value;
+        if (!position_cache_read(&bucket[i], &slot_key, &value) || slot_key != key) continue;
+        *entry = position_cache_decode(value);
+        // refresh the stamp so the entry survives replacement
+        if (value >> 32 != stamp) position_cache_write(&bucket[i], key, (value & 0xffffffff) | stamp << 32);
+        return true;
+    }
+    return false;
+}
+
+void position_cache_put(PositionCache *cache, uint64_t key, uint64_t stamp, CacheEntry entry) {
+    // an existing entry for the key keeps the shortest solution (or the largest node limit) and any effort it had
+    PositionCacheSlot *bucket = &cache->slots[key & cache->mask & ~(uint64_t) (POSITION_CACHE_WAYS - 1)];
+    int victim = 0;
+    uint64_t oldest = UINT64_MAX;
+    for (int i = 0; i < POSITION_CACHE_WAYS; ++i) {
+        uint64_t slot_key, value;
+        if (!position_cache_read(&bucket[i], &slot_key, &value)) {
+            victim = i, oldest = 0;
+            continue;
+        }
+        if (slot_key == key) {
+            CacheEntry old = position_cache_decode(value);
+            if (old.result == entry.result) {
+                if (entry.result == CACHE_GAVE_UP ? old.depth > entry.depth : old.depth < entry.depth) entry.depth = old.depth;
+                if (old.effort > entry.effort) entry.effort = old.effort;
+            }
+            victim = i;
+            break;
+        }
+        // stamps from the same solve come out equal, wrapping around is rare enough to ignore
+        if (value >> 32 < oldest) victim = i, oldest = value >> 32;
+    }
+    position_cache_write(&bucket[victim], key, position_cache_encode(entry, stamp));
+}
+
+#endif
+#endif
@@ -0,0 +1,607 @@
+#ifndef SOLITAIRE_REFERENCE
+#define SOLITAIRE_REFERENCE
+
+#include <stdbool.h>
+#include "./cards.h"
+
+// a frozen copy of the engine as it was before any fast paths, every function behind ref_
+// the differential checker (differential.h) plays it side by side with cards.h, so leave its rules as they are (it
+// only follows the pile sizes in cards.h):
+// if the two ever disagree, the one in cards.h is the one that changed
+// its legal moves are not a copy of get_legal_moves() but what ref_highlight_stackable() lights up for every card the
+// cursor could pick up, so the fast listing is checked against the rules the player sees
+
+void ref_update_display(Game *game);
+bool ref_handle_action(Action direction, Game *game);
+int ref_get_legal_moves(Game *game, Move *moves);
+bool ref_apply_move(Game *game, Move move);
+
+#ifdef SOLITAIRE_REFERENCE_IMPLEMENTATION
+
+void ref_update_visible(Game *game);
+bool ref_can_stack(Card card, Card above, bool is_foundation);
+void ref_clear_highlight(Game *game);
+void ref_highlight_source(Game *game);
+int ref_highlight_stackable(Card *card, CardLocation from, Game *game, bool *only_foundation);
+Card *ref_get_waste_top(Game *game, bool no_rank);
+Card *ref_get_stock_top(Game *game, bool no_rank);
+Card *ref_get_card(CardPos pos, Game *game, bool no_rank);
+int ref_get_amount_stacked_cards(CardPos pos, Game *game);
+bool ref_is_opposite_color(Suite suite1, Suite suite2);
+bool ref_get_suite_color(Suite suite);
+void ref_fix_selected_tableau(Game *game);
+bool ref_move_card(Game *game);
+bool ref_is_same_pos(CardPos a, CardPos b);
+int ref_add_highlighted(Game *game, CardPos from, Move *moves, int count);
+
+void ref_update_display(Game *game) {
+    // stuff to make the game work
+    ref_update_visible(game);
+    ref_clear_highlight(game);
+    if (game->moving.active) {
+        Card *card = ref_get_card(game->moving, game, false);
+        if (!card) {
+            game->moving.active = false;
+        } else {
+            ref_highlight_stackable(card, game->moving.location, game, NULL);
+        }
+    }
+    ref_highlight_source(game);
+}
+
+void ref_update_visible(Game *game) {
+    // make the top card of each tableau column visible
+    for (int column = 0; column < TABLEAU_COLUMNS; ++column) {
+        for (int row = 0; row < COLUMN_SLOTS; ++row) {
+            if (game->tableau[column][row].rank == NO_RANK) {
+                if (row > 0) game->tableau[column][row - 1].visible = true;
+                break;
+            }
+        }
+    }
+}
+
+bool ref_can_stack(Card card, Card above, bool is_foundation) {
+    // can a card stack on another card?
+    if (is_foundation) {
+        // must be same suite and stack on the rank below it
+        if (above.rank == NO_RANK)
+            return card.rank == ACE;
+        return card.suite == above.suite && card.rank == above.rank + 1;
+    }
+    // king is top of a column, other cards stack on a card with the opposite suite color and the rank above it, e.g 2 of clubs stacks on 3 of diamonds
+    return (above.rank == NO_RANK && card.rank == KING) || (ref_is_opposite_color(card.suite, above.suite) && above.rank == card.rank + 1);
+}
+
+void ref_clear_highlight(Game *game) {
+    // clears the "highlight"
+    for (int i = 0; i < FOUNDATION_PILES; ++i) {
+        game->foundation[i].highlight = NO_HIGHLIGHT;
+    }
+    for (int i = 0; i < PILE_SLOTS; ++i) {
+        game->stock[i].highlight = NO_HIGHLIGHT;
+        game->waste[i].highlight = NO_HIGHLIGHT;
+    }
+    for (int column = 0; column < TABLEAU_COLUMNS; ++column) {
+        for (int row = 0; row < COLUMN_SLOTS; ++row) {
+            game->tableau[column][row].highlight = NO_HIGHLIGHT;
+        }
+    }
+}
+
+void ref_highlight_source(Game *game) {
+    // highlight the card we are moving (source)
+    if (!game->moving.active) return;
+    Card *card = ref_get_card(game->moving, game, true);
+    if (!card) return;
+    card->highlight = SOURCE;
+}
+
+int ref_highlight_stackable(Card *card, CardLocation from, Game *game, bool *only_foundation) {
+    // highlights cards that a card can be stacked on as "highlighted", which the action function uses
+    ref_clear_highlight(game);
+    int count_stackable = 0;
+
+    bool only_foundation_ = false;
+
+    // if we are on the tableau and the next card is not empty, don't highlight moving to foundation
+    // we cannot move more than one card at a time to the foundation
+    // a foundation card never goes onto another foundation, with two decks there is one of the same suit to take it
+    if (from == WASTE || (from == TABLEAU && card[1].rank == NO_RANK)) {
+        for (int i = 0; i < FOUNDATION_PILES; ++i) {
+            bool stack = ref_can_stack(*card, game->foundation[i], true);
+            if (stack) {
+                only_foundation_ = true;
+                ++count_stackable;
+                game->foundation[i].highlight = HIGHLIGHTED;
+            }
+        }
+    }
+
+    for (int column = 0; column < TABLEAU_COLUMNS; ++column) {
+        for (int row = 0; row < COLUMN_SLOTS; ++row) {
+            if (game->tableau[column][row].rank == NO_RANK) {
+                if (row > 0) {
+                    if (game->tableau[column][row - 1].visible) {
+                        bool stack = ref_can_stack(*card, game->tableau[column][row - 1], false);
+                        if (stack) {
+                            only_foundation_ = false;
+                            ++count_stackable;
+                            game->tableau[column][row - 1].highlight = HIGHLIGHTED;
+                        }
+                    }
+                } else if (card->rank == KING) {
+                    only_foundation_ = false;
+                    ++count_stackable;
+                    game->tableau[column][row].highlight = HIGHLIGHTED;
+                }
+                break;
+            }
+        }
+    }
+
+    if (only_foundation) *only_foundation = only_foundation_;
+    return count_stackable;
+}
+
+Card *ref_get_waste_top(Game *game, bool no_rank) {
+    // get waste cards
+    // will return NULL if there is no card there (has NO_RANK) and if the no-rank argument is set to false
+    // otherwise will return the first "non-existent" card if no-rank is true
+    Card *card = NULL;
+    for (int i = 0; i < PILE_SLOTS; ++i) {
+        if (game->waste[i].rank == NO_RANK) {
+            if (no_rank && !card) return &game->waste[i];
+            return card;
+        }
+        game->waste[i].visible = true;
+        card = &game->waste[i];
+    }
+    return card;
+}
+
+Card *ref_get_stock_top(Game *game, bool no_rank) {
+    // get stock cards
+    // will return NULL if there is no card there (has NO_RANK) and if the no-rank argument is set to false
+    // otherwise will return the first "non-existent" card if no-rank is true
+    Card *card = NULL;
+    for (int i = 0; i < PILE_SLOTS; ++i) {
+        if (game->stock[i].rank == NO_RANK) {
+            if (no_rank && !card) return &game->stock[i];
+            return card;
+        }
+        game->stock[i].visible = true;
+        card = &game->stock[i];
+    }
+    return card;
+}
+
+Card *ref_get_card(CardPos pos, Game *game, bool no_rank) {
+    // get a pointer to the card that a CardPos references
+    // will return NULL if there is no card there (has NO_RANK) and if the no-rank argument is set to false
+    if (!pos.active) return NULL;
+    Card *card = NULL;
+    switch (pos.location) {
+        case TABLEAU:
+            if (pos.column >= 0 && pos.column < TABLEAU_COLUMNS && pos.row >= 0 && pos.row < COLUMN_SLOTS)
+                card = &game->tableau[pos.column][pos.row];
+            if (!no_rank && card && card->rank == NO_RANK) return NULL;
+            break;
+        case WASTE:
+            card = ref_get_waste_top(game, no_rank);
+            break;
+        case FOUNDATION:
+            if (pos.column >= 0 && pos.column < FOUNDATION_PILES)
+                card = &game->foundation[pos.column];
+            break;
+        case STOCK:
+            card = ref_get_stock_top(game, no_rank);
+            break;
+    }
+    return card;
+}
+
+int ref_get_amount_stacked_cards(CardPos pos, Game *game) {
+    // gets how many cards are stacked on top of the specified card
+    // only works for cards in the tableau
+    if (!pos.active) return 0;
+    if (pos.location != TABLEAU) return 1;
+    if (pos.column < 0 || pos.column >= TABLEAU_COLUMNS || pos.row < 0 || pos.row >= COLUMN_SLOTS) return 0;
+    int i = 0;
+    for (int row = pos.row; row < COLUMN_SLOTS; ++row, ++i) {
+        if (game->tableau[pos.column][row].rank == NO_RANK) return i;
+    }
+    return i;
+}
+
+bool ref_is_opposite_color(Suite suite1, Suite suite2) {
+    return ref_get_suite_color(suite1) != ref_get_suite_color(suite2);
+}
+
+bool ref_get_suite_color(Suite suite) {
+    return suite & 2;
+}
+
+void ref_fix_selected_tableau(Game *game) {
+    // moves the selected card to the nearest visible card in the tableau
+    // what's the point of selecting a card that is flipped over? /rh
+    if (!game->selected.active || game->selected.location != TABLEAU) return;
+    Card *card_dir = NULL;
+    while (true) {
+        card_dir = ref_get_card(game->selected, game, false);
+        if (!card_dir) {
+            if (game->selected.row == 0) {
+                break;
+            } else {
+                --game->selected.row;
+            }
+        } else if (!card_dir->visible) {
+            ++game->selected.row;
+        } else if (card_dir->visible) break;
+    }
+}
+
+bool ref_move_card(Game *game) {
+    // main part of the game lol
+
+    // don't move if there is no selected card
+    if (!game->selected.active || !game->moving.active) return false;
+
+    // card stack we're moving
+    Card *source_card = ref_get_card(game->moving, game, false);
+    if (!source_card) return false;
+
+    CardPos destination = game->selected;
+
+    // where we're moving it to
+    Card *orig_destination_card = ref_get_card(destination, game, true);
+    Card *destination_card = orig_destination_card;
+    if (!destination_card) return false;
+    if (destination_card->rank != NO_RANK && destination.location == TABLEAU) {
+        // select the one on top of it, so we don't replace replaces
+        ++destination.row;
+        destination_card = ref_get_card(destination, game, true);
+        if (!destination_card || destination_card->rank != NO_RANK) return false;
+    }
+
+    if (!ref_can_stack(*source_card, *orig_destination_card, destination.location == FOUNDATION)) return false;
+
+    int amount = ref_get_amount_stacked_cards(game->moving, game);
+    if (amount < 1) return false;
+
+    if (destination.location == TABLEAU) {
+        // check to see the card stack can move
+        CardPos last_destination = destination;
+        last_destination.row += amount - 1;
+        Card *last_destination_card = ref_get_card(last_destination, game, true);
+        if (!last_destination_card || last_destination_card->rank != NO_RANK) return false; // continue if there is no card there but not out of bounds
+
+        // another check
+        CardPos last_source = game->moving;
+        last_source.row += amount - 1;
+        Card *last_source_card = ref_get_card(last_source, game, false);
+        if (!last_source_card) return false; // continue if there is a card there
+
+        if (last_source.location == TABLEAU) {
+            // and another
+            ++last_source.row;
+            last_source_card = ref_get_card(last_source, game, true);
+            if (!last_source_card || last_source_card->rank != NO_RANK) return false; // continue if there is no card there but not out of bounds
+        } else if (last_source.location == FOUNDATION) {
+            if (source_card->rank == NO_RANK) return false;
+        }
+
+        memcpy(destination_card, source_card, sizeof(Card) * amount);
+
+        if (last_source.location == FOUNDATION) {
+            --source_card->rank; // decrease the rank on foundation
+        } else {
+            for (int i = 0; i < amount; ++i) {
+                source_card = ref_get_card(game->moving, game, false);
+                if (!source_card) break;
+                source_card->rank = NO_RANK;
+                ++game->moving.row;
+            }
+        }
+    } else if (destination.location == FOUNDATION) {
+        // the card would be copied and the pile under it emptied
+        if (game->moving.location == FOUNDATION) return false;
+        if (game->moving.location == TABLEAU) {
+            CardPos above = game->moving;
+            ++above.row;
+
+            Card *above_card = ref_get_card(above, game, false);
+            if (above_card) return false;
+        }
+
+        *destination_card = *source_card;
+        source_card->rank = NO_RANK;
+    } else return false;
+
+    // finish up
+    game->selected = destination;
+    game->moving.active = false;
+    ref_update_visible(game);
+    ref_clear_highlight(game);
+    ref_fix_selected_tableau(game);
+    return true;
+}
+
+bool ref_is_same_pos(CardPos a, CardPos b) {
+    return a.active && b.active && a.column == b.column && a.row == b.row && a.location == b.location;
+}
+
+bool ref_handle_action(Action direction, Game *game) {
+    // handle key presses
+    ref_update_visible(game);
+    switch (direction) {
+        case UP:
+        case RIGHT:
+        case DOWN:
+        case LEFT:
+            // handle this later in the code
+            break;
+
+        case CONFIRM:
+            if (game->selected.active) {
+                if (game->selected.location == STOCK) {
+                    if (game->moving.active) return false;
+
+                    Card *card = ref_get_stock_top(game, false);
+                    if (!card) {
+                        for (int i = 0;; ++i) {
+                            Card *waste_card = ref_get_waste_top(game, false);
+                            if (!waste_card) break;
+                            game->stock[i] = *waste_card;
+                            waste_card->rank = NO_RANK;
+                        }
+                    } else {
+                        for (int i = 0; i < PILE_SLOTS; ++i) {
+                            if (game->waste[i].rank == NO_RANK) {
+                                if (i < PILE_SLOTS - 1) game->waste[i + 1].rank = NO_RANK;
+                                card->visible = true;
+                                game->waste[i] = *card;
+                                card->rank = NO_RANK;
+                                break;
+                            }
+                        }
+                        game->selected.location = WASTE;
+                    }
+                    return true;
+                }
+
+                Card *card = ref_get_card(game->selected, game, false);
+                if (card) {
+                    if (game->moving.active) {
+                        if (ref_is_same_pos(game->moving, game->selected)) {
+                            game->moving.active = false;
+                            return true;
+                        }
+                        if (card->highlight == HIGHLIGHTED) {
+                            return ref_move_card(game);
+                        }
+                    } else {
+                        bool foundation = false;
+                        int count = ref_highlight_stackable(card, game->selected.location, game, &foundation);
+                        if (count < 1) return false;
+                        ref_highlight_source(game);
+                        game->moving = game->selected;
+                        game->moving.active = true;
+                        if (count == 1 || foundation) {
+                            for (int column = 0; column < TABLEAU_COLUMNS; ++column) {
+                                for (int row = 0; row < COLUMN_SLOTS; ++row) {
+                                    if (game->tableau[column][row].highlight == HIGHLIGHTED) {
+                                        game->selected = (CardPos) {true, TABLEAU, column, row};
+                                        return ref_move_card(game);
+                                    }
+                                    if (game->tableau[column][row].rank == NO_RANK) break;
+                                }
+                            }
+                            for (int x = 0; x < FOUNDATION_PILES; ++x) {
+                                if (game->foundation[x].highlight == HIGHLIGHTED) {
+                                    game->selected = (CardPos) {true, FOUNDATION, x, 0};
+                                    return ref_move_card(game);
+                                }
+                            }
+                        }
+                    }
+                }
+                return false;
+            }
+            return false;
+
+        case CANCEL:
+            if (game->moving.active) {
+                game->moving.active = false;
+                return true;
+            }
+            return false;
+
+        default:
+            return false;
+    }
+
+    // return if there is no card selected
+    if (!game->selected.active) return NULL;
+    Card *card_dir = NULL;
+    CardPos pos_dir;
+
+    // cba to comment all of this, it basically selects the card in said direction of the previously selected card
+    switch (game->selected.location) {
+        case TABLEAU:
+            switch (direction) {
+                case UP:
+                    pos_dir = game->selected;
+                    --pos_dir.row;
+                    card_dir = ref_get_card(pos_dir, game, false);
+                    if (game->selected.row <= 0 || !card_dir || !card_dir->visible) {
+                        game->selected.row = 0;
+                        if (game->selected.column >= FOUNDATION_PILES) {
+                            if (game->waste[0].rank != NO_RANK) {
+                                game->selected.column = 0;
+                                game->selected.location = WASTE;
+                            } else if (game->selected.column == FOUNDATION_PILES) {
+                                game->selected.column = FOUNDATION_PILES - 1;
+                                game->selected.location = FOUNDATION;
+                            } else if (game->selected.column >= STOCK_SLOT) {
+                                game->selected.column = 0;
+                                game->selected.location = STOCK;
+                            }
+                        } else {
+                            game->selected.location = FOUNDATION;
+                        }
+                        ref_fix_selected_tableau(game);
+                        return true;
+                    }
+                    --game->selected.row;
+                    return true;
+                case RIGHT:
+                    if (game->selected.column >= TABLEAU_COLUMNS - 1) {
+                        game->selected.row = 0;
+                        game->selected.column = 0;
+                        game->selected.location = STOCK;
+                    } else {
+                        ++game->selected.column;
+                        ref_fix_selected_tableau(game);
+                    }
+                    return true;
+                case DOWN:
+                    pos_dir = game->selected;
+                    ++pos_dir.row;
+                    card_dir = ref_get_card(pos_dir, game, false);
+                    if (card_dir && card_dir->visible) {
+                        game->selected = pos_dir;
+                        return true;
+                    }
+                    return false;
+                case LEFT:
+                    if (game->selected.column > 0) {
+                        --game->selected.column;
+                        ref_fix_selected_tableau(game);
+                    }
+                    return true;
+                default:
+                    return false;
+            }
+        case FOUNDATION:
+            game->selected.row = 0;
+            switch (direction) {
+                case UP:
+                    return false;
+                case RIGHT:
+                    if (game->selected.column >= FOUNDATION_PILES - 1) {
+                        game->selected.column = 0;
+                        if (game->waste[0].rank != NO_RANK) {
+                            game->selected.location = WASTE;
+                        } else {
+                            game->selected.location = STOCK;
+                        }
+                        return true;
+                    }
+                    ++game->selected.column;
+                    return true;
+                case DOWN:
+                    game->selected.location = TABLEAU;
+                    ref_fix_selected_tableau(game);
+                    return true;
+                case LEFT:
+                    if (game->selected.column <= 0) return false;
+                    --game->selected.column;
+                    return true;
+                default:
+                    return false;
+            }
+        case WASTE:
+        case STOCK:
+            game->selected.row = 0;
+            switch (direction) {
+                case UP:
+                    return false;
+                case RIGHT:
+                    if (game->selected.location == WASTE) {
+                        game->selected.column = FOUNDATION_PILES - 1;
+                        game->selected.location = STOCK;
+                        return true;
+                    }
+                    return false;
+                case DOWN:
+                    game->selected.column = game->selected.location == WASTE ? WASTE_SLOT : STOCK_SLOT;
+                    if (game->selected.column >= TABLEAU_COLUMNS) game->selected.column = TABLEAU_COLUMNS - 1;
+                    game->selected.location = TABLEAU;
+                    ref_fix_selected_tableau(game);
+                    return true;
+                case LEFT:
+                    if (game->waste[0].rank == NO_RANK || game->selected.location == WASTE) {
+                        game->selected.column = FOUNDATION_PILES - 1;
+                        game->selected.location = FOUNDATION;
+                    } else {
+                        game->selected.column = 0;
+                        game->selected.location = WASTE;
+                    }
+                    return true;
+                default:
+                    return false;
+            }
+    }
+    return false;
+}
+
+int ref_add_highlighted(Game *game, CardPos from, Move *moves, int count) {
+    // the moves of a card picked up at from, onto every pile ref_highlight_stackable() lit up for it
+    Card *card = ref_get_card(from, game, false);
+    if (!card) return count;
+    ref_highlight_stackable(card, from.location, game, NULL);
+    for (int i = 0; i < FOUNDATION_PILES; ++i) {
+        if (game->foundation[i].highlight == HIGHLIGHTED) moves[count++] = (Move) {from, {true, FOUNDATION, i, 0}};
+    }
+    for (int column = 0; column < TABLEAU_COLUMNS; ++column) {
+        for (int row = 0; row < COLUMN_SLOTS; ++row) {
+            if (game->tableau[column][row].highlight == HIGHLIGHTED) {
+                moves[count++] = (Move) {from, {true, TABLEAU, column, row}};
+                break;
+            }
+            if (game->tableau[column][row].rank == NO_RANK) break;
+        }
+    }
+    return count;
+}
+
+int ref_get_legal_moves(Game *game, Move *moves) {
+    // lists the moves the cursor offers: every card it can pick up, onto every pile that lights up for it
+    // worked out on a copy, so the highlight and the cursor of game stay as they are
+    // moves must have room for MAX_LEGAL_MOVES entries
+    Game scratch = *game;
+    int count = 0;
+    for (int column = 0; column < TABLEAU_COLUMNS; ++column) {
+        for (int row = 0; row < COLUMN_SLOTS && scratch.tableau[column][row].rank != NO_RANK; ++row) {
+            if (scratch.tableau[column][row].visible) count = ref_add_highlighted(&scratch, (CardPos) {true, TABLEAU, column, row}, moves, count);
+        }
+    }
+    count = ref_add_highlighted(&scratch, (CardPos) {true, WASTE, 0, 0}, moves, count);
+    for (int i = 0; i < FOUNDATION_PILES; ++i) {
+        if (scratch.foundation[i].rank != NO_RANK) count = ref_add_highlighted(&scratch, (CardPos) {true, FOUNDATION, i, 0}, moves, count);
+    }
+
+    // drawing from the stock, or turning the waste back over
+    if (scratch.stock[0].rank != NO_RANK || scratch.waste[0].rank != NO_RANK) {
+        moves[count++] = (Move) {{true, STOCK, 0, 0}, {true, WASTE, 0, 0}};
+    }
+    return count;
+}
+
+bool ref_apply_move(Game *game, Move move) {
+    // applies a move from get_legal_moves, the cursor ends up wherever move_card leaves it
+    if (move.from.location == STOCK) {
+        game->moving.active = false;
+        game->selected = (CardPos) {true, STOCK, 0, 0};
+        return ref_handle_action(CONFIRM, game);
+    }
+    game->moving = move.from;
+    game->selected = move.to;
+    if (ref_move_card(game)) return true;
+    game->moving.active = false;
+    return false;
+}
+
+#endif
+#endif
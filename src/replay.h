@@ -0,0 +1,424 @@
+#ifndef SOLITAIRE_REPLAY
+#define SOLITAIRE_REPLAY
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "./cards.h"
+#include "./histogram.h"
+#include "./save.h"
+#include "./workers.h"
+
+// replay archives: every recorded game is appended as one record, a header with the position it started from
+// followed by one 32-bit event per action, so archives from many sessions can just be concatenated
+// the analyzer streams them back through handle_action() on all cores and keeps only mergeable counters
+
+#define REPLAY_MAGIC 0x4c505253 // "SRPL", starts every game record
+#define REPLAY_VERSION (1 | LAYOUT_VERSION)
+#define REPLAY_ACTIONS 8 // NO_ACTION up to QUIT
+#define REPLAY_ACTION_BITS 3 // the action, the milliseconds since the previous event take the rest of an event
+#define REPLAY_MAX_MILLIS ((1u << (32 - REPLAY_ACTION_BITS)) - 1)
+#define REPLAY_CHUNK (1 << 20) // bytes of whole games an analyzer thread takes at a time
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    uint32_t events;
+    uint32_t checksum; // FNV-1a over the rest of the header and the events
+    uint32_t seed;
+    SavedPos selected;
+    SavedPos moving;
+    PackedGame start;
+    uint8_t padding[4 - sizeof(PackedGame) % 4]; // keeps the events after it 4-byte aligned
+} ReplayHeader;
+
+typedef struct {
+    int fd;
+    ReplayHeader header;
+    uint32_t *events;
+    uint32_t capacity;
+    double last; // time of the previous event
+} Recording;
+
+typedef struct {
+    // every field adds up, so per-thread copies merge into the total
+    uint64_t games;
+    uint64_t won;
+    uint64_t damaged; // records skipped for a bad checksum, a bad action or a torn end
+    uint64_t bytes;
+    uint64_t actions[REPLAY_ACTIONS];
+    uint64_t moves; // actions that changed where cards are
+    uint64_t returns; // moves back to a position the game had already been in
+    uint64_t recycles; // waste turned back over onto the stock
+    Histogram moves_per_game;
+    Histogram actions_per_game;
+    Histogram recycles_per_game;
+    Histogram win_millis;
+} ReplayStats;
+
+Recording *open_recording(const char *path, Game *game);
+void record_action(Recording *recording, Action action);
+bool close_recording(Recording *recording);
+void merge_replay_stats(ReplayStats *into, const ReplayStats *from);
+bool analyze_replays(const char *path, int threads, ReplayStats *stats);
+void print_replay_stats(FILE *file, const ReplayStats *stats, bool json);
+
+#ifdef SOLITAIRE_REPLAY_IMPLEMENTATION
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char *replay_action_names[REPLAY_ACTIONS] = {"none", "up", "right", "down", "left", "confirm", "cancel", "quit"};
+
+uint32_t replay_checksum(const ReplayHeader *header, const uint32_t *events) {
+    // FNV-1a like save_checksum(), over the header from the seed on, then the events
+    uint32_t hash = 0x811c9dc5;
+    const uint8_t *bytes = (const uint8_t *) &header->seed;
+    for (size_t i = 0; i < sizeof(ReplayHeader) - offsetof(ReplayHeader, seed); ++i) hash = (hash ^ bytes[i]) * 0x01000193;
+    bytes = (const uint8_t *) events;
+    for (size_t i = 0; i < header->events * sizeof(uint32_t); ++i) hash = (hash ^ bytes[i]) * 0x01000193;
+    return hash;
+}
+
+Recording *open_recording(const char *path, Game *game) {
+    // starts recording game from where it is now, it gets appended to path when the recording is closed
+    Recording *recording = calloc(1, sizeof(Recording));
+    if (!recording) return NULL;
+    recording->fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (recording->fd < 0) {
+        free(recording);
+        return NULL;
+    }
+    ReplayHeader *header = &recording->header;
+    header->magic = REPLAY_MAGIC;
+    header->version = REPLAY_VERSION;
+    header->seed = game->seed;
+    header->selected = save_pos(game->selected);
+    header->moving = save_pos(game->moving);
+    pack_game(game, &header->start);
+    recording->last = monotonic_seconds();
+    return recording;
+}
+
+void record_action(Recording *recording, Action action) {
+    // call right before handle_action
+    if (!recording) return;
+    if (recording->header.events == recording->capacity) {
+        uint32_t capacity = recording->capacity ? recording->capacity * 2 : 1024;
+        uint32_t *events = realloc(recording->events, capacity * sizeof(uint32_t));
+        if (!events) return;
+        recording->events = events;
+        recording->capacity = capacity;
+    }
+    double now = monotonic_seconds();
+    double millis = (now - recording->last) * 1000;
+    recording->last = now;
+    uint32_t delay = millis > REPLAY_MAX_MILLIS ? REPLAY_MAX_MILLIS : (uint32_t) millis;
+    recording->events[recording->header.events++] = (uint32_t) action | delay << REPLAY_ACTION_BITS;
+}
+
+bool close_recording(Recording *recording) {
+    // appends the game with a single write, so sessions recording into the same archive don't interleave
+    if (!recording) return true;
+    ReplayHeader *header = &recording->header;
+    header->checksum = replay_checksum(header, recording->events);
+    size_t size = sizeof(ReplayHeader) + header->events * sizeof(uint32_t);
+    uint8_t *record = malloc(size);
+    bool ok = record != NULL;
+    if (ok) {
+        memcpy(record, header, sizeof(ReplayHeader));
+        if (header->events) memcpy(record + sizeof(ReplayHeader), recording->events, header->events * sizeof(uint32_t));
+        ssize_t written;
+        while ((written = write(recording->fd, record, size)) < 0 && errno == EINTR);
+        ok = written == (ssize_t) size;
+    }
+    if (close(recording->fd) != 0) ok = false;
+    free(record);
+    free(recording->events);
+    free(recording);
+    return ok;
+}
+
+void merge_replay_stats(ReplayStats *into, const ReplayStats *from) {
+    into->games += from->games;
+    into->won += from->won;
+    into->damaged += from->damaged;
+    into->bytes += from->bytes;
+    for (int i = 0; i < REPLAY_ACTIONS; ++i) into->actions[i] += from->actions[i];
+    into->moves += from->moves;
+    into->returns += from->returns;
+    into->recycles += from->recycles;
+    histogram_merge(&into->moves_per_game, &from->moves_per_game);
+    histogram_merge(&into->actions_per_game, &from->actions_per_game);
+    histogram_merge(&into->recycles_per_game, &from->recycles_per_game);
+    histogram_merge(&into->win_millis, &from->win_millis);
+}
+
+typedef struct {
+    // one archive being analyzed, threads take chunks of whole records from offset on
+    const uint8_t *map;
+    size_t size;
+    size_t offset;
+    uint64_t damaged; // torn or unrecognized stretches found while cutting chunks
+    pthread_mutex_t lock;
+} ReplayScan;
+
+typedef struct {
+    ReplayScan *scan;
+    ReplayStats stats;
+    Game *game;
+    // positions seen in the current game, a slot counts if its stamp is the current one
+    uint64_t *seen;
+    uint32_t *stamps;
+    uint32_t capacity;
+    uint32_t stamp;
+} ReplayWorker;
+
+static inline bool is_replay_header(const ReplayScan *scan, size_t offset) {
+    const ReplayHeader *header = (const ReplayHeader *) (scan->map + offset);
+    return header->magic == REPLAY_MAGIC && header->version == REPLAY_VERSION;
+}
+
+bool replay_record_at(const ReplayScan *scan, size_t offset, size_t end, size_t *size) {
+    // whether a record starts at offset and ends by end, going by the headers alone: its own, and after it another
+    // one or the end of the archive
+    // a record torn by a session that died while writing it claims more events than it has, and later sessions
+    // append right after what it did write, so its size runs into the middle of their records, or past the end
+    if (offset + sizeof(ReplayHeader) > end || !is_replay_header(scan, offset)) return false;
+    *size = sizeof(ReplayHeader) + (size_t) ((const ReplayHeader *) (scan->map + offset))->events * sizeof(uint32_t);
+    if (*size > end - offset) return false;
+    size_t next = offset + *size;
+    return next + sizeof(ReplayHeader) > scan->size || is_replay_header(scan, next);
+}
+
+bool replay_take_chunk(ReplayScan *scan, size_t *start, size_t *end) {
+    // cuts the next chunk at a record boundary, only the headers are read here
+    pthread_mutex_lock(&scan->lock);
+    *start = scan->offset;
+    bool lost = false;
+    while (scan->offset - *start < REPLAY_CHUNK && scan->offset + sizeof(ReplayHeader) <= scan->size) {
+        size_t size;
+        if (!replay_record_at(scan, scan->offset, scan->size, &size)) {
+            // records are 4-byte aligned, look for the next one from there, counting the stretch once
+            if (!lost) ++scan->damaged;
+            lost = true;
+            scan->offset += 4;
+            continue;
+        }
+        lost = false;
+        scan->offset += size;
+    }
+    if (scan->offset + sizeof(ReplayHeader) > scan->size) {
+        // whatever is left can't hold a whole record
+        if (scan->offset < scan->size && !lost) ++scan->damaged;
+        scan->offset = scan->size;
+    }
+    *end = scan->offset;
+    pthread_mutex_unlock(&scan->lock);
+    return *end > *start;
+}
+
+bool replay_seen(ReplayWorker *worker, uint64_t key) {
+    // adds key to the positions of the current game, true if it was there already
+    uint32_t mask = worker->capacity - 1;
+    for (uint32_t i = (uint32_t) key & mask;; i = (i + 1) & mask) {
+        if (worker->stamps[i] != worker->stamp) {
+            worker->stamps[i] = worker->stamp;
+            worker->seen[i] = key;
+            return false;
+        }
+        if (worker->seen[i] == key) return true;
+    }
+}
+
+bool replay_game(ReplayWorker *worker, const ReplayHeader *header, const uint32_t *events) {
+    // plays one record back, false if it's damaged
+    ReplayStats *stats = &worker->stats;
+    if (replay_checksum(header, events) != header->checksum) return false;
+
+    // the position table needs room for every move of this game at most half full
+    if (header->events + 1 > worker->capacity / 2) {
+        uint32_t capacity = worker->capacity ? worker->capacity : 1024;
+        while (header->events + 1 > capacity / 2) capacity *= 2;
+        uint64_t *seen = malloc(capacity * sizeof(uint64_t));
+        uint32_t *stamps = calloc(capacity, sizeof(uint32_t));
+        if (!seen || !stamps) {
+            free(seen);
+            free(stamps);
+            return false;
+        }
+        free(worker->seen);
+        free(worker->stamps);
+        worker->seen = seen, worker->stamps = stamps, worker->capacity = capacity, worker->stamp = 0;
+    }
+    if (++worker->stamp == 0) {
+        memset(worker->stamps, 0, worker->capacity * sizeof(uint32_t));
+        worker->stamp = 1;
+    }
+
+    Game *game = worker->game;
+    PackedGame start = header->start, last, now;
+    unpack_game(&start, game);
+    game->seed = header->seed;
+    game->selected = load_pos(header->selected);
+    game->moving = load_pos(header->moving);
+    update_display(game);
+    pack_game(game, &last);
+    replay_seen(worker, hash_packed(&last));
+
+    uint64_t moves = 0, recycles = 0, millis = 0, actions[REPLAY_ACTIONS] = {0};
+    for (uint32_t i = 0; i < header->events; ++i) {
+        uint32_t action = events[i] & ((1u << REPLAY_ACTION_BITS) - 1);
+        millis += events[i] >> REPLAY_ACTION_BITS;
+        ++actions[action];
+        // the arrows only move the cursor, which leaves the highlights update_display() works out as they were,
+        // so only confirm and cancel need it to match what the game showed
+        bool handled = handle_action((Action) action, game);
+        if (action != CONFIRM && action != CANCEL) continue;
+        update_display(game);
+        if (!handled || action != CONFIRM) continue;
+        pack_game(game, &now);
+        if (memcmp(&now, &last, sizeof(PackedGame)) == 0) continue;
+        ++moves;
+        if (last.stock_count == 0 && now.stock_count > 0) ++recycles;
+        if (replay_seen(worker, hash_packed(&now))) ++stats->returns;
+        last = now;
+    }
+
+    ++stats->games;
+    for (int i = 0; i < REPLAY_ACTIONS; ++i) stats->actions[i] += actions[i];
+    stats->moves += moves;
+    stats->recycles += recycles;
+    histogram_add(&stats->moves_per_game, moves);
+    histogram_add(&stats->actions_per_game, header->events);
+    histogram_add(&stats->recycles_per_game, recycles);
+    if (is_game_won(game)) {
+        ++stats->won;
+        histogram_add(&stats->win_millis, millis);
+    }
+    return true;
+}
+
+void *replay_thread(void *arg) {
+    ReplayWorker *worker = arg;
+    ReplayScan *scan = worker->scan;
+    long page = sysconf(_SC_PAGESIZE);
+    size_t start, end;
+    while (replay_take_chunk(scan, &start, &end)) {
+        bool lost = false;
+        for (size_t offset = start; offset + sizeof(ReplayHeader) <= end;) {
+            size_t size;
+            if (!replay_record_at(scan, offset, end, &size)) {
+                // already counted when the chunk was cut
+                offset += 4;
+                continue;
+            }
+            const ReplayHeader *header = (const ReplayHeader *) (scan->map + offset);
+            if (replay_game(worker, header, (const uint32_t *) (header + 1))) {
+                lost = false;
+                offset += size;
+                continue;
+            }
+            // a bad checksum means its size can't be trusted either, the records it seems to cover may be whole
+            if (!lost) ++worker->stats.damaged;
+            lost = true;
+            offset += 4;
+        }
+        worker->stats.bytes += end - start;
+        // done with these pages, dropping them keeps memory flat however big the archive is
+        size_t first = (start + page - 1) / page * page, last = end / page * page;
+        if (last > first) madvise((void *) (scan->map + first), last - first, MADV_DONTNEED);
+    }
+    return NULL;
+}
+
+bool analyze_replays(const char *path, int threads, ReplayStats *stats) {
+    // plays every record of an archive back, adding to stats, false (with errno set) if it can't be read
+    if (threads < 1) threads = 1;
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        if (fd >= 0) close(fd);
+        return false;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        return true;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    ReplayWorker *workers = calloc(threads, sizeof(ReplayWorker));
+    bool ok = map != MAP_FAILED && workers;
+    for (int t = 0; ok && t < threads; ++t) ok = (workers[t].game = malloc(sizeof(Game))) != NULL;
+
+    if (ok) {
+        madvise(map, st.st_size, MADV_SEQUENTIAL);
+        ReplayScan scan = {map, st.st_size, 0, 0};
+        pthread_mutex_init(&scan.lock, NULL);
+        for (int t = 0; t < threads; ++t) workers[t].scan = &scan;
+        run_workers(replay_thread, workers, sizeof(ReplayWorker), threads);
+        pthread_mutex_destroy(&scan.lock);
+        stats->damaged += scan.damaged;
+    }
+
+    int saved = errno;
+    for (int t = 0; workers && t < threads; ++t) {
+        merge_replay_stats(stats, &workers[t].stats);
+        free(workers[t].game);
+        free(workers[t].seen);
+        free(workers[t].stamps);
+    }
+    if (map != MAP_FAILED) munmap(map, st.st_size);
+    free(workers);
+    errno = saved;
+    return ok;
+}
+
+void print_replay_stats(FILE *file, const ReplayStats *stats, bool json) {
+    // CSV is one metric per row, counters only fill in the count
+    const char *names[] = {"moves_per_game", "actions_per_game", "recycles_per_game", "win_millis"};
+    const Histogram *histograms[] = {&stats->moves_per_game, &stats->actions_per_game, &stats->recycles_per_game, &stats->win_millis};
+    const char *counter_names[] = {"games", "won", "damaged", "bytes", "moves", "returns", "recycles"};
+    uint64_t counters[] = {stats->games, stats->won, stats->damaged, stats->bytes, stats->moves, stats->returns, stats->recycles};
+    int histogram_count = sizeof(histograms) / sizeof(histograms[0]), counter_count = sizeof(counters) / sizeof(counters[0]);
+
+    if (!json) {
+        fprintf(file, "metric,count,mean,p50,p90,p99,max\n");
+        for (int i = 0; i < counter_count; ++i) fprintf(file, "%s,%lu,,,,,\n", counter_names[i], (unsigned long) counters[i]);
+        for (int i = 0; i < REPLAY_ACTIONS; ++i) {
+            fprintf(file, "action_%s,%lu,,,,,\n", replay_action_names[i], (unsigned long) stats->actions[i]);
+        }
+    } else {
+        fprintf(file, "{");
+        for (int i = 0; i < counter_count; ++i) fprintf(file, "\"%s\": %lu, ", counter_names[i], (unsigned long) counters[i]);
+        fprintf(file, "\"actions\": {");
+        for (int i = 0; i < REPLAY_ACTIONS; ++i) {
+            fprintf(file, "%s\"%s\": %lu", i ? ", " : "", replay_action_names[i], (unsigned long) stats->actions[i]);
+        }
+        fprintf(file, "}");
+    }
+    for (int i = 0; i < histogram_count; ++i) {
+        const Histogram *histogram = histograms[i];
+        double mean = histogram->count ? (double) histogram->sum / (double) histogram->count : 0;
+        unsigned long p50 = histogram_quantile(histogram, 0.5), p90 = histogram_quantile(histogram, 0.9);
+        unsigned long p99 = histogram_quantile(histogram, 0.99), max = histogram->max;
+        if (!json) {
+            fprintf(file, "%s,%lu,%.2f,%lu,%lu,%lu,%lu\n", names[i], (unsigned long) histogram->count, mean, p50, p90, p99, max);
+        } else {
+            fprintf(file, ", \"%s\": {\"count\": %lu, \"mean\": %.2f, \"p50\": %lu, \"p90\": %lu, \"p99\": %lu, \"max\": %lu}",
+                    names[i], (unsigned long) histogram->count, mean, p50, p90, p99, max);
+        }
+    }
+    if (json) fprintf(file, "}\n");
+}
+
+#endif
+#endif
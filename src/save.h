@@ -0,0 +1,412 @@
+#ifndef SOLITAIRE_SAVE
+#define SOLITAIRE_SAVE
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "./cards.h"
+
+#define SAVE_MAGIC "SOLSAVE\0"
+#define SAVE_VERSION (1 | LAYOUT_VERSION)
+
+// the journal gets folded into a checkpoint after this many actions
+#define SAVE_COMPACT_EVERY 256
+#define SAVE_QUEUE_SIZE 1024
+
+typedef struct {
+    uint8_t active;
+    uint8_t location;
+    uint8_t column;
+    uint8_t row;
+} SavedPos;
+
+typedef struct {
+    uint64_t generation; // the newest valid slot wins
+    uint64_t sequence; // number of actions folded into this checkpoint since the deal
+    uint32_t game; // which game the journal records belong to, bumped on every new deal
+    uint32_t seed;
+    SavedPos selected;
+    SavedPos moving;
+    PackedGame packed;
+    uint32_t checksum;
+} SaveCheckpoint;
+
+typedef struct {
+    // the state file, mapped, two checkpoint slots so a torn write always leaves the other one intact
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    SaveCheckpoint slots[2];
+} SaveFile;
+
+typedef struct {
+    // one journal record per handle_action call, appended after the newest checkpoint
+    uint32_t sequence;
+    uint16_t game;
+    uint8_t action;
+    uint8_t reserved;
+    uint32_t checksum;
+} SaveRecord;
+
+typedef enum {
+    SAVE_ACTION, SAVE_COMPACT, SAVE_FLUSH
+} SaveItemType;
+
+typedef struct {
+    SaveItemType type;
+    SaveRecord record;
+} SaveItem;
+
+typedef struct {
+    SaveFile *file;
+    int fd; // the state file, held open for its lock
+    int journal;
+    off_t journal_size; // where the last complete batch of records ends, only the writer thread touches it
+    bool journal_broken; // a write failed, actions aren't journaled again until the next checkpoint is on disk
+    int error; // errno of the first write that failed, 0 if none did
+    uint64_t sequence; // actions since the deal
+    uint64_t checkpoint; // sequence of the newest checkpoint
+    uint64_t generation;
+    uint32_t game;
+
+    // actions are queued here and written (and fsynced in batches) by the writer thread
+    pthread_t writer;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t drained;
+    SaveItem queue[SAVE_QUEUE_SIZE];
+    unsigned int head, tail;
+    bool stopping;
+} Save;
+
+Save *open_save(const char *path);
+bool resume_save(Save *save, Game *game);
+void save_new_game(Save *save, Game *game);
+void save_action(Save *save, Game *game, Action action);
+bool close_save(Save *save, Game *game);
+char *default_save_path();
+
+#ifdef SOLITAIRE_SAVE_IMPLEMENTATION
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+uint32_t save_checksum(const void *data, size_t size) {
+    // FNV-1a
+    const uint8_t *bytes = data;
+    uint32_t hash = 0x811c9dc5;
+    for (size_t i = 0; i < size; ++i) hash = (hash ^ bytes[i]) * 0x01000193;
+    return hash;
+}
+
+SavedPos save_pos(CardPos pos) {
+    return (SavedPos) {pos.active, pos.location, pos.column, pos.row};
+}
+
+CardPos load_pos(SavedPos pos) {
+    return (CardPos) {pos.active, pos.location, pos.column, pos.row};
+}
+
+bool make_parent_dirs(const char *path) {
+    // mkdir -p for everything before the last slash
+    char buffer[4096];
+    if (strlen(path) >= sizeof(buffer)) return false;
+    strcpy(buffer, path);
+    for (char *slash = strchr(buffer + 1, '/'); slash; slash = strchr(slash + 1, '/')) {
+        *slash = '\0';
+        if (mkdir(buffer, 0755) != 0 && errno != EEXIST) return false;
+        *slash = '/';
+    }
+    return true;
+}
+
+char *default_save_path() {
+    // $XDG_STATE_HOME/solitaire/save, or ~/.local/state/solitaire/save
+    static char path[4096];
+    char *state = getenv("XDG_STATE_HOME");
+    char *home = getenv("HOME");
+    if (state && *state) snprintf(path, sizeof(path), "%s/%s/save", state, EXEC);
+    else if (home && *home) snprintf(path, sizeof(path), "%s/.local/state/%s/save", home, EXEC);
+    else return NULL;
+    return path;
+}
+
+void save_failed(Save *save) {
+    if (!save->error) save->error = errno ? errno : EIO;
+}
+
+bool write_journal(Save *save, SaveRecord *records, int count) {
+    // appends the records and syncs them, on any error the journal is cut back to where it was, so it never ends in a
+    // torn record that later batches would be appended after
+    const char *data = (const char *) records;
+    size_t size = count * sizeof(SaveRecord), done = 0;
+    while (done < size) {
+        ssize_t written = write(save->journal, data + done, size - done);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) {
+            if (written == 0) errno = ENOSPC;
+            break;
+        }
+        done += written;
+    }
+    if (done == size && fdatasync(save->journal) == 0) {
+        save->journal_size += size;
+        return true;
+    }
+    save_failed(save);
+    // if even this fails the torn record stays, but nothing goes after it until a checkpoint truncates the journal
+    if (ftruncate(save->journal, save->journal_size) != 0) save_failed(save);
+    return false;
+}
+
+void *save_writer_thread(void *arg) {
+    Save *save = arg;
+    SaveItem batch[SAVE_QUEUE_SIZE];
+    SaveRecord records[SAVE_QUEUE_SIZE];
+
+    pthread_mutex_lock(&save->lock);
+    while (true) {
+        while (save->head == save->tail && !save->stopping) {
+            pthread_cond_broadcast(&save->drained);
+            pthread_cond_wait(&save->wake, &save->lock);
+        }
+        if (save->head == save->tail && save->stopping) break;
+
+        // take everything that's queued, then write it without holding the lock
+        int count = 0;
+        while (save->tail != save->head) {
+            batch[count++] = save->queue[save->tail % SAVE_QUEUE_SIZE];
+            ++save->tail;
+        }
+        pthread_cond_broadcast(&save->drained);
+        pthread_mutex_unlock(&save->lock);
+
+        for (int i = 0; i < count;) {
+            int records_count = 0;
+            while (i < count && batch[i].type == SAVE_ACTION) records[records_count++] = batch[i++].record;
+            // after a failed write the journal would have a gap, resume stops at it, so until the next checkpoint the
+            // actions are only in memory
+            if (records_count > 0 && !save->journal_broken) save->journal_broken = !write_journal(save, records, records_count);
+            if (i < count && batch[i].type == SAVE_COMPACT) {
+                // the checkpoint has to be on disk before the journal it replaces goes away
+                // anything queued after it hasn't been written yet, so nothing newer is lost
+                if (msync(save->file, sizeof(SaveFile), MS_SYNC) != 0) {
+                    save_failed(save);
+                } else if (ftruncate(save->journal, 0) != 0) {
+                    save_failed(save);
+                } else {
+                    save->journal_size = 0;
+                    save->journal_broken = false;
+                }
+                ++i;
+            } else if (i < count && batch[i].type == SAVE_FLUSH) {
+                if (msync(save->file, sizeof(SaveFile), MS_SYNC) != 0) save_failed(save);
+                ++i;
+            }
+        }
+        pthread_mutex_lock(&save->lock);
+    }
+    pthread_cond_broadcast(&save->drained);
+    pthread_mutex_unlock(&save->lock);
+    return NULL;
+}
+
+void save_enqueue(Save *save, SaveItem item) {
+    pthread_mutex_lock(&save->lock);
+    // only waits if the disk is so slow that a whole queue of actions is still pending
+    while (save->head - save->tail >= SAVE_QUEUE_SIZE) pthread_cond_wait(&save->drained, &save->lock);
+    save->queue[save->head % SAVE_QUEUE_SIZE] = item;
+    ++save->head;
+    pthread_cond_signal(&save->wake);
+    pthread_mutex_unlock(&save->lock);
+}
+
+Save *open_save(const char *path) {
+    // opens (or creates) the state file at path and the journal next to it
+    // the state file stays locked while it is open, another game saving to it fails with EWOULDBLOCK
+    if (!make_parent_dirs(path)) return NULL;
+    char journal_path[4096];
+    if (snprintf(journal_path, sizeof(journal_path), "%s.journal", path) >= (int) sizeof(journal_path)) return NULL;
+
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) return NULL;
+    if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+        int error = errno;
+        close(fd);
+        errno = error;
+        return NULL;
+    }
+    struct stat st;
+    bool fresh = fstat(fd, &st) == 0 && (size_t) st.st_size < sizeof(SaveFile);
+    if (fresh && ftruncate(fd, sizeof(SaveFile)) != 0) {
+        close(fd);
+        return NULL;
+    }
+    SaveFile *file = mmap(NULL, sizeof(SaveFile), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (file == MAP_FAILED) {
+        close(fd);
+        return NULL;
+    }
+    if (fresh || memcmp(file->magic, SAVE_MAGIC, 8) != 0 || file->version != SAVE_VERSION) {
+        memset(file, 0, sizeof(SaveFile));
+        memcpy(file->magic, SAVE_MAGIC, 8);
+        file->version = SAVE_VERSION;
+    }
+
+    int journal = open(journal_path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (journal < 0) {
+        munmap(file, sizeof(SaveFile));
+        close(fd);
+        return NULL;
+    }
+
+    Save *save = calloc(1, sizeof(Save));
+    if (!save) {
+        close(journal);
+        munmap(file, sizeof(SaveFile));
+        close(fd);
+        return NULL;
+    }
+    save->file = file;
+    save->fd = fd;
+    save->journal = journal;
+    save->journal_size = lseek(journal, 0, SEEK_END);
+    if (save->journal_size < 0) save->journal_size = 0;
+    pthread_mutex_init(&save->lock, NULL);
+    pthread_cond_init(&save->wake, NULL);
+    pthread_cond_init(&save->drained, NULL);
+    if (pthread_create(&save->writer, NULL, save_writer_thread, save) != 0) {
+        close(journal);
+        munmap(file, sizeof(SaveFile));
+        close(fd);
+        free(save);
+        return NULL;
+    }
+    return save;
+}
+
+SaveCheckpoint *newest_checkpoint(Save *save) {
+    SaveCheckpoint *newest = NULL;
+    for (int i = 0; i < 2; ++i) {
+        SaveCheckpoint *slot = &save->file->slots[i];
+        if (slot->checksum == 0 || slot->checksum != save_checksum(slot, offsetof(SaveCheckpoint, checksum))) continue;
+        if (!newest || slot->generation > newest->generation) newest = slot;
+    }
+    return newest;
+}
+
+void write_checkpoint(Save *save, Game *game) {
+    // overwrite the older slot, the newer one stays valid until this one is complete
+    SaveCheckpoint *newest = newest_checkpoint(save);
+    SaveCheckpoint *slot = newest == &save->file->slots[0] ? &save->file->slots[1] : &save->file->slots[0];
+    SaveCheckpoint checkpoint = {++save->generation, save->sequence, save->game, game->seed, save_pos(game->selected), save_pos(game->moving), {}, 0};
+    pack_game(game, &checkpoint.packed);
+    checkpoint.checksum = save_checksum(&checkpoint, offsetof(SaveCheckpoint, checksum));
+    if (!checkpoint.checksum) checkpoint.checksum = 1;
+    slot->checksum = 0;
+    memcpy(slot, &checkpoint, offsetof(SaveCheckpoint, checksum));
+    __atomic_store_n(&slot->checksum, checkpoint.checksum, __ATOMIC_RELEASE);
+    save->checkpoint = save->sequence;
+}
+
+bool resume_save(Save *save, Game *game) {
+    // loads the newest checkpoint and replays the journal on top of it
+    // returns false if there is nothing to resume
+    SaveCheckpoint *checkpoint = newest_checkpoint(save);
+    if (!checkpoint) return false;
+
+    unpack_game(&checkpoint->packed, game);
+    game->seed = checkpoint->seed;
+    game->selected = load_pos(checkpoint->selected);
+    game->moving = load_pos(checkpoint->moving);
+    save->sequence = save->checkpoint = checkpoint->sequence;
+    save->generation = checkpoint->generation;
+    save->game = checkpoint->game;
+
+    // records older than the checkpoint are left over from before a compaction, a gap or bad checksum is a torn tail
+    SaveRecord records[256];
+    ssize_t got;
+    off_t offset = 0;
+    bool done = false;
+    while (!done && (got = pread(save->journal, records, sizeof(records), offset)) > 0) {
+        offset += got;
+        for (size_t i = 0; i < (size_t) got / sizeof(SaveRecord); ++i) {
+            SaveRecord *record = &records[i];
+            if (record->checksum != save_checksum(record, offsetof(SaveRecord, checksum))) {
+                done = true;
+                break;
+            }
+            if (record->game != (uint16_t) save->game || record->sequence <= (uint32_t) save->sequence) continue;
+            if (record->sequence != (uint32_t) save->sequence + 1) {
+                done = true;
+                break;
+            }
+            handle_action(record->action, game);
+            update_display(game);
+            ++save->sequence;
+        }
+    }
+    update_display(game);
+    return true;
+}
+
+void save_new_game(Save *save, Game *game) {
+    // starts the save over from a fresh deal
+    SaveCheckpoint *newest = newest_checkpoint(save);
+    if (newest) {
+        save->generation = newest->generation;
+        save->game = newest->game + 1;
+    }
+    save->sequence = 0;
+    write_checkpoint(save, game);
+    save_enqueue(save, (SaveItem) {SAVE_COMPACT});
+}
+
+void save_action(Save *save, Game *game, Action action) {
+    // call after handle_action, never blocks on the disk
+    SaveRecord record = {(uint32_t) ++save->sequence, (uint16_t) save->game, action, 0, 0};
+    record.checksum = save_checksum(&record, offsetof(SaveRecord, checksum));
+    save_enqueue(save, (SaveItem) {SAVE_ACTION, record});
+
+    if (save->sequence - save->checkpoint >= SAVE_COMPACT_EVERY) {
+        write_checkpoint(save, game);
+        save_enqueue(save, (SaveItem) {SAVE_COMPACT});
+    }
+}
+
+bool close_save(Save *save, Game *game) {
+    // folds the journal into a final checkpoint and waits for the writer to finish
+    // returns false with errno set if any write failed, the game is saved up to the last write that didn't
+    if (!save) return true;
+    if (game) {
+        write_checkpoint(save, game);
+        save_enqueue(save, (SaveItem) {SAVE_COMPACT});
+    }
+    save_enqueue(save, (SaveItem) {SAVE_FLUSH});
+    pthread_mutex_lock(&save->lock);
+    save->stopping = true;
+    pthread_cond_signal(&save->wake);
+    pthread_mutex_unlock(&save->lock);
+    pthread_join(save->writer, NULL);
+
+    int error = save->error;
+    close(save->journal);
+    munmap(save->file, sizeof(SaveFile));
+    close(save->fd);
+    pthread_mutex_destroy(&save->lock);
+    pthread_cond_destroy(&save->wake);
+    pthread_cond_destroy(&save->drained);
+    free(save);
+    errno = error;
+    return !error;
+}
+
+#endif
+#endif
@@ -0,0 +1,482 @@
+#ifndef SOLITAIRE_SERVE
+#define SOLITAIRE_SERVE
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "./cards.h"
+
+// line protocol for driving many games from one process, one request per line, one response line each
+//   new ID SEED     deal a game (replaces any game with that ID)    -> ok ID
+//   move ID MOVE    apply a move written like format_move          -> ok ID [won] | err ID illegal
+//   state ID        packed layout (PackedGame) in hex              -> ok ID HEX
+//   legal ID        legal moves                                    -> ok ID COUNT MOVE...
+//   undo ID         take back the last move                        -> ok ID | err ID nothing to undo
+//   free ID         forget a game                                  -> ok ID
+// every command can be shortened to its first letter, IDs are unsigned 64-bit numbers, seeds unsigned 32-bit ones
+// written in plain decimal digits, a malformed ID or an argument a command doesn't take is answered with err
+// requests are read and answered in batches, so pipelining many requests per write is cheap
+// on the socket every client has its own output buffer, a client that doesn't read its responses only holds up itself
+
+typedef struct {
+    uint64_t id;
+    Game *game; // NULL if the slot is empty
+    PackedGame *history; // layouts before each move, for undo
+    int history_count;
+    int history_size;
+} ServeGame;
+
+typedef struct {
+    ServeGame *slots; // open addressing on the ID
+    size_t mask;
+    size_t count;
+} ServeTable;
+
+typedef struct {
+    char *data;
+    size_t length;
+    size_t size;
+} ServeBuffer;
+
+void serve_request(ServeTable *table, char *line, ServeBuffer *out);
+bool serve_stream(int in, int out);
+bool serve_socket(const char *path, bool *running);
+void free_serve_table(ServeTable *table);
+
+#ifdef SOLITAIRE_SERVE_IMPLEMENTATION
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define SERVE_READ_SIZE 65536
+#define SERVE_MAX_CLIENTS 256
+#define SERVE_MAX_PENDING (4 << 20) // unsent response bytes after which a client's requests wait until it reads
+
+typedef enum {
+    SERVE_NEW, SERVE_MOVE, SERVE_STATE, SERVE_LEGAL, SERVE_UNDO, SERVE_FREE, SERVE_UNKNOWN
+} ServeCommand;
+
+static const char *serve_command_names[] = {"new", "move", "state", "legal", "undo", "free"};
+
+bool buffer_reserve(ServeBuffer *buffer, size_t extra) {
+    if (buffer->length + extra <= buffer->size) return true;
+    size_t size = buffer->size ? buffer->size : 4096;
+    while (size < buffer->length + extra) size *= 2;
+    char *data = realloc(buffer->data, size);
+    if (!data) return false;
+    buffer->data = data;
+    buffer->size = size;
+    return true;
+}
+
+void buffer_printf(ServeBuffer *buffer, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+    if (length < 0 || !buffer_reserve(buffer, length + 1)) return;
+    va_start(args, format);
+    vsnprintf(buffer->data + buffer->length, length + 1, format, args);
+    va_end(args);
+    buffer->length += length;
+}
+
+uint64_t serve_hash(uint64_t id) {
+    id ^= id >> 33;
+    id *= 0xff51afd7ed558ccd;
+    return id ^ id >> 33;
+}
+
+ServeGame *serve_find(ServeTable *table, uint64_t id, bool create) {
+    // finds the game with an ID, or the empty slot it would go in when create is set
+    if (create && (table->count + 1) * 2 > table->mask + 1) {
+        // grow, keeping the table at most half full
+        size_t size = table->slots ? (table->mask + 1) * 2 : 1024;
+        ServeGame *slots = calloc(size, sizeof(ServeGame));
+        if (!slots) return NULL;
+        for (size_t i = 0; table->slots && i <= table->mask; ++i) {
+            if (!table->slots[i].game) continue;
+            size_t j = serve_hash(table->slots[i].id) & (size - 1);
+            while (slots[j].game) j = (j + 1) & (size - 1);
+            slots[j] = table->slots[i];
+        }
+        free(table->slots);
+        table->slots = slots;
+        table->mask = size - 1;
+    }
+    if (!table->slots) return NULL;
+    for (size_t i = serve_hash(id) & table->mask;; i = (i + 1) & table->mask) {
+        ServeGame *slot = &table->slots[i];
+        if (slot->game && slot->id == id) return slot;
+        if (!slot->game) return create ? slot : NULL;
+    }
+}
+
+void serve_remove(ServeTable *table, ServeGame *slot) {
+    // backward shift deletion, so lookups never need tombstones
+    free(slot->game);
+    free(slot->history);
+    size_t i = slot - table->slots;
+    table->slots[i] = (ServeGame) {0};
+    --table->count;
+    for (size_t j = (i + 1) & table->mask; table->slots[j].game; j = (j + 1) & table->mask) {
+        size_t home = serve_hash(table->slots[j].id) & table->mask;
+        // move the entry back if its home isn't cyclically in (i, j]
+        if (((j - home) & table->mask) >= ((j - i) & table->mask)) {
+            table->slots[i] = table->slots[j];
+            table->slots[j] = (ServeGame) {0};
+            i = j;
+        }
+    }
+}
+
+void free_serve_table(ServeTable *table) {
+    for (size_t i = 0; table->slots && i <= table->mask; ++i) {
+        free(table->slots[i].game);
+        free(table->slots[i].history);
+    }
+    free(table->slots);
+    *table = (ServeTable) {0};
+}
+
+bool serve_push_history(ServeGame *slot) {
+    if (slot->history_count == slot->history_size) {
+        int size = slot->history_size ? slot->history_size * 2 : 64;
+        PackedGame *history = realloc(slot->history, size * sizeof(PackedGame));
+        if (!history) return false;
+        slot->history = history;
+        slot->history_size = size;
+    }
+    pack_game(slot->game, &slot->history[slot->history_count++]);
+    return true;
+}
+
+bool is_legal_move(Game *game, Move move) {
+    Move moves[MAX_LEGAL_MOVES];
+    int count = get_legal_moves(game, moves);
+    for (int i = 0; i < count; ++i) {
+        if (moves[i].from.location != move.from.location) continue;
+        if (move.from.location == STOCK) return true;
+        if (is_same_pos(moves[i].from, move.from) && is_same_pos(moves[i].to, move.to)) return true;
+    }
+    return false;
+}
+
+ServeCommand parse_serve_command(const char *word, size_t length) {
+    // a whole command name or its first letter
+    for (int command = 0; command < SERVE_UNKNOWN; ++command) {
+        const char *name = serve_command_names[command];
+        if (length == 1 ? *word == *name : length == strlen(name) && memcmp(word, name, length) == 0) return command;
+    }
+    return SERVE_UNKNOWN;
+}
+
+void serve_request(ServeTable *table, char *line, ServeBuffer *out) {
+    // handles one request line (without the newline) and appends the response line to out
+    char *command = line;
+    while (*command == ' ') ++command;
+    if (!*command) return;
+    char *end = command;
+    while (*end && *end != ' ') ++end;
+    ServeCommand kind = parse_serve_command(command, end - command);
+    char *id_text = end;
+    while (*id_text == ' ') ++id_text;
+    errno = 0;
+    uint64_t id = strtoull(id_text, &end, 10);
+    if (!*id_text) {
+        buffer_printf(out, "err - missing id\n");
+        return;
+    }
+    // strtoull() would take a sign (wrapping a negative ID around) and stop at the first thing that isn't a digit
+    if (*id_text < '0' || *id_text > '9' || (*end && *end != ' ') || errno == ERANGE) {
+        buffer_printf(out, "err - bad id\n");
+        return;
+    }
+    char *argument = end;
+    while (*argument == ' ') ++argument;
+    if (*argument && kind != SERVE_NEW && kind != SERVE_MOVE && kind != SERVE_UNKNOWN) {
+        buffer_printf(out, "err %lu unexpected argument\n", (unsigned long) id);
+        return;
+    }
+
+    ServeGame *slot;
+    switch (kind) {
+        case SERVE_NEW: {
+            if (!*argument) {
+                buffer_printf(out, "err %lu missing seed\n", (unsigned long) id);
+                return;
+            }
+            char *seed_end;
+            errno = 0;
+            unsigned long long seed = strtoull(argument, &seed_end, 10);
+            while (*seed_end == ' ') ++seed_end;
+            if (*argument < '0' || *argument > '9' || *seed_end || errno == ERANGE || seed > UINT_MAX) {
+                buffer_printf(out, "err %lu bad seed\n", (unsigned long) id);
+                return;
+            }
+            slot = serve_find(table, id, true);
+            if (!slot) {
+                buffer_printf(out, "err %lu out of memory\n", (unsigned long) id);
+                return;
+            }
+            if (!slot->game) {
+                slot->game = malloc(sizeof(Game));
+                if (!slot->game) {
+                    buffer_printf(out, "err %lu out of memory\n", (unsigned long) id);
+                    return;
+                }
+                slot->id = id;
+                ++table->count;
+            }
+            slot->history_count = 0;
+            deal_game(slot->game, (unsigned int) seed);
+            buffer_printf(out, "ok %lu\n", (unsigned long) id);
+            return;
+        }
+        case SERVE_FREE:
+            slot = serve_find(table, id, false);
+            if (slot) serve_remove(table, slot);
+            buffer_printf(out, "ok %lu\n", (unsigned long) id);
+            return;
+        case SERVE_MOVE:
+        case SERVE_LEGAL:
+        case SERVE_STATE:
+        case SERVE_UNDO:
+            break;
+        default:
+            buffer_printf(out, "err %lu unknown command\n", (unsigned long) id);
+            return;
+    }
+
+    slot = serve_find(table, id, false);
+    if (!slot) {
+        buffer_printf(out, "err %lu no such game\n", (unsigned long) id);
+        return;
+    }
+    Game *game = slot->game;
+
+    if (kind == SERVE_MOVE) {
+        Move move;
+        if (!parse_move(game, argument, &move) || !is_legal_move(game, move)) {
+            buffer_printf(out, "err %lu illegal\n", (unsigned long) id);
+            return;
+        }
+        if (!serve_push_history(slot)) {
+            buffer_printf(out, "err %lu out of memory\n", (unsigned long) id);
+            return;
+        }
+        if (!apply_move(game, move)) {
+            --slot->history_count;
+            buffer_printf(out, "err %lu illegal\n", (unsigned long) id);
+            return;
+        }
+        buffer_printf(out, is_game_won(game) ? "ok %lu won\n" : "ok %lu\n", (unsigned long) id);
+    } else if (kind == SERVE_LEGAL) {
+        Move moves[MAX_LEGAL_MOVES];
+        int count = get_legal_moves(game, moves);
+        buffer_printf(out, "ok %lu %d", (unsigned long) id, count);
+        char text[16];
+        for (int i = 0; i < count; ++i) buffer_printf(out, " %s", format_move(moves[i], text));
+        buffer_printf(out, "\n");
+    } else if (kind == SERVE_STATE) {
+        PackedGame packed;
+        pack_game(game, &packed);
+        if (!buffer_reserve(out, 32 + sizeof(PackedGame) * 2)) return;
+        buffer_printf(out, "ok %lu ", (unsigned long) id);
+        static const char digits[] = "0123456789abcdef";
+        uint8_t *bytes = (uint8_t *) &packed;
+        for (size_t i = 0; i < sizeof(PackedGame); ++i) {
+            out->data[out->length++] = digits[bytes[i] >> 4];
+            out->data[out->length++] = digits[bytes[i] & 15];
+        }
+        out->data[out->length++] = '\n';
+    } else {
+        if (slot->history_count == 0) {
+            buffer_printf(out, "err %lu nothing to undo\n", (unsigned long) id);
+            return;
+        }
+        unsigned int seed = game->seed;
+        unpack_game(&slot->history[--slot->history_count], game);
+        game->seed = seed;
+        buffer_printf(out, "ok %lu\n", (unsigned long) id);
+    }
+}
+
+size_t serve_lines(ServeTable *table, char *data, size_t length, ServeBuffer *out) {
+    // handles every complete line in data, returns how many bytes were used
+    size_t used = 0;
+    for (size_t i = 0; i < length; ++i) {
+        if (data[i] != '\n') continue;
+        data[i] = '\0';
+        if (i > used && data[i - 1] == '\r') data[i - 1] = '\0';
+        serve_request(table, data + used, out);
+        used = i + 1;
+    }
+    return used;
+}
+
+bool write_all(int fd, const char *data, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += written;
+        length -= written;
+    }
+    return true;
+}
+
+typedef struct {
+    int fd;
+    char *input;
+    size_t input_length;
+    ServeBuffer output; // responses not written yet
+    size_t sent; // how much of output has been
+    bool closing; // the client stopped sending, it goes once the last responses are out
+} ServeClient;
+
+bool serve_read(ServeTable *table, ServeClient *client) {
+    // reads whatever is available and answers every complete request in it into the client's output
+    // returns false once the client stops sending
+    ssize_t got = read(client->fd, client->input + client->input_length, SERVE_READ_SIZE - client->input_length);
+    if (got < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)) return true;
+    if (got <= 0) return false;
+    client->input_length += got;
+
+    size_t used = serve_lines(table, client->input, client->input_length, &client->output);
+    memmove(client->input, client->input + used, client->input_length - used);
+    client->input_length -= used;
+    if (client->input_length == SERVE_READ_SIZE) {
+        // a line longer than the whole buffer, drop it
+        client->input_length = 0;
+        buffer_printf(&client->output, "err - line too long\n");
+    }
+    return true;
+}
+
+bool serve_flush(ServeClient *client) {
+    // writes as much of the output as the socket takes without blocking, false if the client is gone
+    ServeBuffer *output = &client->output;
+    while (client->sent < output->length) {
+        ssize_t written = write(client->fd, output->data + client->sent, output->length - client->sent);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) return false;
+            // drop what went out once it's most of the buffer, a client that never quite catches up keeps it bounded
+            if (client->sent * 2 > output->length) {
+                memmove(output->data, output->data + client->sent, output->length - client->sent);
+                output->length -= client->sent;
+                client->sent = 0;
+            }
+            return true;
+        }
+        client->sent += written;
+    }
+    output->length = client->sent = 0;
+    return true;
+}
+
+static inline size_t serve_pending(ServeClient *client) {
+    return client->output.length - client->sent;
+}
+
+bool serve_stream(int in, int out_fd) {
+    // serves requests from in until it closes, responses go to out_fd
+    ServeTable table = {0};
+    ServeClient client = {in, malloc(SERVE_READ_SIZE), 0, {0}, 0, false};
+    if (!client.input) return false;
+    while (serve_read(&table, &client)) {
+        if (!write_all(out_fd, client.output.data, client.output.length)) break;
+        client.output.length = 0;
+    }
+    free(client.input);
+    free(client.output.data);
+    free_serve_table(&table);
+    return true;
+}
+
+void close_serve_client(ServeClient *client) {
+    close(client->fd);
+    free(client->input);
+    free(client->output.data);
+}
+
+bool serve_socket(const char *path, bool *running) {
+    // serves clients on a unix socket until *running goes false, they all share the same games
+    // client sockets don't block, responses wait in each client's output until poll() says it can take them
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) return false;
+    struct sockaddr_un address = {0};
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        close(listener);
+        errno = ENAMETOOLONG;
+        return false;
+    }
+    strcpy(address.sun_path, path);
+    unlink(path);
+    if (bind(listener, (struct sockaddr *) &address, sizeof(address)) != 0 || listen(listener, 64) != 0) {
+        close(listener);
+        return false;
+    }
+
+    ServeTable table = {0};
+    struct pollfd fds[SERVE_MAX_CLIENTS + 1];
+    ServeClient clients[SERVE_MAX_CLIENTS];
+    int client_count = 0;
+    fds[0] = (struct pollfd) {listener, POLLIN, 0};
+
+    while (*running) {
+        for (int i = 0; i < client_count; ++i) {
+            // a client with a backlog of responses is only written to until it reads them
+            short events = (!clients[i].closing && serve_pending(&clients[i]) < SERVE_MAX_PENDING ? POLLIN : 0) |
+                           (serve_pending(&clients[i]) > 0 ? POLLOUT : 0);
+            fds[i + 1] = (struct pollfd) {clients[i].fd, events, 0};
+        }
+        if (poll(fds, client_count + 1, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        for (int i = client_count - 1; i >= 0; --i) {
+            short revents = fds[i + 1].revents;
+            if (!revents) continue;
+            ServeClient *client = &clients[i];
+            bool alive = !(revents & (POLLERR | POLLNVAL));
+            if (alive && (revents & (POLLIN | POLLHUP)) && !client->closing) client->closing = !serve_read(&table, client);
+            if (alive) alive = serve_flush(client);
+            if (!alive || (client->closing && serve_pending(client) == 0)) {
+                close_serve_client(client);
+                clients[i] = clients[--client_count];
+            }
+        }
+        if (fds[0].revents & POLLIN) {
+            int fd = accept(listener, NULL, NULL);
+            if (fd >= 0 && client_count < SERVE_MAX_CLIENTS && fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) == 0) {
+                clients[client_count] = (ServeClient) {fd, malloc(SERVE_READ_SIZE), 0, {0}, 0, false};
+                if (clients[client_count].input) ++client_count;
+                else close(fd);
+            } else if (fd >= 0) {
+                close(fd);
+            }
+        }
+    }
+
+    for (int i = 0; i < client_count; ++i) close_serve_client(&clients[i]);
+    close(listener);
+    unlink(path);
+    free_serve_table(&table);
+    return true;
+}
+
+#endif
+#endif
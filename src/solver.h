@@ -0,0 +1,352 @@
+#ifndef SOLITAIRE_SOLVER
+#define SOLITAIRE_SOLVER
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "./cards.h"
+#include "./poscache.h"
+
+typedef enum {
+    SOLVE_WON, SOLVE_LOST, SOLVE_GAVE_UP
+} SolveStatus;
+
+// deepest line the solver will follow
+#define SOLVER_MAX_DEPTH 400
+// mixed into canonical keys, so a cache shared by both key modes never mistakes one kind for the other
+#define SOLVER_CANONICAL_KEYS 0x9e3779b97f4a7c15ull
+
+typedef struct {
+    long node_limit; // give up after expanding this many positions
+    bool canonical; // treat positions with the same canonicalize_packed() form as one
+    PositionCache *cache; // solved positions shared across runs, or NULL
+} SolverOptions;
+
+typedef struct {
+    SolveStatus status;
+    int length; // moves in the solution
+    int cached; // the last moves of the solution, that a cache hit vouched for and that aren't in moves (plain keys only)
+    long nodes; // positions expanded
+    long states; // distinct positions put in the table (with canonical keys, one per canonical form)
+    long cache_lookups;
+    long cache_hits;
+    bool from_cache; // the deal itself was in the cache
+    Move moves[SOLVER_MAX_DEPTH]; // the solution, length - cached moves
+} SolveResult;
+
+typedef struct {
+    Game game;
+    Move moves[MAX_LEGAL_MOVES];
+    int count;
+    int next;
+    int draws; // draws in a row that led here, only counted with canonical keys
+} SolverFrame;
+
+typedef struct {
+    SolverOptions options;
+    uint64_t *table; // positions already searched, open addressing, 0 is empty
+    size_t table_mask;
+    SolverFrame *frames;
+} Solver;
+
+Solver *create_solver(SolverOptions options);
+void free_solver(Solver *solver);
+SolveStatus solve_game(Solver *solver, Game *game, SolveResult *result);
+bool replays_to_win(Game *game, SolveResult *result);
+int solve_difficulty(SolveResult *result, long node_limit);
+
+#ifdef SOLITAIRE_SOLVER_IMPLEMENTATION
+
+#include <string.h>
+
+Solver *create_solver(SolverOptions options) {
+    // one solver per thread, it owns the search stack and the table of visited positions
+    Solver *solver = malloc(sizeof(Solver));
+    if (!solver) return NULL;
+    if (options.node_limit < 1) options.node_limit = 200000;
+    solver->options = options;
+
+    // keep the table at most half full
+    size_t size = 1024;
+    while (size < (size_t) options.node_limit * 2) size <<= 1;
+    solver->table_mask = size - 1;
+    solver->table = malloc(size * sizeof(uint64_t));
+    solver->frames = malloc((SOLVER_MAX_DEPTH + 1) * sizeof(SolverFrame));
+    if (!solver->table || !solver->frames) {
+        free_solver(solver);
+        return NULL;
+    }
+    return solver;
+}
+
+void free_solver(Solver *solver) {
+    if (!solver) return;
+    free(solver->table);
+    free(solver->frames);
+    free(solver);
+}
+
+uint64_t solver_key(Solver *solver, Game *game) {
+    // the key for the table and the cache, never 0
+    PackedGame packed;
+    pack_game(game, &packed);
+    if (!solver->options.canonical) return hash_packed(&packed) | 1;
+    canonicalize_packed(&packed);
+    return (hash_packed(&packed) ^ SOLVER_CANONICAL_KEYS) | 1;
+}
+
+bool solver_visit(Solver *solver, uint64_t key) {
+    // marks a position as searched, returns false if it already was
+    for (size_t i = key & solver->table_mask;; i = (i + 1) & solver->table_mask) {
+        if (solver->table[i] == key) return false;
+        if (solver->table[i] == 0) {
+            solver->table[i] = key;
+            return true;
+        }
+    }
+}
+
+int stock_cycle_length(Game *game) {
+    // draws that go through every other position of the stock cycle, one more (the recycle) is back at the start
+    int cards = 0;
+    while (cards < PILE_SLOTS && game->stock[cards].rank != NO_RANK) ++cards;
+    for (int i = 0; i < PILE_SLOTS && game->waste[i].rank != NO_RANK; ++i) ++cards;
+    return cards;
+}
+
+int foundation_rank_of(Game *game, Suite suite) {
+    // the lowest of the suit's piles, 0 until every deck has one started
+    int piles = 0, lowest = KING;
+    for (int i = 0; i < FOUNDATION_PILES; ++i) {
+        if (game->foundation[i].rank != NO_RANK && game->foundation[i].suite == suite) {
+            if (game->foundation[i].rank < lowest) lowest = game->foundation[i].rank;
+            if (++piles == SOLITAIRE_DECKS) return lowest;
+        }
+    }
+    return 0;
+}
+
+bool is_safe_foundation_move(Game *game, Card card) {
+    // a card can always go up once nothing could ever need to stack on it
+    if (card.rank <= RANK2) return true;
+    int opposite = 99, same = 99;
+    for (Suite suite = HEARTS; suite <= SPADES; ++suite) {
+        if (suite == card.suite) continue;
+        int rank = foundation_rank_of(game, suite);
+        if (is_opposite_color(suite, card.suite)) {
+            if (rank < opposite) opposite = rank;
+        } else if (rank < same) {
+            same = rank;
+        }
+    }
+    return opposite >= card.rank - 1 && same >= card.rank - 2;
+}
+
+int solver_move_order(Game *game, Move move) {
+    // lower goes first, -1 drops the move
+    if (move.from.location == STOCK) return 5;
+    if (move.to.location == FOUNDATION) return 0;
+    if (move.from.location == FOUNDATION) return 6;
+    if (move.from.location == WASTE) return 3;
+
+    // tableau to tableau
+    Card *card = &game->tableau[move.from.column][move.from.row];
+    if (move.from.row == 0) {
+        // moving a king from one empty column to another never helps
+        return card->rank == KING ? -1 : 2;
+    }
+    Card *below = &game->tableau[move.from.column][move.from.row - 1];
+    if (!below->visible) return 1;
+
+    // splitting a run is only worth it if the card it uncovers can go up
+    for (int i = 0; i < FOUNDATION_PILES; ++i) {
+        if (can_stack(*below, game->foundation[i], true)) return 4;
+    }
+    return -1;
+}
+
+void solver_generate(SolverFrame *frame) {
+    Game *game = &frame->game;
+    Move moves[MAX_LEGAL_MOVES];
+    int count = get_legal_moves(game, moves);
+    frame->count = 0;
+    frame->next = 0;
+
+    // a safe move to the foundation is the only move worth trying
+    for (int i = 0; i < count; ++i) {
+        if (moves[i].to.location != FOUNDATION || moves[i].from.location == FOUNDATION) continue;
+        Card card;
+        if (moves[i].from.location == TABLEAU) card = game->tableau[moves[i].from.column][moves[i].from.row];
+        else card = *get_waste_top(game, false);
+        if (is_safe_foundation_move(game, card)) {
+            frame->moves[frame->count++] = moves[i];
+            return;
+        }
+    }
+
+    // stable sort by order, buckets are small
+    for (int order = 0; order <= 6; ++order) {
+        for (int i = 0; i < count; ++i) {
+            if (solver_move_order(game, moves[i]) == order) frame->moves[frame->count++] = moves[i];
+        }
+    }
+}
+
+int bit_length(long value) {
+    return value > 0 ? 64 - __builtin_clzll((unsigned long long) value) : 0;
+}
+
+SolveStatus solver_won(Solver *solver, SolveResult *result, int depth, int cached, uint64_t stamp) {
+    // the line through frames 0 to depth wins, with cached moves still to go after it
+    result->status = SOLVE_WON;
+    result->length = depth + cached;
+    result->cached = cached;
+    for (int i = 0; i < depth; ++i) result->moves[i] = solver->frames[i].moves[solver->frames[i].next - 1];
+
+    // every position on the line is won in the rest of it, and the whole deal took this much searching
+    // a canonical key also stands for the positions some draws away in the stock cycle, which are won too, but not
+    // in the same number of moves
+    PositionCache *cache = solver->options.cache;
+    if (cache) {
+        for (int i = 0; i <= depth; ++i) {
+            int effort = i == 0 ? bit_length(result->nodes - result->length) : 0;
+            int length = solver->options.canonical ? CACHE_UNKNOWN_LENGTH : result->length - i;
+            position_cache_put(cache, solver_key(solver, &solver->frames[i].game), stamp, (CacheEntry) {CACHE_WON, length, effort});
+        }
+    }
+    return SOLVE_WON;
+}
+
+SolveStatus solve_game(Solver *solver, Game *game, SolveResult *result) {
+    // depth first search with a table of searched positions
+    // moves that can't matter are pruned (see solver_move_order), so SOLVE_LOST means no solution within those moves
+    // with a cache, known losses are skipped, a win of known length ends the search, and what this search proves is added
+    // a win of unknown length (canonical keys) is searched again, for the line
+    memset(solver->table, 0, (solver->table_mask + 1) * sizeof(uint64_t));
+    result->nodes = 0;
+    result->states = 1;
+    result->length = 0;
+    result->cached = 0;
+    result->cache_lookups = 0;
+    result->cache_hits = 0;
+    result->from_cache = false;
+    result->status = SOLVE_LOST;
+
+    PositionCache *cache = solver->options.cache;
+    uint64_t stamp = cache ? position_cache_tick(cache) : 0;
+    bool truncated = false; // some line was cut off at SOLVER_MAX_DEPTH, so a loss isn't proven
+    CacheEntry entry;
+
+    int depth = 0;
+    solver->frames[0].game = *game;
+    solver->frames[0].draws = 0;
+    uint64_t key = solver_key(solver, game);
+    solver_visit(solver, key);
+    ++result->nodes;
+    long budget = solver->options.node_limit / 1000; // node limit as kept with CACHE_GAVE_UP
+    if (cache) {
+        ++result->cache_lookups;
+        if (position_cache_get(cache, key, stamp, &entry) && (entry.result != CACHE_GAVE_UP || budget <= entry.depth) &&
+            (entry.result != CACHE_WON || entry.depth != CACHE_UNKNOWN_LENGTH)) {
+            ++result->cache_hits;
+            result->from_cache = true;
+            if (entry.result == CACHE_LOST) return SOLVE_LOST;
+            if (entry.result == CACHE_GAVE_UP) {
+                result->nodes = solver->options.node_limit;
+                result->status = SOLVE_GAVE_UP;
+                return SOLVE_GAVE_UP;
+            }
+            // as if the deal had been searched again, so its difficulty comes out the same
+            result->nodes = entry.depth + (entry.effort ? 1L << (entry.effort - 1) : 0);
+            result->status = SOLVE_WON;
+            result->length = result->cached = entry.depth;
+            return SOLVE_WON;
+        }
+    }
+    solver_generate(&solver->frames[0]);
+
+    while (depth >= 0) {
+        SolverFrame *frame = &solver->frames[depth];
+        if (is_game_won(&frame->game)) return solver_won(solver, result, depth, 0, stamp);
+        if (frame->next >= frame->count || depth >= SOLVER_MAX_DEPTH) {
+            if (frame->next < frame->count) truncated = true;
+            --depth;
+            continue;
+        }
+        if (result->nodes >= solver->options.node_limit) {
+            result->status = SOLVE_GAVE_UP;
+            if (cache) position_cache_put(cache, solver_key(solver, game), stamp, (CacheEntry) {CACHE_GAVE_UP, (int) budget, 0});
+            return SOLVE_GAVE_UP;
+        }
+
+        SolverFrame *child = &solver->frames[depth + 1];
+        child->game = frame->game;
+        Move move = frame->moves[frame->next++];
+        if (!apply_move(&child->game, move)) continue;
+        if (solver->options.canonical && move.from.location == STOCK) {
+            // every draw leads back to the same canonical position, whose table entry stands for the whole stock cycle,
+            // so the cycle is walked here once, past the table, to reach the moves off each waste card
+            if (frame->draws >= stock_cycle_length(&frame->game)) continue;
+            child->draws = frame->draws + 1;
+        } else {
+            key = solver_key(solver, &child->game);
+            if (!solver_visit(solver, key)) continue;
+            ++result->states;
+            child->draws = 0;
+            if (cache) {
+                ++result->cache_lookups;
+                if (position_cache_get(cache, key, stamp, &entry) && entry.result != CACHE_GAVE_UP &&
+                    (entry.result != CACHE_WON || entry.depth != CACHE_UNKNOWN_LENGTH)) {
+                    ++result->cache_hits;
+                    if (entry.result == CACHE_LOST) continue;
+                    return solver_won(solver, result, depth + 1, entry.depth, stamp);
+                }
+            }
+        }
+        solver_generate(child);
+        ++result->nodes;
+        ++depth;
+    }
+
+    // the search ran out, so every position in the table is lost
+    if (cache && !truncated) {
+        for (size_t i = 0; i <= solver->table_mask; ++i) {
+            if (solver->table[i]) position_cache_put(cache, solver->table[i], stamp, (CacheEntry) {CACHE_LOST, 0, 0});
+        }
+    }
+    return SOLVE_LOST;
+}
+
+bool replays_to_win(Game *game, SolveResult *result) {
+    // whether result holds every move of its solution and they win game, a line that ends in a cache hit doesn't
+    if (result->status != SOLVE_WON || result->cached > 0) return false;
+    Game *copy = malloc(sizeof(Game));
+    if (!copy) return false;
+    *copy = *game;
+    bool won = true;
+    for (int i = 0; won && i < result->length; ++i) won = apply_move(copy, result->moves[i]);
+    won = won && is_game_won(copy);
+    free(copy);
+    return won;
+}
+
+int solve_difficulty(SolveResult *result, long node_limit) {
+    // 0 (solved straight away) to 100 (needed the whole node budget), on a log scale of the search effort
+    if (result->status != SOLVE_WON) return 100;
+    double nodes = (double) (result->nodes > result->length ? result->nodes - result->length : 0);
+    double limit = (double) node_limit;
+    int difficulty = 0;
+    while (nodes >= 1 && difficulty < 100) {
+        nodes /= 2;
+        ++difficulty;
+    }
+    int scale = 0;
+    while (limit >= 1) {
+        limit /= 2;
+        ++scale;
+    }
+    difficulty = scale > 0 ? difficulty * 100 / scale : 0;
+    return difficulty > 100 ? 100 : difficulty;
+}
+
+#endif
+#endif
@@ -0,0 +1,338 @@
+#ifndef SOLITAIRE_SPECTATE
+#define SOLITAIRE_SPECTATE
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "./cards.h"
+
+// piles as numbered in deltas: tableau columns, then the waste, the stock and the foundations
+#define PILE_WASTE TABLEAU_COLUMNS
+#define PILE_STOCK (TABLEAU_COLUMNS + 1)
+#define PILE_FOUNDATION (TABLEAU_COLUMNS + 2)
+#define PILES (PILE_FOUNDATION + FOUNDATION_PILES)
+// room for the longest pile, a column or the stock
+#define PILE_CARDS (COLUMN_SLOTS > PILE_SLOTS ? COLUMN_SLOTS : PILE_SLOTS)
+
+// every message is a type byte, a payload length byte and the payload
+typedef enum {
+    SPECTATE_RESET = 1, // no payload, a snapshot follows
+    SPECTATE_PILE = 2, // pile, new count, first changed card, then the cards from there on (packed like pack_card)
+    SPECTATE_CURSOR = 3, // selected then moving: active, location, column, row
+} SpectateMessage;
+
+// the largest batch a single action can produce, well under PIPE_BUF so pipe writes stay atomic
+#define SPECTATE_MAX_BATCH (2 + PILES * (2 + 3 + PILE_CARDS) + 2 + 8)
+
+typedef struct {
+    uint8_t counts[PILES];
+    uint8_t cards[PILES][PILE_CARDS];
+    uint8_t cursor[8];
+} SpectateState;
+
+typedef struct {
+    int fd;
+    uint8_t *pending; // bytes not yet accepted by the socket
+    size_t pending_length;
+} Spectator;
+
+typedef struct {
+    // main thread side
+    int pipe_write;
+    SpectateState published;
+    bool resync; // a batch was dropped, send a whole snapshot next time
+
+    // server thread side, which keeps its own copy of the state for new spectators
+    int listener;
+    int pipe_read;
+    char *path;
+    pthread_t thread;
+    SpectateState mirror;
+} Spectate;
+
+void spectate_capture(Game *game, SpectateState *state);
+size_t spectate_diff(SpectateState *old, SpectateState *new, uint8_t *out);
+size_t spectate_snapshot(SpectateState *state, uint8_t *out);
+size_t spectate_apply(SpectateState *state, uint8_t *data, size_t length, bool *reset);
+void spectate_to_game(SpectateState *state, Game *game);
+Spectate *open_spectate(const char *path);
+void spectate_publish(Spectate *spectate, Game *game);
+void close_spectate(Spectate *spectate);
+
+#ifdef SOLITAIRE_SPECTATE_IMPLEMENTATION
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// a spectator that falls this far behind is dropped, it can reconnect for a fresh snapshot
+#define SPECTATOR_MAX_PENDING 65536
+#define SPECTATE_MAX_SPECTATORS 1024
+
+void spectate_capture(Game *game, SpectateState *state) {
+    for (int column = 0; column < TABLEAU_COLUMNS; ++column) {
+        int row = 0;
+        for (; row < COLUMN_SLOTS && game->tableau[column][row].rank != NO_RANK; ++row) {
+            state->cards[column][row] = pack_card(game->tableau[column][row]);
+        }
+        state->counts[column] = row;
+    }
+    int count = 0;
+    for (; count < PILE_SLOTS && game->waste[count].rank != NO_RANK; ++count) {
+        state->cards[PILE_WASTE][count] = pack_card(game->waste[count]) | 0x80;
+    }
+    state->counts[PILE_WASTE] = count;
+    for (count = 0; count < PILE_SLOTS && game->stock[count].rank != NO_RANK; ++count) {
+        state->cards[PILE_STOCK][count] = pack_card(game->stock[count]) & 0x7f;
+    }
+    state->counts[PILE_STOCK] = count;
+    for (int i = 0; i < FOUNDATION_PILES; ++i) {
+        state->cards[PILE_FOUNDATION + i][0] = pack_card(game->foundation[i]) | 0x80;
+        state->counts[PILE_FOUNDATION + i] = game->foundation[i].rank != NO_RANK;
+    }
+    CardPos cursor[2] = {game->selected, game->moving};
+    for (int i = 0; i < 2; ++i) {
+        state->cursor[i * 4] = cursor[i].active;
+        state->cursor[i * 4 + 1] = cursor[i].location;
+        state->cursor[i * 4 + 2] = cursor[i].column;
+        state->cursor[i * 4 + 3] = cursor[i].row;
+    }
+}
+
+size_t spectate_diff(SpectateState *old, SpectateState *new, uint8_t *out) {
+    // writes the messages that turn old into new, out needs SPECTATE_MAX_BATCH bytes
+    size_t length = 0;
+    for (int pile = 0; pile < PILES; ++pile) {
+        int count = new->counts[pile], start = 0;
+        int common = count < old->counts[pile] ? count : old->counts[pile];
+        while (start < common && old->cards[pile][start] == new->cards[pile][start]) ++start;
+        if (start == count && count == old->counts[pile]) continue;
+        out[length++] = SPECTATE_PILE;
+        out[length++] = 3 + count - start;
+        out[length++] = pile;
+        out[length++] = count;
+        out[length++] = start;
+        memcpy(&out[length], &new->cards[pile][start], count - start);
+        length += count - start;
+    }
+    if (memcmp(old->cursor, new->cursor, sizeof(new->cursor)) != 0) {
+        out[length++] = SPECTATE_CURSOR;
+        out[length++] = sizeof(new->cursor);
+        memcpy(&out[length], new->cursor, sizeof(new->cursor));
+        length += sizeof(new->cursor);
+    }
+    return length;
+}
+
+size_t spectate_snapshot(SpectateState *state, uint8_t *out) {
+    // a reset followed by every pile and the cursor
+    SpectateState empty = {0};
+    memset(empty.cursor, 0xff, sizeof(empty.cursor));
+    out[0] = SPECTATE_RESET;
+    out[1] = 0;
+    return 2 + spectate_diff(&empty, state, out + 2);
+}
+
+size_t spectate_apply(SpectateState *state, uint8_t *data, size_t length, bool *reset) {
+    // applies every complete message in data, returns how many bytes were used
+    size_t used = 0;
+    while (length - used >= 2 && length - used >= 2u + data[used + 1]) {
+        uint8_t type = data[used], size = data[used + 1], *payload = &data[used + 2];
+        if (type == SPECTATE_RESET) {
+            memset(state, 0, sizeof(*state));
+            if (reset) *reset = true;
+        } else if (type == SPECTATE_PILE && size >= 3 && payload[0] < PILES && payload[1] <= PILE_CARDS && payload[2] <= payload[1] &&
+                   size == 3 + payload[1] - payload[2]) {
+            state->counts[payload[0]] = payload[1];
+            memcpy(&state->cards[payload[0]][payload[2]], &payload[3], payload[1] - payload[2]);
+        } else if (type == SPECTATE_CURSOR && size == sizeof(state->cursor)) {
+            memcpy(state->cursor, payload, sizeof(state->cursor));
+        }
+        used += 2 + size;
+    }
+    return used;
+}
+
+void spectate_to_game(SpectateState *state, Game *game) {
+    for (int column = 0; column < TABLEAU_COLUMNS; ++column) {
+        for (int row = 0; row < COLUMN_SLOTS; ++row) {
+            game->tableau[column][row] = unpack_card(row < state->counts[column] ? state->cards[column][row] : 0);
+        }
+    }
+    for (int i = 0; i < PILE_SLOTS; ++i) {
+        game->waste[i] = unpack_card(i < state->counts[PILE_WASTE] ? state->cards[PILE_WASTE][i] : 0);
+        game->stock[i] = unpack_card(i < state->counts[PILE_STOCK] ? state->cards[PILE_STOCK][i] : 0);
+    }
+    for (int i = 0; i < FOUNDATION_PILES; ++i) {
+        game->foundation[i] = unpack_card(state->counts[PILE_FOUNDATION + i] ? state->cards[PILE_FOUNDATION + i][0] : 0);
+        game->foundation[i].visible = true;
+    }
+    CardPos *cursor[2] = {&game->selected, &game->moving};
+    for (int i = 0; i < 2; ++i) {
+        // clamped, so a bad stream can't point outside the piles
+        CardLocation location = state->cursor[i * 4 + 1] & 3;
+        int max_column = location == FOUNDATION ? FOUNDATION_PILES - 1 : location == TABLEAU ? TABLEAU_COLUMNS - 1 : 0;
+        int column = state->cursor[i * 4 + 2] > max_column ? max_column : state->cursor[i * 4 + 2];
+        int row = state->cursor[i * 4 + 3] > COLUMN_SLOTS - 1 ? COLUMN_SLOTS - 1 : state->cursor[i * 4 + 3];
+        *cursor[i] = (CardPos) {state->cursor[i * 4] == 1, location, column, row};
+    }
+}
+
+bool spectator_send(Spectator *spectator, uint8_t *data, size_t length) {
+    // queues data behind anything still pending and writes as much as the socket takes
+    // returns false if the spectator should be dropped
+    if (spectator->pending_length + length > SPECTATOR_MAX_PENDING) return false;
+    memcpy(spectator->pending + spectator->pending_length, data, length);
+    spectator->pending_length += length;
+    ssize_t written = send(spectator->fd, spectator->pending, spectator->pending_length, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (written < 0) return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    memmove(spectator->pending, spectator->pending + written, spectator->pending_length - written);
+    spectator->pending_length -= written;
+    return true;
+}
+
+void *spectate_thread(void *arg) {
+    // fans every batch from the game out to the spectators, the game itself never waits on a socket
+    Spectate *spectate = arg;
+    Spectator *spectators = calloc(SPECTATE_MAX_SPECTATORS, sizeof(Spectator));
+    struct pollfd *fds = calloc(SPECTATE_MAX_SPECTATORS + 2, sizeof(struct pollfd));
+    uint8_t *input = malloc(65536);
+    uint8_t snapshot[SPECTATE_MAX_BATCH];
+    size_t input_length = 0;
+    int count = 0;
+    if (!spectators || !fds || !input) goto done;
+
+    while (true) {
+        fds[0] = (struct pollfd) {spectate->pipe_read, POLLIN, 0};
+        fds[1] = (struct pollfd) {spectate->listener, POLLIN, 0};
+        for (int i = 0; i < count; ++i) {
+            fds[i + 2] = (struct pollfd) {spectators[i].fd, spectators[i].pending_length ? POLLOUT : 0, 0};
+        }
+        if (poll(fds, count + 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        // drop or flush spectators first, so the indices still match fds
+        for (int i = count - 1; i >= 0; --i) {
+            short events = fds[i + 2].revents;
+            if (!events) continue;
+            if (!(events & (POLLERR | POLLHUP | POLLNVAL)) && spectator_send(&spectators[i], NULL, 0)) continue;
+            close(spectators[i].fd);
+            free(spectators[i].pending);
+            spectators[i] = spectators[--count];
+        }
+
+        if (fds[0].revents) {
+            ssize_t got = read(spectate->pipe_read, input + input_length, 65536 - input_length);
+            if (got <= 0 && !(got < 0 && errno == EINTR)) break; // the game closed its end
+            if (got > 0) {
+                input_length += got;
+                size_t used = spectate_apply(&spectate->mirror, input, input_length, NULL);
+                for (int i = count - 1; i >= 0; --i) {
+                    if (spectator_send(&spectators[i], input, used)) continue;
+                    close(spectators[i].fd);
+                    free(spectators[i].pending);
+                    spectators[i] = spectators[--count];
+                }
+                memmove(input, input + used, input_length - used);
+                input_length -= used;
+            }
+        }
+
+        if (fds[1].revents & POLLIN) {
+            int fd = accept(spectate->listener, NULL, NULL);
+            if (fd >= 0) {
+                Spectator spectator = {fd, malloc(SPECTATOR_MAX_PENDING), 0};
+                if (count < SPECTATE_MAX_SPECTATORS && spectator.pending &&
+                    spectator_send(&spectator, snapshot, spectate_snapshot(&spectate->mirror, snapshot))) {
+                    spectators[count++] = spectator;
+                } else {
+                    close(fd);
+                    free(spectator.pending);
+                }
+            }
+        }
+    }
+
+    done:
+    for (int i = 0; i < count; ++i) {
+        close(spectators[i].fd);
+        free(spectators[i].pending);
+    }
+    free(spectators);
+    free(fds);
+    free(input);
+    return NULL;
+}
+
+Spectate *open_spectate(const char *path) {
+    // listens for spectators on a unix socket at path
+    Spectate *spectate = calloc(1, sizeof(Spectate));
+    if (!spectate) return NULL;
+    struct sockaddr_un address = {0};
+    address.sun_family = AF_UNIX;
+    int fds[2] = {-1, -1};
+    spectate->listener = -1;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        errno = ENAMETOOLONG;
+        goto fail;
+    }
+    strcpy(address.sun_path, path);
+    spectate->path = strdup(path);
+    spectate->listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (!spectate->path || spectate->listener < 0) goto fail;
+    unlink(path);
+    if (bind(spectate->listener, (struct sockaddr *) &address, sizeof(address)) != 0 || listen(spectate->listener, 64) != 0) goto fail;
+    if (pipe(fds) != 0) goto fail;
+    fcntl(fds[1], F_SETFL, O_NONBLOCK);
+    spectate->pipe_read = fds[0];
+    spectate->pipe_write = fds[1];
+    memset(spectate->mirror.cursor, 0xff, sizeof(spectate->mirror.cursor));
+    memset(spectate->published.cursor, 0xff, sizeof(spectate->published.cursor));
+    if (pthread_create(&spectate->thread, NULL, spectate_thread, spectate) != 0) goto fail;
+    return spectate;
+
+    fail:
+    if (fds[0] >= 0) close(fds[0]);
+    if (fds[1] >= 0) close(fds[1]);
+    if (spectate->listener >= 0) close(spectate->listener);
+    free(spectate->path);
+    free(spectate);
+    return NULL;
+}
+
+void spectate_publish(Spectate *spectate, Game *game) {
+    // call after every change to the game, sends only what changed since the last call
+    if (!spectate) return;
+    SpectateState state;
+    uint8_t batch[SPECTATE_MAX_BATCH];
+    spectate_capture(game, &state);
+    size_t length = spectate->resync ? spectate_snapshot(&state, batch) : spectate_diff(&spectate->published, &state, batch);
+    if (length == 0) return;
+    // batches are under PIPE_BUF, so the write is all or nothing
+    if (write(spectate->pipe_write, batch, length) != (ssize_t) length) {
+        spectate->resync = true;
+        return;
+    }
+    spectate->resync = false;
+    spectate->published = state;
+}
+
+void close_spectate(Spectate *spectate) {
+    if (!spectate) return;
+    close(spectate->pipe_write);
+    pthread_join(spectate->thread, NULL);
+    close(spectate->pipe_read);
+    close(spectate->listener);
+    unlink(spectate->path);
+    free(spectate->path);
+    free(spectate);
+}
+
+#endif
+#endif
@@ -0,0 +1,423 @@
+#ifndef SOLITAIRE_VERSIONS
+#define SOLITAIRE_VERSIONS
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "./cards.h"
+#include "./policy.h"
+#include "./playcheck.h"
+
+// persistent game versions, for exploring what-if lines: every pile is an immutable node, and a version is a table
+// of pile pointers plus the foundation tops, a move makes a new version with new nodes for the (at most two) piles
+// it changes that shares every other pile with its parent, so a tree of versions costs memory per move, not per
+// position, and moving between versions is just following a pointer
+// the rules are move_card()'s and a draw's, checkout_version() turns a version back into a Game for the screen
+// versions and piles are reference counted without locks, a tree of versions belongs to one thread
+
+#define VERSION_PILES (TABLEAU_COLUMNS + 2)
+#define VERSION_WASTE TABLEAU_COLUMNS
+#define VERSION_STOCK (TABLEAU_COLUMNS + 1)
+
+typedef struct {
+    uint32_t references;
+    uint8_t count;
+    uint8_t cards[]; // bottom to top, packed like pack_card(), waste cards face up and stock cards face down
+} VersionPile;
+
+typedef struct GameVersion {
+    uint32_t references; // one per child and one per holder
+    uint32_t depth; // moves since the root
+    struct GameVersion *parent; // NULL for a root
+    Move move; // the move that led here from parent
+    unsigned int seed;
+    uint8_t foundation[FOUNDATION_PILES]; // top card of each foundation, 0 if empty
+    VersionPile *piles[VERSION_PILES]; // the tableau columns, the waste and the stock, NULL when empty
+} GameVersion;
+
+// positions in each what-if tree that explore_versions() grows
+#define VERSION_TREE_NODES 4096
+
+typedef struct {
+    long trees;
+    long nodes;
+    double seconds;
+    size_t peak_bytes; // the most memory one tree held
+} ExploreResult;
+
+// bytes held by all live versions and piles
+extern size_t version_bytes;
+
+GameVersion *version_from_game(Game *game);
+GameVersion *version_apply(GameVersion *version, Move move);
+void retain_version(GameVersion *version);
+void release_version(GameVersion *version);
+void pack_version(GameVersion *version, PackedGame *packed);
+void checkout_version(GameVersion *version, Game *game);
+bool is_version_won(GameVersion *version);
+bool explore_versions(unsigned int first_seed, long deals, ExploreResult *result);
+bool explore_copies(unsigned int first_seed, long deals, ExploreResult *result);
+bool check_versions(unsigned int first_seed, long deals, long *nodes, char *message);
+
+#ifdef SOLITAIRE_VERSIONS_IMPLEMENTATION
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+size_t version_bytes = 0;
+
+VersionPile *create_version_pile(int count) {
+    // a pile of no cards is NULL
+    if (count == 0) return NULL;
+    VersionPile *pile = malloc(sizeof(VersionPile) + count);
+    if (!pile) return NULL;
+    pile->references = 1;
+    pile->count = (uint8_t) count;
+    version_bytes += sizeof(VersionPile) + count;
+    return pile;
+}
+
+void release_version_pile(VersionPile *pile) {
+    if (!pile || --pile->references > 0) return;
+    version_bytes -= sizeof(VersionPile) + pile->count;
+    free(pile);
+}
+
+static inline int version_pile_count(VersionPile *pile) {
+    return pile ? pile->count : 0;
+}
+
+GameVersion *create_version(GameVersion *parent) {
+    GameVersion *version = malloc(sizeof(GameVersion));
+    if (!version) return NULL;
+    if (parent) {
+        *version = *parent;
+    } else {
+        memset(version, 0, sizeof(GameVersion));
+    }
+    version->references = 1;
+    version->parent = parent;
+    retain_version(parent);
+    version_bytes += sizeof(GameVersion);
+    return version;
+}
+
+GameVersion *version_from_game(Game *game) {
+    // a root version, with the cards of game (not the cursor)
+    PackedGame packed;
+    pack_game(game, &packed);
+    GameVersion *version = create_version(NULL);
+    if (!version) return NULL;
+    version->seed = game->seed;
+    memcpy(version->foundation, packed.foundation, FOUNDATION_PILES);
+    int i = 0;
+    for (int pile = 0; pile < VERSION_PILES; ++pile) {
+        int count = pile < TABLEAU_COLUMNS ? packed.tableau_count[pile] : pile == VERSION_WASTE ? packed.waste_count : packed.stock_count;
+        if (count == 0) continue;
+        version->piles[pile] = create_version_pile(count);
+        if (!version->piles[pile]) {
+            release_version(version);
+            return NULL;
+        }
+        for (int j = 0; j < count; ++j) {
+            version->piles[pile]->cards[j] = pile == VERSION_WASTE ? packed.cards[i + j] | 0x80 : packed.cards[i + j];
+        }
+        i += count;
+    }
+    return version;
+}
+
+bool replace_version_pile(GameVersion *version, int pile, int count) {
+    // gives version a new node of count cards for pile, the old one is most likely still shared with the parent
+    VersionPile *replaced = create_version_pile(count);
+    if (count > 0 && !replaced) return false;
+    release_version_pile(version->piles[pile]);
+    version->piles[pile] = replaced;
+    return true;
+}
+
+GameVersion *version_apply(GameVersion *version, Move move) {
+    // a new version after move, which holds a reference to version, or NULL if move isn't legal (or out of memory)
+    // the piles the move doesn't change are shared with version
+    GameVersion *next = create_version(version);
+    if (!next) return NULL;
+    next->depth = version->depth + 1;
+    next->move = move;
+    for (int pile = 0; pile < VERSION_PILES; ++pile) {
+        if (next->piles[pile]) ++next->piles[pile]->references;
+    }
+    VersionPile *stock = version->piles[VERSION_STOCK], *waste = version->piles[VERSION_WASTE];
+    if (move.from.location == STOCK) {
+        if (stock) {
+            // draw the top of the stock onto the waste, face up
+            int waste_count = version_pile_count(waste);
+            if (!replace_version_pile(next, VERSION_WASTE, waste_count + 1)) goto fail;
+            if (waste) memcpy(next->piles[VERSION_WASTE]->cards, waste->cards, waste_count);
+            next->piles[VERSION_WASTE]->cards[waste_count] = stock->cards[stock->count - 1] | 0x80;
+            if (!replace_version_pile(next, VERSION_STOCK, stock->count - 1)) goto fail;
+            if (next->piles[VERSION_STOCK]) memcpy(next->piles[VERSION_STOCK]->cards, stock->cards, stock->count - 1);
+        } else if (waste) {
+            // turn the waste over, its top becomes the bottom of the stock
+            if (!replace_version_pile(next, VERSION_STOCK, waste->count)) goto fail;
+            for (int i = 0; i < waste->count; ++i) next->piles[VERSION_STOCK]->cards[i] = waste->cards[waste->count - 1 - i] & 0x7f;
+            if (!replace_version_pile(next, VERSION_WASTE, 0)) goto fail;
+        } else goto fail;
+        return next;
+    }
+
+    // the card (and the run above it) that moves
+    uint8_t card;
+    int amount = 1;
+    VersionPile *source = NULL;
+    if (move.from.location == TABLEAU) {
+        if (move.from.column < 0 || move.from.column >= TABLEAU_COLUMNS) goto fail;
+        source = version->piles[move.from.column];
+        if (move.from.row < 0 || move.from.row >= version_pile_count(source) || !(source->cards[move.from.row] & 0x80)) goto fail;
+        card = source->cards[move.from.row];
+        amount = source->count - move.from.row;
+    } else if (move.from.location == WASTE) {
+        if (!waste) goto fail;
+        source = waste;
+        card = waste->cards[waste->count - 1];
+    } else {
+        if (move.from.column < 0 || move.from.column >= FOUNDATION_PILES || !version->foundation[move.from.column]) goto fail;
+        card = version->foundation[move.from.column] | 0x80;
+    }
+
+    if (move.to.location == TABLEAU) {
+        if (move.to.column < 0 || move.to.column >= TABLEAU_COLUMNS) goto fail;
+        if (move.from.location == TABLEAU && move.from.column == move.to.column) goto fail;
+        VersionPile *destination = version->piles[move.to.column];
+        int height = version_pile_count(destination);
+        Card above = height > 0 ? unpack_card(destination->cards[height - 1]) : unpack_card(0);
+        if (move.to.row != (height > 0 ? height - 1 : 0) || (height > 0 && !above.visible)) goto fail;
+        if (!can_stack(unpack_card(card), above, false) || height + amount > COLUMN_SLOTS - 1) goto fail;
+        if (!replace_version_pile(next, move.to.column, height + amount)) goto fail;
+        if (destination) memcpy(next->piles[move.to.column]->cards, destination->cards, height);
+        if (move.from.location == TABLEAU) {
+            memcpy(next->piles[move.to.column]->cards + height, source->cards + move.from.row, amount);
+        } else {
+            next->piles[move.to.column]->cards[height] = card;
+        }
+    } else if (move.to.location == FOUNDATION) {
+        if (move.to.column < 0 || move.to.column >= FOUNDATION_PILES || move.from.location == FOUNDATION || amount != 1) goto fail;
+        if (!can_stack(unpack_card(card), unpack_card(version->foundation[move.to.column]), true)) goto fail;
+        next->foundation[move.to.column] = card & 0x7f;
+    } else goto fail;
+
+    // take the card off its pile, a column turns its new top card face up
+    if (move.from.location == TABLEAU) {
+        if (!replace_version_pile(next, move.from.column, move.from.row)) goto fail;
+        VersionPile *rest = next->piles[move.from.column];
+        if (rest) {
+            memcpy(rest->cards, source->cards, move.from.row);
+            rest->cards[rest->count - 1] |= 0x80;
+        }
+    } else if (move.from.location == WASTE) {
+        if (!replace_version_pile(next, VERSION_WASTE, waste->count - 1)) goto fail;
+        if (next->piles[VERSION_WASTE]) memcpy(next->piles[VERSION_WASTE]->cards, waste->cards, waste->count - 1);
+    } else {
+        // a foundation is its top card, one rank lower is the card under it
+        uint8_t *top = &next->foundation[move.from.column];
+        *top = (*top & 15) == ACE ? 0 : *top - 1;
+    }
+    return next;
+
+fail:
+    release_version(next);
+    return NULL;
+}
+
+void retain_version(GameVersion *version) {
+    if (version) ++version->references;
+}
+
+void release_version(GameVersion *version) {
+    // frees the version once nothing holds it, and its ancestors that only it held, without recursing
+    while (version && --version->references == 0) {
+        for (int pile = 0; pile < VERSION_PILES; ++pile) release_version_pile(version->piles[pile]);
+        GameVersion *parent = version->parent;
+        version_bytes -= sizeof(GameVersion);
+        free(version);
+        version = parent;
+    }
+}
+
+void pack_version(GameVersion *version, PackedGame *packed) {
+    // the same bytes as pack_game() of the position
+    memcpy(packed->foundation, version->foundation, FOUNDATION_PILES);
+    int i = 0;
+    for (int pile = 0; pile < VERSION_PILES; ++pile) {
+        VersionPile *cards = version->piles[pile];
+        int count = version_pile_count(cards);
+        if (pile < TABLEAU_COLUMNS) {
+            packed->tableau_count[pile] = count;
+            if (count) memcpy(packed->cards + i, cards->cards, count);
+        } else {
+            if (pile == VERSION_WASTE) packed->waste_count = count;
+            else packed->stock_count = count;
+            for (int j = 0; j < count; ++j) packed->cards[i + j] = cards->cards[j] & 0x7f;
+        }
+        i += count;
+    }
+    memset(packed->cards + i, 0, DECK_CARDS - i);
+}
+
+void checkout_version(GameVersion *version, Game *game) {
+    // game becomes the position of version, with the cursor back at the start
+    PackedGame packed;
+    pack_version(version, &packed);
+    unpack_game(&packed, game);
+    game->seed = version->seed;
+}
+
+bool is_version_won(GameVersion *version) {
+    for (int i = 0; i < FOUNDATION_PILES; ++i) {
+        if ((version->foundation[i] & 15) != KING) return false;
+    }
+    return true;
+}
+
+// what-if trees: every node after the deal is a random legal move from a random earlier node, the same tree for
+// a seed whichever way it is kept
+static inline uint64_t explore_random(uint64_t *rng, uint64_t bound) {
+    return (policy_random(rng) >> 32) * bound >> 32;
+}
+
+bool explore_versions(unsigned int first_seed, long deals, ExploreResult *result) {
+    // grows a tree of VERSION_TREE_NODES versions for each deal
+    *result = (ExploreResult) {0};
+    GameVersion **nodes = malloc(sizeof(GameVersion *) * VERSION_TREE_NODES);
+    Game *game = malloc(sizeof(Game));
+    Move *moves = malloc(sizeof(Move) * MAX_LEGAL_MOVES);
+    bool ok = nodes && game && moves;
+    double start = monotonic_seconds();
+    for (long deal = 0; ok && deal < deals; ++deal) {
+        unsigned int seed = first_seed + (unsigned int) deal;
+        uint64_t rng = deal_random(seed, 0x80000000u) | 1;
+        size_t base = version_bytes;
+        deal_game(game, seed);
+        nodes[0] = version_from_game(game);
+        int count = nodes[0] != NULL;
+        for (; count > 0 && count < VERSION_TREE_NODES; ++count) {
+            GameVersion *parent = nodes[explore_random(&rng, count)];
+            checkout_version(parent, game);
+            int legal = get_legal_moves(game, moves);
+            nodes[count] = legal > 0 ? version_apply(parent, moves[explore_random(&rng, legal)]) : parent;
+            if (legal == 0) retain_version(parent);
+            if (!nodes[count]) break;
+        }
+        ok = count == VERSION_TREE_NODES;
+        if (version_bytes - base > result->peak_bytes) result->peak_bytes = version_bytes - base;
+        for (int i = 0; i < count; ++i) release_version(nodes[i]);
+        ++result->trees;
+        result->nodes += count;
+    }
+    result->seconds = monotonic_seconds() - start;
+    free(nodes);
+    free(game);
+    free(moves);
+    return ok;
+}
+
+bool explore_copies(unsigned int first_seed, long deals, ExploreResult *result) {
+    // the same trees with a whole Game per node, through apply_move()
+    *result = (ExploreResult) {0};
+    Game **nodes = malloc(sizeof(Game *) * VERSION_TREE_NODES);
+    Move *moves = malloc(sizeof(Move) * MAX_LEGAL_MOVES);
+    bool ok = nodes && moves;
+    double start = monotonic_seconds();
+    for (long deal = 0; ok && deal < deals; ++deal) {
+        unsigned int seed = first_seed + (unsigned int) deal;
+        uint64_t rng = deal_random(seed, 0x80000000u) | 1;
+        int count = 0;
+        nodes[0] = malloc(sizeof(Game));
+        if (nodes[0]) deal_game(nodes[count++], seed);
+        for (; count > 0 && count < VERSION_TREE_NODES; ++count) {
+            Game *parent = nodes[explore_random(&rng, count)];
+            int legal = get_legal_moves(parent, moves);
+            nodes[count] = malloc(sizeof(Game));
+            if (!nodes[count]) break;
+            memcpy(nodes[count], parent, sizeof(Game));
+            if (legal > 0) apply_move(nodes[count], moves[explore_random(&rng, legal)]);
+        }
+        ok = count == VERSION_TREE_NODES;
+        result->peak_bytes = sizeof(Game) * VERSION_TREE_NODES;
+        for (int i = 0; i < count; ++i) free(nodes[i]);
+        ++result->trees;
+        result->nodes += count;
+    }
+    result->seconds = monotonic_seconds() - start;
+    free(nodes);
+    free(moves);
+    return ok;
+}
+
+bool check_versions(unsigned int first_seed, long deals, long *nodes, char *message) {
+    // grows the trees both ways at once, every version has to pack to the same bytes as its Game, message
+    // (PLAY_CHECK_MESSAGE bytes) says where they first didn't
+    GameVersion **versions = malloc(sizeof(GameVersion *) * VERSION_TREE_NODES);
+    Game *games = malloc(sizeof(Game) * VERSION_TREE_NODES);
+    Game *game = malloc(sizeof(Game));
+    Move *moves = malloc(sizeof(Move) * MAX_LEGAL_MOVES);
+    bool ok = versions && games && game && moves;
+    if (!ok) strcpy(message, "out of memory");
+    *nodes = 0;
+    PackedGame got;
+    for (long deal = 0; ok && deal < deals; ++deal) {
+        unsigned int seed = first_seed + (unsigned int) deal;
+        uint64_t rng = deal_random(seed, 0x80000000u) | 1;
+        deal_game(&games[0], seed);
+        versions[0] = version_from_game(&games[0]);
+        int count = versions[0] != NULL;
+        if (!count) {
+            strcpy(message, "out of memory");
+            ok = false;
+        }
+        for (; ok && count < VERSION_TREE_NODES; ++count) {
+            int parent = (int) explore_random(&rng, count);
+            checkout_version(versions[parent], game);
+            int legal = get_legal_moves(game, moves);
+            if (!check_listed_moves(&games[parent], moves, legal, message)) {
+                prefix_check_message(message, "seed %u node %d checked out", seed, parent);
+                ok = false;
+                break;
+            }
+            games[count] = games[parent];
+            if (legal == 0) {
+                versions[count] = versions[parent];
+                retain_version(versions[parent]);
+                continue;
+            }
+            Move move = moves[explore_random(&rng, legal)];
+            versions[count] = version_apply(versions[parent], move);
+            if (!versions[count]) {
+                char text[16];
+                snprintf(message, PLAY_CHECK_MESSAGE, "seed %u node %d: %s is not legal on the version", seed, count, format_move(move, text));
+                ok = false;
+                break;
+            }
+            pack_version(versions[count], &got);
+            if (!check_played_move(&games[count], move, &got, is_version_won(versions[count]), message)) {
+                prefix_check_message(message, "seed %u node %d", seed, count);
+                ok = false;
+                break;
+            }
+        }
+        for (int i = 0; i < count; ++i) release_version(versions[i]);
+        if (ok && version_bytes != 0) {
+            snprintf(message, PLAY_CHECK_MESSAGE, "seed %u: %lu bytes still held after releasing every version", seed, (unsigned long) version_bytes);
+            ok = false;
+        }
+        *nodes += count;
+    }
+    free(versions);
+    free(games);
+    free(game);
+    free(moves);
+    return ok;
+}
+
+#endif
+#endif
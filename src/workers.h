@@ -0,0 +1,37 @@
+#ifndef SOLITAIRE_WORKERS
+#define SOLITAIRE_WORKERS
+
+#include <stddef.h>
+
+// one function run on a number of threads, each with its own argument
+// the calling thread runs the first worker itself, and any worker a thread couldn't be started for, so the work
+// always gets done: split evenly it all runs, taken from a shared queue the late workers find it empty
+
+void run_workers(void *(*work)(void *), void *args, size_t arg_size, int threads);
+
+#ifdef SOLITAIRE_WORKERS_IMPLEMENTATION
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+void run_workers(void *(*work)(void *), void *args, size_t arg_size, int threads) {
+    // worker t gets args + t * arg_size, an arg_size of 0 gives every worker the same args
+    if (threads < 1) threads = 1;
+    pthread_t *ids = malloc(sizeof(pthread_t) * threads);
+    bool *started = calloc(threads, sizeof(bool));
+    for (int t = 1; ids && started && t < threads; ++t) {
+        started[t] = pthread_create(&ids[t], NULL, work, (char *) args + t * arg_size) == 0;
+    }
+    for (int t = 0; t < threads; ++t) {
+        if (!started || !started[t]) work((char *) args + t * arg_size);
+    }
+    for (int t = 1; started && t < threads; ++t) {
+        if (started[t]) pthread_join(ids[t], NULL);
+    }
+    free(ids);
+    free(started);
+}
+
+#endif
+#endif